@@ -41,6 +41,7 @@
 #include "net/uip.h"
 #include "net/uip-ds6.h"
 #include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"
 
 #include "net/netstack.h"
 #include "dev/button-sensor.h"
@@ -54,10 +55,70 @@
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
 
+#if BR_CONF_PERSIST
+#include "br-config.h"
+#endif
+#include "slip-bridge.h"
+#if ROUTE_STORE
+#include "route-store.h"
+#endif
+#if BR_CONF_AUTO_REPAIR
+#include "br-repair.h"
+#endif
+#if BR_CONF_TRAFFIC
+#include "br-traffic.h"
+#endif
+#if WITH_COAP
+#include "erbium.h"
+#endif
+#if COAP_PROXY
+#include "coap-proxy.h"
+#endif
+#if COAP_PROXY_CONF_COCOA
+#include "coap-rto.h"
+#endif
+#if BR_CONF_AGGREGATE
+#include "br-aggregate.h"
+#endif
+#if BR_CONF_SLOTS
+#include "br-slots.h"
+#endif
+#if BR_CONF_MESH_AGG
+#include "br-mesh-agg.h"
+#endif
+#if BR_CONF_TRACE
+#include "br-trace.h"
+#endif
+#if BR_CONF_RD
+#include "br-rd.h"
+#endif
+#if BR_CONF_MULTI
+#include "br-multi.h"
+#endif
+
 uint16_t dag_id[] = {0x1111, 0x1100, 0, 0, 0, 0, 0, 0x0011};
 
 static uip_ipaddr_t prefix;
 static uint8_t prefix_set;
+static rpl_dag_t *dag;
+
+#if BR_CONF_PERSIST
+static struct br_config config;
+static uint8_t config_loaded;
+static uint8_t prefix_changed;
+#endif
+
+#if ROUTE_STORE
+/* Progress of the route store on the console, for route-stress-simulation */
+static struct uip_ds6_notification store_notification;
+static uint16_t store_peak_printed;
+static uint16_t store_evicted_printed;
+#endif
+
+/* Boot instrumentation, in clock ticks since boot. */
+static clock_time_t dag_ticks;
+static clock_time_t first_dio_ticks;
+#define TICKS_TO_MS(t) ((unsigned long)(t) * 1000 / CLOCK_SECOND)
 
 PROCESS(border_router_process, "Border router process");
 
@@ -142,6 +203,105 @@ ipaddr_add(const uip_ipaddr_t *addr)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if BR_CONF_TRAFFIC
+static void
+iid_add(const uint8_t *iid)
+{
+  ADD("%x:%x:%x:%x", (iid[0] << 8) + iid[1], (iid[2] << 8) + iid[3],
+      (iid[4] << 8) + iid[5], (iid[6] << 8) + iid[7]);
+}
+/*---------------------------------------------------------------------------*/
+/* The counters as JSON, at /traffic */
+static
+PT_THREAD(generate_traffic(struct httpd_state *s))
+{
+  static int i;
+  static uint8_t first;
+  struct br_traffic *t;
+#if BUF_USES_STACK
+  char buf[256];
+#endif
+
+  PSOCK_BEGIN(&s->sout);
+
+  SEND_STRING(&s->sout, "[");
+  first = 1;
+  for(i = 0; i <= BR_TRAFFIC_ENTRIES; i++) {
+    t = &br_traffic[i];
+    if(t->down_packets == 0 && t->up_packets == 0 && t->no_route == 0) {
+      continue;
+    }
+#if BUF_USES_STACK
+    bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+    blen = 0;
+#endif
+    ADD("%s{\"iid\":\"", first ? "" : ",\n");
+    if(i < BR_TRAFFIC_ENTRIES) {
+      iid_add(t->iid);
+    } else {
+      ADD("other");
+    }
+    ADD("\",\"down_packets\":%u,\"down_bytes\":%lu,",
+        t->down_packets, (unsigned long)t->down_bytes);
+    ADD("\"up_packets\":%u,\"up_bytes\":%lu,\"no_route\":%u}",
+        t->up_packets, (unsigned long)t->up_bytes, t->no_route);
+    first = 0;
+    SEND_STRING(&s->sout, buf);
+  }
+  SEND_STRING(&s->sout, "]\n");
+
+  PSOCK_END(&s->sout);
+}
+#endif /* BR_CONF_TRAFFIC */
+/*---------------------------------------------------------------------------*/
+#if BR_CONF_TRACE
+/* The packet trace as text, at /dump, one record per line in hex:
+   ticks rtimer flags proto len src dst mid code type */
+static
+PT_THREAD(generate_dump(struct httpd_state *s))
+{
+  static int i;
+  static uint8_t first;
+  struct br_trace_record *r;
+#if BUF_USES_STACK
+  char buf[80];
+#endif
+
+  PSOCK_BEGIN(&s->sout);
+
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("# clock %u %u\n", (unsigned)CLOCK_SECOND, (unsigned)RTIMER_SECOND);
+  SEND_STRING(&s->sout, buf);
+  /* Sending the dump adds records of its own, which may overwrite the
+     oldest ones before they are sent: trace2pcap sorts them again */
+  first = br_trace_next;
+  for(i = 0; i < BR_TRACE_RECORDS; i++) {
+    r = &br_trace[(first + i) % BR_TRACE_RECORDS];
+    if(r->len == 0) {
+      continue;
+    }
+#if BUF_USES_STACK
+    bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+    blen = 0;
+#endif
+    ADD("%lx %x %x %x %x %02x%02x%02x%02x %02x%02x%02x%02x %x %x %x\n",
+        (unsigned long)r->ticks, r->rtimer, r->flags, r->proto, r->len,
+        r->src[0], r->src[1], r->src[2], r->src[3],
+        r->dst[0], r->dst[1], r->dst[2], r->dst[3],
+        r->mid, r->code, r->type);
+    SEND_STRING(&s->sout, buf);
+  }
+
+  PSOCK_END(&s->sout);
+}
+#endif /* BR_CONF_TRACE */
+/*---------------------------------------------------------------------------*/
 static
 PT_THREAD(generate_routes(struct httpd_state *s))
 {
@@ -213,7 +373,19 @@ PT_THREAD(generate_routes(struct httpd_state *s))
       }
 #endif
   }
+#if ROUTE_STORE
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("</pre>Routes (%u of %u, peak %u, %u evicted, %u rejected)<pre>",
+      uip_ds6_route_num_routes(), ROUTE_STORE_ROUTES, route_store_stats.peak,
+      route_store_stats.evicted, route_store_stats.rejected);
+#else
   ADD("</pre>Routes<pre>");
+#endif
   SEND_STRING(&s->sout, buf);
 #if BUF_USES_STACK
   bufptr = buf; bufend = bufptr + sizeof(buf);
@@ -260,7 +432,189 @@ PT_THREAD(generate_routes(struct httpd_state *s))
     blen = 0;
 #endif
   }
+  ADD("</pre>Boot<pre>DODAG root after %lu ms, first DIO after %lu ms</pre>",
+      TICKS_TO_MS(dag_ticks), TICKS_TO_MS(first_dio_ticks));
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("SLIP<pre>in %u, dropped %u, too long %u, peak %u bytes\n",
+      slip_bridge_stats.rx_frames, slip_bridge_stats.rx_dropped,
+      slip_bridge_stats.rx_oversize, slip_bridge_stats.rx_peak);
+  ADD("out %u, not bounced back %u\n",
+      slip_bridge_stats.tx_frames, slip_bridge_stats.tx_bounced);
+#if SLIP_BRIDGE_CONF_PRIORITY
+  for(i = 1; i >= 0; i--) {
+    ADD("%s %u, waited %lu ms on average, %u ms max\n",
+        i ? "commands" : "others", slip_bridge_stats.class_frames[i],
+        slip_bridge_stats.class_frames[i] == 0 ? 0UL :
+        (unsigned long)(slip_bridge_stats.class_total_ms[i] /
+                        slip_bridge_stats.class_frames[i]),
+        slip_bridge_stats.class_max_ms[i]);
+  }
+#endif
+  ADD("</pre>");
+#if BR_CONF_AUTO_REPAIR
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Repair<pre>%u local, %u global, routes back in %u s (max %u s)%s\n",
+      br_repair_stats.local, br_repair_stats.global,
+      br_repair_stats.last_convergence, br_repair_stats.max_convergence,
+      br_repair_stats.converging ? ", repairing" : "");
+  ADD("baseline %u routes; last interval +%u -%u, %u without route</pre>",
+      br_repair_stats.baseline, br_repair_stats.added,
+      br_repair_stats.removed, br_repair_stats.bounced);
+#endif
+#if BR_CONF_RD
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Directory<pre>%u endpoints, %u registrations, %u refreshes, "
+      "%u expired, %u refused, %u lookups</pre>",
+      br_rd_stats.endpoints, br_rd_stats.registrations,
+      br_rd_stats.refreshes, br_rd_stats.expired, br_rd_stats.refused,
+      br_rd_stats.lookups);
+#endif
+#if BR_CONF_MULTI
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Routers<pre>DODAG ");
+  ipaddr_add((uip_ipaddr_t *)dag_id);
+  ADD(", preference %u\n%u routes reported, %u listings, %u overflows</pre>",
+      BR_CONF_PREFERENCE, br_multi_stats.reports, br_multi_stats.listings,
+      br_multi_stats.overflows);
+#endif
+#if BR_CONF_SLOTS
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Slots<pre>%u motes spread, %u rounds, %u sent, %u changed</pre>",
+      br_slots_stats.motes, br_slots_stats.rounds, br_slots_stats.sent,
+      br_slots_stats.changed);
+#endif
+#if BR_CONF_TRAFFIC
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Traffic (<a href=/traffic>JSON</a>)<pre>");
+  for(i = 0; i <= BR_TRAFFIC_ENTRIES; i++) {
+    if(br_traffic[i].down_packets == 0 && br_traffic[i].up_packets == 0 &&
+       br_traffic[i].no_route == 0) {
+      continue;
+    }
+    SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+    bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+    blen = 0;
+#endif
+    if(i < BR_TRAFFIC_ENTRIES) {
+      iid_add(br_traffic[i].iid);
+    } else {
+      ADD("other");
+    }
+    ADD(" down %u/%lu B, up %u/%lu B, no route %u\n",
+        br_traffic[i].down_packets, (unsigned long)br_traffic[i].down_bytes,
+        br_traffic[i].up_packets, (unsigned long)br_traffic[i].up_bytes,
+        br_traffic[i].no_route);
+  }
+  ADD("</pre>");
+#endif
+#if COAP_PROXY
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Proxy<pre>%u hits, %u coalesced, %u mesh requests, "
+      "%u retransmissions, %u timeouts\n",
+      coap_proxy_stats.hits, coap_proxy_stats.coalesced,
+      coap_proxy_stats.requests, coap_proxy_stats.retransmissions,
+      coap_proxy_stats.timeouts);
+  ADD("%u registrations, %u notifications relayed\n",
+      coap_proxy_stats.registrations, coap_proxy_stats.notifications);
+  if(coap_proxy_stats.announces > 0) {
+    SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+    bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+    blen = 0;
+#endif
+    ADD("%u announces, last routable %lu ms after boot\n",
+        coap_proxy_stats.announces,
+        (unsigned long)coap_proxy_stats.last_routable);
+  }
+#if BR_CONF_AGGREGATE
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("House: %u rooms, %u readings, %u notifications, %u unobserved, "
+      "%u missed\n", br_aggregate_stats.rooms, br_aggregate_stats.readings,
+      br_aggregate_stats.notifications, br_aggregate_stats.unobserved,
+      br_aggregate_stats.missed);
+#endif
+#if BR_CONF_MESH_AGG
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("Mesh: %u packets, %u readings, %u unobserved, up to %u hops\n",
+      br_mesh_agg_stats.packets, br_mesh_agg_stats.readings,
+      br_mesh_agg_stats.unobserved, br_mesh_agg_stats.max_hops);
+#endif
   ADD("</pre>");
+#if COAP_PROXY_CONF_COCOA
+  SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+  bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+  blen = 0;
+#endif
+  ADD("RTO<pre>");
+  for(i = 0; i < COAP_RTO_PEERS; i++) {
+    if(coap_rto_peers[i].rto == 0) {
+      continue;
+    }
+    SEND_STRING(&s->sout, buf);
+#if BUF_USES_STACK
+    bufptr = buf; bufend = bufptr + sizeof(buf);
+#else
+    blen = 0;
+#endif
+    iid_add(&coap_rto_peers[i].addr.u8[8]);
+    ADD(" RTT %u ms, RTO %u ms, %u exchanges, %u retransmissions, "
+        "%u give-ups\n", coap_rto_peers[i].rtt, coap_rto_peers[i].rto,
+        coap_rto_peers[i].exchanges, coap_rto_peers[i].retransmissions,
+        coap_rto_peers[i].giveups);
+  }
+  ADD("</pre>");
+#endif
+#endif
 
 #if WEBSERVER_CONF_FILESTATS
   static uint16_t numtimes;
@@ -281,9 +635,35 @@ PT_THREAD(generate_routes(struct httpd_state *s))
 httpd_simple_script_t
 httpd_simple_get_script(const char *name)
 {
-
+#if BR_CONF_TRAFFIC
+  /* Only the first character of the file name is kept */
+  if(name[0] == 't') {
+    return generate_traffic;
+  }
+#endif
+#if BR_CONF_TRACE
+  if(name[0] == 'd') {
+    return generate_dump;
+  }
+#endif
   return generate_routes;
 }
+/*---------------------------------------------------------------------------*/
+const char *
+httpd_simple_get_content_type(const char *name)
+{
+#if BR_CONF_TRAFFIC
+  if(name[0] == 't') {
+    return "Content-type: application/json\r\n\r\n";
+  }
+#endif
+#if BR_CONF_TRACE
+  if(name[0] == 'd') {
+    return "Content-type: text/plain\r\n\r\n";
+  }
+#endif
+  return "Content-type: text/html\r\n\r\n";
+}
 
 #endif /* WEBSERVER */
 
@@ -306,6 +686,30 @@ print_local_addresses(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if ROUTE_STORE
+static void
+store_changed(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+              int num_routes)
+{
+  /* Every 10 routes of a new peak, the first eviction and every 10th
+     after it, so that a full store does not flood the SLIP link. An
+     eviction is seen with the route added in its place. */
+  if(event != UIP_DS6_NOTIFICATION_ROUTE_ADD) {
+    return;
+  }
+  if(route_store_stats.peak >= store_peak_printed + 10 ||
+     (route_store_stats.peak == ROUTE_STORE_ROUTES &&
+      store_peak_printed != ROUTE_STORE_ROUTES) ||
+     (route_store_stats.evicted > 0 && store_evicted_printed == 0) ||
+     route_store_stats.evicted >= store_evicted_printed + 10) {
+    store_peak_printed = route_store_stats.peak;
+    store_evicted_printed = route_store_stats.evicted;
+    printf("Routes: %u/%u, %u evicted\n", uip_ds6_route_num_routes(),
+           ROUTE_STORE_ROUTES, route_store_stats.evicted);
+  }
+}
+#endif
+/*---------------------------------------------------------------------------*/
 void
 request_prefix(void)
 {
@@ -321,17 +725,88 @@ void
 set_prefix_64(uip_ipaddr_t *prefix_64)
 {
   uip_ipaddr_t ipaddr;
+#if BR_CONF_PERSIST
+  uip_ds6_addr_t *addr;
+
+  if(dag != NULL && !uip_ipaddr_prefixcmp(&prefix, prefix_64, 64)) {
+    /* The host assigned a different prefix than the one the DODAG was
+       started with: drop the address derived from the old one. */
+    memcpy(&ipaddr, &prefix, 16);
+    uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+    addr = uip_ds6_addr_lookup(&ipaddr);
+    if(addr != NULL) {
+      uip_ds6_addr_rm(addr);
+    }
+    prefix_changed = 1;
+  }
+#endif
   memcpy(&prefix, prefix_64, 16);
   memcpy(&ipaddr, prefix_64, 16);
   prefix_set = 1;
+#if BR_CONF_MULTI
+  /* The host end (re)started and does not know the routes yet */
+  br_multi_resync();
+#endif
+#if ROUTE_STORE
+  route_store_set_prefix(prefix_64);
+#endif
+#if BR_CONF_TRAFFIC
+  br_traffic_set_prefix(prefix_64);
+#endif
   uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
   uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+  process_poll(&border_router_process);
+}
+/*---------------------------------------------------------------------------*/
+#if BR_CONF_PERSIST
+static void
+save_config(void)
+{
+  memcpy(config.prefix, &prefix, sizeof(config.prefix));
+  memcpy(config.dag_id, dag_id, sizeof(config.dag_id));
+  config.dag_version = dag->version;
+  if(!br_config_save(&config)) {
+    PRINTA("Could not store the border router configuration\n");
+  }
+}
+#endif
+/*---------------------------------------------------------------------------*/
+static void
+start_dag(void)
+{
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE,(uip_ip6addr_t *)dag_id);
+  if(dag != NULL) {
+#if BR_CONF_MULTI
+    dag->preference = BR_CONF_PREFERENCE;
+#endif
+#if WITH_COAP
+    /* The motes reach the root at the DODAG ID, e.g. to announce or
+       register themselves, so the router answers on it */
+    if(uip_ds6_addr_lookup((uip_ipaddr_t *)dag_id) == NULL) {
+      uip_ds6_addr_add((uip_ipaddr_t *)dag_id, 0, ADDR_MANUAL);
+    }
+#endif
+#if BR_CONF_PERSIST
+    if(config_loaded) {
+      /* Continue the version sequence of the previous run, so that motes
+         still attached to the old DODAG move to this one right away. */
+      dag->version = config.dag_version;
+      RPL_LOLLIPOP_INCREMENT(dag->version);
+    }
+#endif
+    rpl_set_prefix(dag, &prefix, 64);
+    dag_ticks = clock_time();
+    PRINTF("created a new RPL dag\n");
+#if BR_CONF_PERSIST
+    save_config();
+#endif
+  }
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(border_router_process, ev, data)
 {
   static struct etimer et;
-  rpl_dag_t *dag;
+  static struct etimer dio_et;
 
   PROCESS_BEGIN();
 
@@ -348,6 +823,11 @@ PROCESS_THREAD(border_router_process, ev, data)
   SENSORS_ACTIVATE(button_sensor);
 
   PRINTF("RPL-Border router started\n");
+#if BR_CONF_MULTI
+  /* Each router roots a DODAG of its own: 1111:1100::11 for the first
+     one, ::12 for the second and so on, or from the MAC address */
+  dag_id[7] = 0x0010 + (BR_CONF_ID != 0 ? BR_CONF_ID : uip_lladdr.addr[7]);
+#endif
 #if 0
    /* The border router runs with a 100% duty cycle in order to ensure high
      packet reception rates.
@@ -355,34 +835,121 @@ PROCESS_THREAD(border_router_process, ev, data)
      cpu will interfere with establishing the SLIP connection */
   NETSTACK_MAC.off(1);
 #endif
- 
+
+#if BR_CONF_PERSIST
+  /* Bring the DODAG up from the configuration of the previous run, if any.
+     The host is still asked for the prefix and may replace it later. */
+  if(br_config_load(&config)) {
+    uip_ipaddr_t cached_prefix;
+
+    config_loaded = 1;
+    memset(&cached_prefix, 0, sizeof(cached_prefix));
+    memcpy(&cached_prefix, config.prefix, sizeof(config.prefix));
+#if BR_CONF_MULTI
+    /* The DODAG ID comes from BR_ID, not from the store: a version
+       stored for another DODAG ID does not apply to this one */
+    if(memcmp(dag_id, config.dag_id, sizeof(config.dag_id)) != 0) {
+      config_loaded = 0;
+    }
+#else
+    memcpy(dag_id, config.dag_id, sizeof(config.dag_id));
+#endif
+    set_prefix_64(&cached_prefix);
+    prefix_set = 0;
+    start_dag();
+    PRINTA("Started DODAG from stored prefix\n");
+  }
+#endif
+
   /* Request prefix until it has been received */
-  while(!prefix_set) {
+  while(!prefix_set && dag == NULL) {
     etimer_set(&et, CLOCK_SECOND);
     request_prefix();
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
   }
 
-  dag = rpl_set_root(RPL_DEFAULT_INSTANCE,(uip_ip6addr_t *)dag_id);
-  if(dag != NULL) {
-    rpl_set_prefix(dag, &prefix, 64);
-    PRINTF("created a new RPL dag\n");
+  if(dag == NULL) {
+    start_dag();
   }
 
   /* Now turn the radio on, but disable radio duty cycling.
    * Since we are the DAG root, reception delays would constrain mesh throughbut.
    */
   NETSTACK_MAC.off(1);
+
+#if ROUTE_STORE
+  uip_ds6_notification_add(&store_notification, store_changed);
+#endif
+#if BR_CONF_AUTO_REPAIR
+  br_repair_init();
+#endif
+#if BR_CONF_SLOTS
+  br_slots_init();
+#endif
+#if BR_CONF_MULTI
+  br_multi_init();
+#endif
+
+#if WITH_COAP
+  rest_init_engine();
+#if COAP_PROXY
+  coap_proxy_init();
+#endif
+#if BR_CONF_AGGREGATE
+  br_aggregate_init();
+#endif
+#if BR_CONF_MESH_AGG
+  br_mesh_agg_init();
+#endif
+#if BR_CONF_RD
+  br_rd_init();
+#endif
+#endif /* WITH_COAP */
   
 #if DEBUG || 1
   print_local_addresses();
 #endif
 
+  /* The first DIO goes out somewhere in the second half of the minimum
+     trickle interval; poll for it to report boot-to-first-DIO time. */
+  if(dag != NULL) {
+    etimer_set(&dio_et, CLOCK_SECOND / 16);
+  }
+  if(!prefix_set) {
+    etimer_set(&et, CLOCK_SECOND);
+    request_prefix();
+  }
+
   while(1) {
     PROCESS_YIELD();
     if (ev == sensors_event && data == &button_sensor) {
       PRINTF("Initiating global repair\n");
       rpl_repair_root(RPL_DEFAULT_INSTANCE);
+#if BR_CONF_PERSIST
+      save_config();
+#endif
+    } else if(ev == PROCESS_EVENT_TIMER && data == &dio_et) {
+      if(dag->instance->dio_send == 0) {
+        first_dio_ticks = clock_time();
+        PRINTA("DODAG root after %lu ms, first DIO after %lu ms\n",
+               TICKS_TO_MS(dag_ticks), TICKS_TO_MS(first_dio_ticks));
+      } else {
+        etimer_reset(&dio_et);
+      }
+    } else if(ev == PROCESS_EVENT_TIMER && data == &et) {
+      /* Running from the stored prefix, keep asking the host to confirm */
+      if(!prefix_set) {
+        request_prefix();
+        etimer_reset(&et);
+      }
+#if BR_CONF_PERSIST
+    } else if(ev == PROCESS_EVENT_POLL && prefix_changed) {
+      prefix_changed = 0;
+      PRINTA("Prefix changed by host, initiating global repair\n");
+      rpl_set_prefix(dag, &prefix, 64);
+      rpl_repair_root(RPL_DEFAULT_INSTANCE);
+      save_config();
+#endif
     }
   }
 
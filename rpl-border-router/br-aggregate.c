@@ -0,0 +1,393 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         House and room temperature aggregates at the border router
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "erbium.h"
+#include "er-coap-13.h"
+#include "coap-proxy.h"
+#include "br-aggregate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Rooms tracked, one per thermostat, each observed through a relay of
+   the proxy. house/avg and house/minmax cover them all; house/ewma leaves
+   out the rooms that do not fit in one REST_MAX_CHUNK_SIZE payload,
+   about 11 bytes per room. */
+#ifndef BR_AGGREGATE_CONF_ROOMS
+#define BR_AGGREGATE_ROOMS 10
+#else
+#define BR_AGGREGATE_ROOMS BR_AGGREGATE_CONF_ROOMS
+#endif
+
+/* Seconds between notifications, the period of the thermostats */
+#ifndef BR_AGGREGATE_CONF_PERIOD
+#define BR_AGGREGATE_PERIOD 5
+#else
+#define BR_AGGREGATE_PERIOD BR_AGGREGATE_CONF_PERIOD
+#endif
+
+/* Rooms silent for this many seconds are left out of the house values */
+#ifndef BR_AGGREGATE_CONF_STALE
+#define BR_AGGREGATE_STALE 60
+#else
+#define BR_AGGREGATE_STALE BR_AGGREGATE_CONF_STALE
+#endif
+
+/* Weight of a new temperature in the room average: 1 / 2^shift */
+#ifndef BR_AGGREGATE_CONF_EWMA_SHIFT
+#define BR_AGGREGATE_EWMA_SHIFT 3
+#else
+#define BR_AGGREGATE_EWMA_SHIFT BR_AGGREGATE_CONF_EWMA_SHIFT
+#endif
+
+#define TEMPERATURE_PATH "temperature"
+/* Room averages are kept in 1/16 degree, with BR_AGGREGATE_EWMA_SHIFT
+   more fraction bits so that they reach a steady temperature exactly */
+#define EWMA_SCALE 16
+#define EWMA(r) ((r)->ewma / (1 << BR_AGGREGATE_EWMA_SHIFT))
+
+#define AGG_AVG    0
+#define AGG_MINMAX 1
+#define AGG_EWMA   2
+
+struct room {
+  uip_ipaddr_t mote;
+  unsigned long seen;       /* clock_seconds() of the last temperature */
+  int16_t last;
+  int16_t ewma;             /* in 1/EWMA_SCALE degree, times 2^shift */
+  uint8_t used;
+};
+
+struct br_aggregate_stats br_aggregate_stats;
+
+static struct room rooms[BR_AGGREGATE_ROOMS];
+static struct ctimer period_timer;
+static struct uip_ds6_notification route_notification;
+static uint16_t obs_counter;
+static uint8_t new_readings;
+/* Last values notified: only changes are sent */
+static int16_t sent_avg;
+static int16_t sent_min;
+static int16_t sent_max;
+static uint8_t sent_rooms;
+
+EVENT_RESOURCE(house_avg, METHOD_GET, "house/avg",
+               "title=\"House temperature\";obs");
+EVENT_RESOURCE(house_minmax, METHOD_GET, "house/minmax",
+               "title=\"Coldest and warmest room\";obs");
+EVENT_RESOURCE(house_ewma, METHOD_GET, "house/ewma",
+               "title=\"Room temperature averages\";obs");
+/*---------------------------------------------------------------------------*/
+static int
+fresh(const struct room *r)
+{
+  return r->used && clock_seconds() - r->seen < BR_AGGREGATE_STALE;
+}
+/*---------------------------------------------------------------------------*/
+/* Mean in tenths of a degree, minimum and maximum of the rooms heard from
+   recently; returns their number. */
+static uint8_t
+house(int16_t *avg, int16_t *min, int16_t *max)
+{
+  int32_t sum = 0;
+  uint8_t n = 0;
+  int i;
+
+  for(i = 0; i < BR_AGGREGATE_ROOMS; i++) {
+    if(!fresh(&rooms[i])) {
+      continue;
+    }
+    if(n == 0 || rooms[i].last < *min) {
+      *min = rooms[i].last;
+    }
+    if(n == 0 || rooms[i].last > *max) {
+      *max = rooms[i].last;
+    }
+    sum += rooms[i].last;
+    n++;
+  }
+  if(n > 0) {
+    *avg = (sum * 10 + (sum < 0 ? -(n / 2) : n / 2)) / n;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static int
+put_tenths(char *buf, int size, int16_t tenths)
+{
+  return snprintf(buf, size, "%s%d.%d", tenths < 0 ? "-" : "",
+                  abs(tenths) / 10, abs(tenths) % 10);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the payload length, 0 if there is nothing to report yet */
+static int
+format(uint8_t which, char *buf, int size)
+{
+  struct room *r;
+  int16_t avg, min, max;
+  int len;
+  int n;
+  int i;
+
+  n = house(&avg, &min, &max);
+  if(n == 0) {
+    return 0;
+  }
+  switch(which) {
+  case AGG_AVG:
+    return put_tenths(buf, size, avg);
+  case AGG_MINMAX:
+    /* With the number of rooms the values cover */
+    return snprintf(buf, size, "{\"min\":%d,\"max\":%d,\"rooms\":%u}",
+                    min, max, n);
+  }
+
+  /* {"202":21.4,"303":19.8}, rooms that do not fit are left out */
+  len = 1;
+  buf[0] = '{';
+  for(i = 0; i < BR_AGGREGATE_ROOMS; i++) {
+    r = &rooms[i];
+    if(!fresh(r)) {
+      continue;
+    }
+    n = snprintf(buf + len, size - len, "%s\"%x\":", len > 1 ? "," : "",
+                 UIP_HTONS(r->mote.u16[7]));
+    if(n < size - len) {
+      n += put_tenths(buf + len + n, size - len - n,
+                      (int32_t)EWMA(r) * 10 / EWMA_SCALE);
+    }
+    if(n >= size - len - 1) {
+      break;
+    }
+    len += n;
+  }
+  buf[len++] = '}';
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+respond(void *response, uint8_t *buffer, uint8_t which)
+{
+  int len;
+
+  len = format(which, (char *)buffer, REST_MAX_CHUNK_SIZE);
+  if(len == 0) {
+    REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+    return;
+  }
+  REST.set_header_content_type(response, which == AGG_AVG ?
+                               REST.type.TEXT_PLAIN :
+                               REST.type.APPLICATION_JSON);
+  REST.set_header_max_age(response, BR_AGGREGATE_PERIOD);
+  REST.set_response_payload(response, buffer, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+notify(resource_t *resource, uint8_t which)
+{
+  coap_packet_t notification[1];
+  static char content[REST_MAX_CHUNK_SIZE];
+  int len;
+
+  len = format(which, content, sizeof(content));
+  if(len == 0) {
+    return;
+  }
+  coap_init_message(notification, COAP_TYPE_NON, REST.status.OK, 0);
+  coap_set_header_content_type(notification, which == AGG_AVG ?
+                               REST.type.TEXT_PLAIN :
+                               REST.type.APPLICATION_JSON);
+  coap_set_header_max_age(notification, BR_AGGREGATE_PERIOD);
+  coap_set_payload(notification, content, len);
+  REST.notify_subscribers(resource, obs_counter, notification);
+  br_aggregate_stats.notifications++;
+}
+/*---------------------------------------------------------------------------*/
+void
+house_avg_handler(void *request, void *response, uint8_t *buffer,
+                  uint16_t preferred_size, int32_t *offset)
+{
+  respond(response, buffer, AGG_AVG);
+}
+/*---------------------------------------------------------------------------*/
+void
+house_avg_event_handler(resource_t *r)
+{
+  notify(r, AGG_AVG);
+}
+/*---------------------------------------------------------------------------*/
+void
+house_minmax_handler(void *request, void *response, uint8_t *buffer,
+                     uint16_t preferred_size, int32_t *offset)
+{
+  respond(response, buffer, AGG_MINMAX);
+}
+/*---------------------------------------------------------------------------*/
+void
+house_minmax_event_handler(resource_t *r)
+{
+  notify(r, AGG_MINMAX);
+}
+/*---------------------------------------------------------------------------*/
+void
+house_ewma_handler(void *request, void *response, uint8_t *buffer,
+                   uint16_t preferred_size, int32_t *offset)
+{
+  respond(response, buffer, AGG_EWMA);
+}
+/*---------------------------------------------------------------------------*/
+void
+house_ewma_event_handler(resource_t *r)
+{
+  notify(r, AGG_EWMA);
+}
+/*---------------------------------------------------------------------------*/
+/* Once per period, the aggregates that changed are notified */
+static void
+period(void *ptr)
+{
+  int16_t avg, min, max;
+
+  ctimer_reset(&period_timer);
+  br_aggregate_stats.rooms = house(&avg, &min, &max);
+  if(br_aggregate_stats.rooms == 0) {
+    return;
+  }
+  obs_counter++;
+  if(avg != sent_avg) {
+    house_avg_event_handler(&resource_house_avg);
+    sent_avg = avg;
+  }
+  if(min != sent_min || max != sent_max ||
+     br_aggregate_stats.rooms != sent_rooms) {
+    house_minmax_event_handler(&resource_house_minmax);
+    sent_min = min;
+    sent_max = max;
+    sent_rooms = br_aggregate_stats.rooms;
+  }
+  if(new_readings) {
+    house_ewma_event_handler(&resource_house_ewma);
+    new_readings = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+temperature_input(const uip_ipaddr_t *mote, const char *path,
+                  const uint8_t *payload, uint8_t len)
+{
+  struct room *r = NULL;
+  struct room *stalest = NULL;
+  char text[8];
+  int16_t t;
+  int i;
+
+  if(len == 0 || len >= sizeof(text)) {
+    return;
+  }
+  memcpy(text, payload, len);
+  text[len] = '\0';
+  t = atoi(text);
+
+  for(i = 0; i < BR_AGGREGATE_ROOMS; i++) {
+    if(rooms[i].used && uip_ipaddr_cmp(&rooms[i].mote, mote)) {
+      r = &rooms[i];
+      break;
+    }
+    if(stalest == NULL || !rooms[i].used ||
+       (stalest->used && rooms[i].seen < stalest->seen)) {
+      stalest = &rooms[i];
+    }
+  }
+  if(r == NULL) {
+    /* A new room takes a free slot, or one of a room gone silent */
+    if(stalest == NULL || fresh(stalest)) {
+      br_aggregate_stats.missed++;
+      return;
+    }
+    r = stalest;
+    uip_ipaddr_copy(&r->mote, mote);
+    r->ewma = t * EWMA_SCALE * (1 << BR_AGGREGATE_EWMA_SHIFT);
+    r->used = 1;
+  } else {
+    r->ewma += t * EWMA_SCALE - EWMA(r);
+  }
+  r->last = t;
+  r->seen = clock_seconds();
+  new_readings = 1;
+  br_aggregate_stats.readings++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+observe(const uip_ipaddr_t *mote)
+{
+  if(!coap_proxy_observe(mote, TEMPERATURE_PATH, temperature_input)) {
+    PRINTF("br-aggregate: no relay for ");
+    PRINT6ADDR(mote);
+    PRINTF("\n");
+    br_aggregate_stats.unobserved++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_changed(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+              int num_routes)
+{
+  if(event == UIP_DS6_NOTIFICATION_ROUTE_ADD) {
+    observe(route);
+  } else if(event == UIP_DS6_NOTIFICATION_ROUTE_RM) {
+    coap_proxy_unobserve(route, TEMPERATURE_PATH);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_aggregate_init(void)
+{
+  uip_ds6_route_t *r;
+
+  rest_activate_event_resource(&resource_house_avg);
+  rest_activate_event_resource(&resource_house_minmax);
+  rest_activate_event_resource(&resource_house_ewma);
+
+  uip_ds6_notification_add(&route_notification, route_changed);
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    observe(&r->ipaddr);
+  }
+  ctimer_set(&period_timer, BR_AGGREGATE_PERIOD * CLOCK_SECOND, period, NULL);
+}
+/*---------------------------------------------------------------------------*/
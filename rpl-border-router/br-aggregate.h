@@ -0,0 +1,62 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         House and room temperature aggregates at the border router
+ *
+ *         The router observes /temperature on every mote it has a route
+ *         to, through the CoAP proxy, and keeps the last value and an
+ *         exponentially weighted moving average of each room. Upstream
+ *         clients observe the aggregates instead of every mote:
+ *         house/avg (mean of the current room temperatures), house/minmax
+ *         (with the number of rooms both cover) and house/ewma (the
+ *         average of each room, keyed by the last group of the mote
+ *         address). Changed aggregates are notified at most once per
+ *         period, whatever the number of rooms.
+ */
+
+#ifndef __BR_AGGREGATE_H__
+#define __BR_AGGREGATE_H__
+
+#include "contiki.h"
+
+struct br_aggregate_stats {
+  uint16_t readings;      /* temperatures received from the motes */
+  uint16_t notifications; /* aggregate changes notified upstream */
+  uint8_t rooms;          /* rooms with a recent temperature */
+  uint8_t unobserved;     /* motes the proxy had no relay left for */
+  uint16_t missed;        /* readings of rooms with no slot left */
+};
+
+extern struct br_aggregate_stats br_aggregate_stats;
+
+/* Activates the resources; the CoAP proxy must be running. */
+void br_aggregate_init(void);
+
+#endif /* __BR_AGGREGATE_H__ */
@@ -0,0 +1,116 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Persistent border router configuration (Coffee backed)
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/crc16.h"
+#include "br-config.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#ifndef BR_CONFIG_CONF_FILENAME
+#define BR_CONFIG_FILENAME "brcfg"
+#else
+#define BR_CONFIG_FILENAME BR_CONFIG_CONF_FILENAME
+#endif
+
+/* Bumped whenever struct br_config changes layout. */
+#define BR_CONFIG_MAGIC 0xB1
+
+struct br_config_record {
+  uint8_t magic;
+  struct br_config config;
+  uint16_t crc;
+};
+/*---------------------------------------------------------------------------*/
+static uint16_t
+record_crc(const struct br_config_record *record)
+{
+  return crc16_data((const unsigned char *)record,
+                    offsetof(struct br_config_record, crc), 0);
+}
+/*---------------------------------------------------------------------------*/
+int
+br_config_load(struct br_config *config)
+{
+  struct br_config_record record;
+  int fd;
+  int len;
+
+  fd = cfs_open(BR_CONFIG_FILENAME, CFS_READ);
+  if(fd < 0) {
+    PRINTF("br-config: no stored configuration\n");
+    return 0;
+  }
+  len = cfs_read(fd, &record, sizeof(record));
+  cfs_close(fd);
+
+  if(len != sizeof(record) || record.magic != BR_CONFIG_MAGIC ||
+     record.crc != record_crc(&record)) {
+    PRINTF("br-config: stored configuration is invalid\n");
+    return 0;
+  }
+  memcpy(config, &record.config, sizeof(struct br_config));
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_config_save(const struct br_config *config)
+{
+  struct br_config_record record;
+  int fd;
+  int len;
+
+  memset(&record, 0, sizeof(record));
+  record.magic = BR_CONFIG_MAGIC;
+  memcpy(&record.config, config, sizeof(struct br_config));
+  record.crc = record_crc(&record);
+
+  /* Reserve the file once so that later rewrites of the fixed-size record
+     go through Coffee's micro log instead of relocating the file. */
+  cfs_coffee_reserve(BR_CONFIG_FILENAME, sizeof(record));
+  fd = cfs_open(BR_CONFIG_FILENAME, CFS_WRITE);
+  if(fd < 0) {
+    PRINTF("br-config: could not open %s\n", BR_CONFIG_FILENAME);
+    return 0;
+  }
+  len = cfs_write(fd, &record, sizeof(record));
+  cfs_close(fd);
+  return len == sizeof(record);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,132 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Temperature readings aggregated over the mesh, at the root
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "coap-proxy.h"
+#include "mesh-agg.h"
+#include "br-mesh-agg.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#define TEMPERATURE_PATH "temperature"
+
+struct br_mesh_agg_stats br_mesh_agg_stats;
+
+static struct uip_udp_conn *conn;
+
+PROCESS(br_mesh_agg_process, "Mesh aggregation");
+
+/*---------------------------------------------------------------------------*/
+static void
+deliver(const uip_ipaddr_t *prefix, const uint8_t *reading)
+{
+  uip_ipaddr_t mote;
+  char text[6];
+  int len;
+
+  memcpy(&mote.u8[0], &prefix->u8[0], 8);
+  memcpy(&mote.u8[8], &reading[MESH_AGG_IID], 8);
+  len = snprintf(text, sizeof(text), "%u",
+                 (reading[MESH_AGG_TEMP] << 8) | reading[MESH_AGG_TEMP + 1]);
+  if(reading[MESH_AGG_HOPS] > br_mesh_agg_stats.max_hops) {
+    br_mesh_agg_stats.max_hops = reading[MESH_AGG_HOPS];
+  }
+  PRINTF("br-mesh-agg: %s from ", text);
+  PRINT6ADDR(&mote);
+  PRINTF(", %u hops\n", reading[MESH_AGG_HOPS]);
+  if(!coap_proxy_deliver(&mote, TEMPERATURE_PATH, (uint8_t *)text, len,
+                         reading[MESH_AGG_MAX_AGE])) {
+    br_mesh_agg_stats.unobserved++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+  uint8_t data[MESH_AGG_HEADER_LEN + MESH_AGG_READINGS * MESH_AGG_READING_LEN];
+  uip_ds6_addr_t *global;
+  uint8_t n;
+  int i;
+
+  /* Copied out: the proxy sends notifications from uip_buf meanwhile */
+  if(uip_datalen() < MESH_AGG_HEADER_LEN || uip_datalen() > sizeof(data)) {
+    return;
+  }
+  memcpy(data, uip_appdata, uip_datalen());
+  n = data[1];
+  if(data[0] != MESH_AGG_VERSION ||
+     uip_datalen() != MESH_AGG_HEADER_LEN + n * MESH_AGG_READING_LEN) {
+    return;
+  }
+  global = uip_ds6_get_global(ADDR_PREFERRED);
+  if(global == NULL) {
+    return;
+  }
+  br_mesh_agg_stats.packets++;
+  br_mesh_agg_stats.readings += n;
+  for(i = 0; i < n; i++) {
+    /* The last hop, to the router */
+    data[MESH_AGG_HEADER_LEN + i * MESH_AGG_READING_LEN + MESH_AGG_HOPS]++;
+    deliver(&global->ipaddr,
+            &data[MESH_AGG_HEADER_LEN + i * MESH_AGG_READING_LEN]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(br_mesh_agg_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  conn = udp_new(NULL, 0, NULL);
+  udp_bind(conn, UIP_HTONS(MESH_AGG_PORT));
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == tcpip_event && uip_newdata()) {
+      input();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+br_mesh_agg_init(void)
+{
+  process_start(&br_mesh_agg_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
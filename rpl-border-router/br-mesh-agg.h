@@ -0,0 +1,58 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Temperature readings aggregated over the mesh, at the root
+ *
+ *         The thermostats built with WITH_MESH_AGG=1 send their readings
+ *         up the DODAG merged into few packets (see mesh-agg/mesh-agg.h).
+ *         The router unpacks them and hands each reading to the CoAP proxy
+ *         as a notification of /temperature of its mote, so that the
+ *         upstream observers of the mote and the house aggregates get it
+ *         as before, without an observation of every mote over the mesh.
+ */
+
+#ifndef __BR_MESH_AGG_H__
+#define __BR_MESH_AGG_H__
+
+#include "contiki.h"
+
+struct br_mesh_agg_stats {
+  uint16_t packets;       /* aggregated packets received */
+  uint16_t readings;      /* readings in them */
+  uint16_t unobserved;    /* readings of a resource nobody observes */
+  uint8_t max_hops;       /* longest way a reading came */
+};
+
+extern struct br_mesh_agg_stats br_mesh_agg_stats;
+
+/* Starts listening; the CoAP proxy must be running. */
+void br_mesh_agg_init(void);
+
+#endif /* __BR_MESH_AGG_H__ */
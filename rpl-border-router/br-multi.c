@@ -0,0 +1,227 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Several border routers on one mesh
+ */
+
+#include "contiki.h"
+#include "net/uip-ds6.h"
+#include "dev/slip.h"
+#include "slip-bridge.h"
+#include "br-multi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Route changes waiting for the SLIP link; more of them between two runs
+   of the process are sent as a full listing instead */
+#ifndef BR_MULTI_CONF_QUEUE
+#define BR_MULTI_QUEUE 8
+#else
+#define BR_MULTI_QUEUE BR_MULTI_CONF_QUEUE
+#endif
+
+/* Seconds between full listings, which also mend reports lost on the
+   link or at a host end that was not running */
+#ifndef BR_MULTI_CONF_LISTING
+#define BR_MULTI_LISTING 60
+#else
+#define BR_MULTI_LISTING BR_MULTI_CONF_LISTING
+#endif
+
+/* Seconds between the "Uplink:" lines on the console; they are also
+   printed after every change of the routes */
+#ifndef BR_MULTI_CONF_PRINT
+#define BR_MULTI_PRINT 10
+#else
+#define BR_MULTI_PRINT BR_MULTI_CONF_PRINT
+#endif
+
+#define IID_LEN    8
+#define RECORD_LEN (1 + IID_LEN)
+
+struct change {
+  uint8_t op;             /* '+' or '-' */
+  uint8_t iid[IID_LEN];
+};
+
+struct br_multi_stats br_multi_stats;
+
+static struct change queue[BR_MULTI_QUEUE];
+static uint8_t queued;
+static uint8_t listing_due;
+static uint16_t frame_len;
+static struct uip_ds6_notification notification;
+
+PROCESS(br_multi_process, "Multi-router");
+/*---------------------------------------------------------------------------*/
+static void
+flush(void)
+{
+  if(frame_len > 0) {
+    uip_len = frame_len;
+    slip_send();
+    uip_len = 0;
+    frame_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_record(uint8_t op, const uint8_t *iid)
+{
+  if(frame_len + RECORD_LEN > UIP_BUFSIZE) {
+    flush();
+  }
+  if(frame_len == 0) {
+    uip_buf[0] = '!';
+    uip_buf[1] = 'R';
+    frame_len = 2;
+  }
+  uip_buf[frame_len++] = op;
+  if(iid != NULL) {
+    memcpy(&uip_buf[frame_len], iid, IID_LEN);
+    frame_len += IID_LEN;
+    br_multi_stats.reports++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_listing(void)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_addr_t *addr;
+
+  put_record('*', NULL);
+  /* The router itself is behind its own link too */
+  addr = uip_ds6_get_global(ADDR_PREFERRED);
+  if(addr != NULL) {
+    put_record('+', &addr->ipaddr.u8[8]);
+  }
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    put_record('+', &r->ipaddr.u8[8]);
+  }
+  put_record('.', NULL);
+  flush();
+  br_multi_stats.listings++;
+  PRINTF("br-multi: listing of %u routes\n", uip_ds6_route_num_routes());
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_uplink(void)
+{
+  printf("Uplink: %u routes, %u frames up\n",
+         uip_ds6_route_num_routes(), slip_bridge_stats.tx_frames);
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_changed(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+              int num_routes)
+{
+  if(event != UIP_DS6_NOTIFICATION_ROUTE_ADD &&
+     event != UIP_DS6_NOTIFICATION_ROUTE_RM) {
+    return;
+  }
+  if(!listing_due) {
+    if(queued < BR_MULTI_QUEUE) {
+      queue[queued].op = event == UIP_DS6_NOTIFICATION_ROUTE_ADD ? '+' : '-';
+      memcpy(queue[queued].iid, &route->u8[8], IID_LEN);
+      queued++;
+    } else {
+      /* The listing is taken from the table when it is sent, so it
+         carries these changes too */
+      listing_due = 1;
+      queued = 0;
+      br_multi_stats.overflows++;
+    }
+  }
+  process_poll(&br_multi_process);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(br_multi_process, ev, data)
+{
+  static struct etimer listing_timer;
+  static struct etimer print_timer;
+  uint8_t i;
+
+  PROCESS_BEGIN();
+
+  listing_due = 1;
+  process_poll(&br_multi_process);
+  etimer_set(&listing_timer, BR_MULTI_LISTING * CLOCK_SECOND);
+  etimer_set(&print_timer, BR_MULTI_PRINT * CLOCK_SECOND);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == PROCESS_EVENT_TIMER && data == &print_timer) {
+      etimer_reset(&print_timer);
+      print_uplink();
+      continue;
+    }
+    if(ev == PROCESS_EVENT_TIMER && data == &listing_timer) {
+      etimer_reset(&listing_timer);
+      listing_due = 1;
+    } else if(ev != PROCESS_EVENT_POLL) {
+      continue;
+    }
+
+    if(listing_due) {
+      listing_due = 0;
+      queued = 0;
+      send_listing();
+    } else if(queued > 0) {
+      for(i = 0; i < queued; i++) {
+        put_record(queue[i].op, queue[i].iid);
+      }
+      queued = 0;
+      flush();
+      print_uplink();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+br_multi_resync(void)
+{
+  listing_due = 1;
+  process_poll(&br_multi_process);
+}
+/*---------------------------------------------------------------------------*/
+void
+br_multi_init(void)
+{
+  uip_ds6_notification_add(&notification, route_changed);
+  process_start(&br_multi_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
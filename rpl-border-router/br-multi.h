@@ -0,0 +1,69 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Several border routers on one mesh
+ *
+ *         Each router roots its own DODAG in the RPL instance, with its
+ *         own DODAG ID and the prefix they all share; a mote joins the
+ *         DODAG in which it gets the best rank (the preference of the
+ *         roots first, if set), keeps its address in any of them and
+ *         moves to another one when its root stops answering. Upward
+ *         traffic leaves through the SLIP link of the mote's root.
+ *
+ *         For downward traffic the host needs to know which router each
+ *         mote is behind: the router reports its routes over SLIP, as a
+ *         "!R" frame of records '+' or '-' followed by the interface
+ *         identifier of a mote under the prefix, and periodically as a
+ *         full listing between the records '*' and '.'. The host end in
+ *         ../tools (tunslip6-hc -R) turns them into /128 routes on its
+ *         tun interface; they go away with the interface when the router
+ *         or its tunnel is lost.
+ */
+
+#ifndef __BR_MULTI_H__
+#define __BR_MULTI_H__
+
+#include "contiki.h"
+
+struct br_multi_stats {
+  uint16_t reports;       /* routes reported, listings included */
+  uint16_t listings;
+  uint16_t overflows;     /* changes that came too fast, sent as a listing */
+};
+
+extern struct br_multi_stats br_multi_stats;
+
+/* Starts reporting the routes; the prefix must be set. */
+void br_multi_init(void);
+
+/* Sends the full listing soon, e.g. when the host end (re)starts. */
+void br_multi_resync(void);
+
+#endif /* __BR_MULTI_H__ */
@@ -0,0 +1,715 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Resource directory at the border router
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "erbium.h"
+#include "er-coap-13.h"
+#include "br-rd.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Registrations kept, one per thermostat: 52 bytes each, 10 as the
+   rooms of the aggregates */
+#ifndef BR_RD_CONF_ENDPOINTS
+#define BR_RD_ENDPOINTS 10
+#else
+#define BR_RD_ENDPOINTS BR_RD_CONF_ENDPOINTS
+#endif
+
+/* Distinct links over all the registrations, one bit each in a
+   registration */
+#ifndef BR_RD_CONF_LINKS
+#define BR_RD_LINKS 12
+#else
+#define BR_RD_LINKS BR_RD_CONF_LINKS
+#endif
+
+#if BR_RD_LINKS > 16
+#error "BR_RD_CONF_LINKS must be 16 at most"
+#endif
+
+/* Longest link kept, "</path>;attributes", NUL included */
+#ifndef BR_RD_CONF_LINK_LEN
+#define BR_RD_LINK_LEN 32
+#else
+#define BR_RD_LINK_LEN BR_RD_CONF_LINK_LEN
+#endif
+
+/* Room hash buckets, a power of two */
+#ifndef BR_RD_CONF_BUCKETS
+#define BR_RD_BUCKETS 4
+#else
+#define BR_RD_BUCKETS BR_RD_CONF_BUCKETS
+#endif
+
+/* Longest registration payload, gathered from its Block1 pieces */
+#ifndef BR_RD_CONF_PAYLOAD
+#define BR_RD_PAYLOAD 128
+#else
+#define BR_RD_PAYLOAD BR_RD_CONF_PAYLOAD
+#endif
+
+/* Lifetime of a registration that gives none, the default of the RD
+   draft, and the shortest one accepted, in seconds */
+#define LIFETIME_DEFAULT 90000UL
+#define LIFETIME_MIN     60
+
+/* Seconds between checks for expired registrations */
+#define EXPIRE_INTERVAL 30
+
+/* Seconds a registration in pieces holds the payload buffer against
+   the others */
+#define PIECES_TIMEOUT 10
+
+/* Endpoint name and room, NUL included */
+#define NAME_LEN 12
+
+/* Codes the REST status table lacks */
+#define RD_CONTINUE   95        /* 2.31 Continue */
+#define RD_INCOMPLETE 136       /* 4.08 Request Entity Incomplete */
+
+#define NONE 0xff
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+struct link {
+  char text[BR_RD_LINK_LEN];
+  uint16_t rt;              /* hash of the rt value, 0 without one */
+  uint8_t users;            /* registrations holding it, 0 when free */
+};
+
+struct endpoint {
+  uip_ipaddr_t addr;
+  unsigned long lifetime;
+  unsigned long expires;    /* clock_seconds() */
+  char ep[NAME_LEN];
+  char room[NAME_LEN];
+  uint16_t links;           /* bit k for links[k] */
+  uint8_t next;             /* room hash chain */
+  uint8_t used;
+};
+
+struct br_rd_stats br_rd_stats;
+
+static struct link links[BR_RD_LINKS];
+static struct endpoint endpoints[BR_RD_ENDPOINTS];
+static uint8_t buckets[BR_RD_BUCKETS];
+static struct ctimer expire_timer;
+static char location[8];
+
+/* Registration arriving in Block1 pieces, one mote at a time */
+static struct {
+  uip_ipaddr_t addr;
+  unsigned long started;
+  uint16_t len;
+  uint8_t active;
+  char buf[BR_RD_PAYLOAD];
+} pieces;
+
+/* Lookup answers are generated whole; the bytes in
+   [out_start, out_start + out_size) are the requested block */
+static uint8_t *out;
+static int32_t out_start;
+static int32_t out_pos;
+static uint16_t out_size;
+
+RESOURCE(rd, METHOD_POST | METHOD_DELETE | HAS_SUB_RESOURCES, "rd",
+         "rt=\"core.rd\";ct=40");
+RESOURCE(rd_lookup, METHOD_GET | HAS_SUB_RESOURCES, "rd-lookup",
+         "rt=\"core.rd-lookup\";ct=40");
+/*---------------------------------------------------------------------------*/
+static uint16_t
+hash(const char *s, int len)
+{
+  uint16_t h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < len; i++) {
+    h = (h * 31) + (uint8_t)s[i];
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+bucket(const char *room)
+{
+  return hash(room, strlen(room)) & (BR_RD_BUCKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+same(const char *s, const char *value, int len)
+{
+  return strncmp(s, value, len) == 0 && s[len] == '\0';
+}
+/*---------------------------------------------------------------------------*/
+/* Value of the rt attribute of a link, quotes removed; NULL without one */
+static const char *
+link_rt(const char *text, int *len)
+{
+  const char *p;
+  int n;
+
+  p = strstr(text, ";rt=");
+  if(p == NULL) {
+    return NULL;
+  }
+  p += 4;
+  if(*p == '"') {
+    p++;
+    for(n = 0; p[n] != '\0' && p[n] != '"'; n++);
+  } else {
+    for(n = 0; p[n] != '\0' && p[n] != ';'; n++);
+  }
+  *len = n;
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rt_hash(const char *rt, int len)
+{
+  uint16_t h;
+
+  h = hash(rt, len);
+  return h == 0 ? 1 : h;
+}
+/*---------------------------------------------------------------------------*/
+/* Index of the link, shared with the registrations that have it already;
+   -1 if it is too long or there is no room left */
+static int
+intern(const char *s, int len)
+{
+  const char *rt;
+  int rt_len;
+  int free_link;
+  int k;
+
+  if(len >= BR_RD_LINK_LEN) {
+    return -1;
+  }
+  free_link = -1;
+  for(k = 0; k < BR_RD_LINKS; k++) {
+    if(links[k].users == 0) {
+      if(free_link < 0) {
+        free_link = k;
+      }
+    } else if(same(links[k].text, s, len)) {
+      links[k].users++;
+      return k;
+    }
+  }
+  if(free_link < 0) {
+    return -1;
+  }
+  memcpy(links[free_link].text, s, len);
+  links[free_link].text[len] = '\0';
+  rt = link_rt(links[free_link].text, &rt_len);
+  links[free_link].rt = rt == NULL ? 0 : rt_hash(rt, rt_len);
+  links[free_link].users = 1;
+  return free_link;
+}
+/*---------------------------------------------------------------------------*/
+static void
+release(uint16_t mask)
+{
+  int k;
+
+  for(k = 0; k < BR_RD_LINKS; k++) {
+    if(mask & (1U << k)) {
+      links[k].users--;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Interns the links of a registration payload; 0 if one of them could
+   not be kept */
+static int
+parse_links(const char *p, int len, uint16_t *mask)
+{
+  uint8_t quoted;
+  int start;
+  int i;
+  int k;
+
+  *mask = 0;
+  quoted = 0;
+  start = 0;
+  for(i = 0; i <= len; i++) {
+    if(i < len && p[i] == '"') {
+      quoted = !quoted;
+    }
+    if(i < len && (p[i] != ',' || quoted)) {
+      continue;
+    }
+    if(i > start) {
+      k = p[start] == '<' ? intern(&p[start], i - start) : -1;
+      if(k < 0) {
+        release(*mask);
+        *mask = 0;
+        return 0;
+      }
+      if(*mask & (1U << k)) {
+        /* The same link twice */
+        links[k].users--;
+      }
+      *mask |= 1U << k;
+    }
+    start = i + 1;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_endpoint(uint8_t i)
+{
+  uint8_t *p;
+
+  for(p = &buckets[bucket(endpoints[i].room)]; *p != NONE;
+      p = &endpoints[*p].next) {
+    if(*p == i) {
+      *p = endpoints[i].next;
+      break;
+    }
+  }
+  release(endpoints[i].links);
+  endpoints[i].used = 0;
+  br_rd_stats.endpoints--;
+}
+/*---------------------------------------------------------------------------*/
+static void
+expire(void *ptr)
+{
+  uint8_t i;
+
+  for(i = 0; i < BR_RD_ENDPOINTS; i++) {
+    if(endpoints[i].used && clock_seconds() >= endpoints[i].expires) {
+      PRINTF("br-rd: %s expired\n", endpoints[i].ep);
+      remove_endpoint(i);
+      br_rd_stats.expired++;
+    }
+  }
+  ctimer_reset(&expire_timer);
+}
+/*---------------------------------------------------------------------------*/
+/* Query variable as a string; its length, -1 if it does not fit */
+static int
+query_string(void *request, const char *name, char *dst, int size)
+{
+  const char *value;
+  int len;
+
+  len = REST.get_query_variable(request, name, &value);
+  if(len >= size) {
+    return -1;
+  }
+  memcpy(dst, value, len);
+  dst[len] = '\0';
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+query_lifetime(void *request, unsigned long lifetime)
+{
+  const char *value;
+  int len;
+  int i;
+
+  len = REST.get_query_variable(request, "lt", &value);
+  if(len > 0) {
+    lifetime = 0;
+    for(i = 0; i < len && value[i] >= '0' && value[i] <= '9'; i++) {
+      lifetime = lifetime * 10 + (value[i] - '0');
+    }
+  }
+  return lifetime < LIFETIME_MIN ? LIFETIME_MIN : lifetime;
+}
+/*---------------------------------------------------------------------------*/
+/* Registration of the endpoint or, with the same name or address, a new
+   one replacing it */
+static uint8_t
+find_endpoint(const char *ep, const uip_ipaddr_t *addr)
+{
+  uint8_t found;
+  uint8_t i;
+
+  found = NONE;
+  for(i = 0; i < BR_RD_ENDPOINTS; i++) {
+    if(!endpoints[i].used) {
+      continue;
+    }
+    if(strcmp(endpoints[i].ep, ep) == 0) {
+      return i;
+    }
+    if(uip_ipaddr_cmp(&endpoints[i].addr, addr)) {
+      found = i;
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static void
+register_endpoint(coap_packet_t *request, void *response)
+{
+  const uint8_t *payload;
+  struct endpoint *e;
+  char ep[NAME_LEN];
+  char room[NAME_LEN];
+  uint32_t num;
+  uint32_t block_offset;
+  uint16_t size;
+  uint16_t mask;
+  uint8_t more;
+  uint8_t i;
+  int len;
+
+  len = REST.get_request_payload(request, &payload);
+
+  if(coap_get_header_block1(request, &num, &more, &size, &block_offset)) {
+    if(pieces.active && !uip_ipaddr_cmp(&pieces.addr, &UIP_IP_BUF->srcipaddr)
+       && clock_seconds() - pieces.started < PIECES_TIMEOUT) {
+      REST.set_header_max_age(response, 2);
+      REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+      return;
+    }
+    if(num == 0) {
+      uip_ipaddr_copy(&pieces.addr, &UIP_IP_BUF->srcipaddr);
+      pieces.started = clock_seconds();
+      pieces.len = 0;
+      pieces.active = 1;
+    }
+    if(pieces.active && block_offset == pieces.len &&
+       uip_ipaddr_cmp(&pieces.addr, &UIP_IP_BUF->srcipaddr)) {
+      if(pieces.len + len > BR_RD_PAYLOAD) {
+        pieces.active = 0;
+        REST.set_response_status(response,
+                                 REST.status.REQUEST_ENTITY_TOO_LARGE);
+        return;
+      }
+      memcpy(&pieces.buf[pieces.len], payload, len);
+      pieces.len += len;
+    } else if(block_offset + len != pieces.len ||
+              !uip_ipaddr_cmp(&pieces.addr, &UIP_IP_BUF->srcipaddr)) {
+      /* Neither the next piece nor the last one again, whose answer was
+         lost */
+      REST.set_response_status(response, RD_INCOMPLETE);
+      return;
+    }
+    coap_set_header_block1(response, num, more, size);
+    if(more) {
+      REST.set_response_status(response, RD_CONTINUE);
+      return;
+    }
+    pieces.active = 0;
+    payload = (const uint8_t *)pieces.buf;
+    len = pieces.len;
+  }
+
+  if(query_string(request, "ep", ep, sizeof(ep)) <= 0 ||
+     query_string(request, "room", room, sizeof(room)) < 0) {
+    REST.set_response_status(response, REST.status.BAD_REQUEST);
+    return;
+  }
+  if(!parse_links((const char *)payload, len, &mask)) {
+    br_rd_stats.refused++;
+    REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+    return;
+  }
+
+  i = find_endpoint(ep, &UIP_IP_BUF->srcipaddr);
+  if(i != NONE) {
+    remove_endpoint(i);
+  } else {
+    for(i = 0; i < BR_RD_ENDPOINTS && endpoints[i].used; i++);
+    if(i == BR_RD_ENDPOINTS) {
+      release(mask);
+      br_rd_stats.refused++;
+      REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+      return;
+    }
+  }
+
+  e = &endpoints[i];
+  uip_ipaddr_copy(&e->addr, &UIP_IP_BUF->srcipaddr);
+  strcpy(e->ep, ep);
+  strcpy(e->room, room);
+  e->links = mask;
+  e->lifetime = query_lifetime(request, LIFETIME_DEFAULT);
+  e->expires = clock_seconds() + e->lifetime;
+  e->next = buckets[bucket(room)];
+  buckets[bucket(room)] = i;
+  e->used = 1;
+  br_rd_stats.endpoints++;
+  br_rd_stats.registrations++;
+  PRINTF("br-rd: %s in %s registered as rd/%u\n", ep, room, i);
+
+  snprintf(location, sizeof(location), "rd/%u", i);
+  REST.set_header_location(response, location);
+  REST.set_response_status(response, REST.status.CREATED);
+}
+/*---------------------------------------------------------------------------*/
+/* POST on rd registers, POST on rd/<n> refreshes the registration and
+   DELETE removes it */
+void
+rd_handler(void *request, void *response, uint8_t *buffer,
+           uint16_t preferred_size, int32_t *offset)
+{
+  coap_packet_t *const coap_req = (coap_packet_t *)request;
+  const char *url;
+  int url_len;
+  uint8_t n;
+  int i;
+
+  url_len = REST.get_url(request, &url);
+  if(url_len == 2) {
+    if(coap_req->code != COAP_POST) {
+      REST.set_response_status(response, REST.status.METHOD_NOT_ALLOWED);
+      return;
+    }
+    register_endpoint(coap_req, response);
+    return;
+  }
+
+  n = 0;
+  for(i = 3; i < url_len && url[i] >= '0' && url[i] <= '9'; i++) {
+    n = n * 10 + (url[i] - '0');
+  }
+  if(url[2] != '/' || i == 3 || i < url_len || n >= BR_RD_ENDPOINTS ||
+     !endpoints[n].used ||
+     !uip_ipaddr_cmp(&endpoints[n].addr, &UIP_IP_BUF->srcipaddr)) {
+    /* Expired or replaced: the mote registers again */
+    REST.set_response_status(response, REST.status.NOT_FOUND);
+    return;
+  }
+  if(coap_req->code == COAP_DELETE) {
+    remove_endpoint(n);
+    REST.set_response_status(response, REST.status.DELETED);
+    return;
+  }
+  endpoints[n].lifetime = query_lifetime(request, endpoints[n].lifetime);
+  endpoints[n].expires = clock_seconds() + endpoints[n].lifetime;
+  br_rd_stats.refreshes++;
+  REST.set_response_status(response, REST.status.CHANGED);
+}
+/*---------------------------------------------------------------------------*/
+static void
+put(const char *s, int len)
+{
+  for(; len > 0; s++, len--, out_pos++) {
+    if(out_pos >= out_start && out_pos < out_start + out_size) {
+      out[out_pos - out_start] = *s;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_string(const char *s)
+{
+  put(s, strlen(s));
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_addr(const uip_ipaddr_t *addr)
+{
+  char group[6];
+  uint16_t a;
+  int i, f;
+
+  for(i = 0, f = 0; i < sizeof(uip_ipaddr_t); i += 2) {
+    a = (addr->u8[i] << 8) + addr->u8[i + 1];
+    if(a == 0 && f >= 0) {
+      if(f++ == 0) {
+        put("::", 2);
+      }
+    } else {
+      if(f > 0) {
+        f = -1;
+      } else if(i > 0) {
+        put(":", 1);
+      }
+      snprintf(group, sizeof(group), "%x", a);
+      put_string(group);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_room(const struct endpoint *e)
+{
+  if(e->room[0] != '\0') {
+    put(";room=\"", 7);
+    put_string(e->room);
+    put("\"", 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* <coap://[addr]/path>;attributes;room="..." for each link of mask */
+static void
+put_resources(const struct endpoint *e, uint16_t mask)
+{
+  int k;
+
+  for(k = 0; k < BR_RD_LINKS; k++) {
+    if(!(e->links & mask & (1U << k))) {
+      continue;
+    }
+    if(out_pos > 0) {
+      put(",", 1);
+    }
+    put("<coap://[", 9);
+    put_addr(&e->addr);
+    put("]", 1);
+    put_string(&links[k].text[1]);
+    put_room(e);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_endpoint(uint8_t i)
+{
+  const struct endpoint *e = &endpoints[i];
+  char number[16];
+
+  if(out_pos > 0) {
+    put(",", 1);
+  }
+  snprintf(number, sizeof(number), "</rd/%u>;ep=\"", i);
+  put_string(number);
+  put_string(e->ep);
+  put("\";base=\"coap://[", 16);
+  put_addr(&e->addr);
+  put("]\"", 2);
+  put_room(e);
+  snprintf(number, sizeof(number), ";lt=%lu", e->lifetime);
+  put_string(number);
+}
+/*---------------------------------------------------------------------------*/
+/* GET rd-lookup/res or rd-lookup/ep, filtered by room, rt and ep */
+void
+rd_lookup_handler(void *request, void *response, uint8_t *buffer,
+                  uint16_t preferred_size, int32_t *offset)
+{
+  const struct endpoint *e;
+  const char *url;
+  const char *room;
+  const char *rt;
+  const char *ep;
+  const char *value;
+  uint16_t mask;
+  uint16_t h;
+  uint8_t resources;
+  uint8_t i;
+  int url_len;
+  int room_len;
+  int rt_len;
+  int ep_len;
+  int len;
+  int k;
+
+  url_len = REST.get_url(request, &url);
+  if(url_len == 13 && strncmp(url, "rd-lookup/res", 13) == 0) {
+    resources = 1;
+  } else if(url_len == 12 && strncmp(url, "rd-lookup/ep", 12) == 0) {
+    resources = 0;
+  } else {
+    REST.set_response_status(response, REST.status.NOT_FOUND);
+    return;
+  }
+  room_len = REST.get_query_variable(request, "room", &room);
+  rt_len = REST.get_query_variable(request, "rt", &rt);
+  ep_len = REST.get_query_variable(request, "ep", &ep);
+
+  /* Links of the resource type asked for */
+  mask = 0xffff;
+  if(rt_len > 0) {
+    mask = 0;
+    h = rt_hash(rt, rt_len);
+    for(k = 0; k < BR_RD_LINKS; k++) {
+      if(links[k].users > 0 && links[k].rt == h &&
+         (value = link_rt(links[k].text, &len)) != NULL &&
+         len == rt_len && strncmp(value, rt, len) == 0) {
+        mask |= 1U << k;
+      }
+    }
+  }
+
+  out = buffer;
+  out_start = *offset;
+  out_size = preferred_size;
+  out_pos = 0;
+
+  /* One bucket chain for a room, all the registrations otherwise */
+  i = room_len > 0 ? buckets[hash(room, room_len) & (BR_RD_BUCKETS - 1)] : 0;
+  while(i < BR_RD_ENDPOINTS) {
+    e = &endpoints[i];
+    if(e->used && (room_len == 0 || same(e->room, room, room_len)) &&
+       (ep_len == 0 || same(e->ep, ep, ep_len)) &&
+       (rt_len == 0 || (e->links & mask) != 0)) {
+      if(resources) {
+        put_resources(e, mask);
+      } else {
+        put_endpoint(i);
+      }
+    }
+    i = room_len > 0 ? e->next : i + 1;
+  }
+
+  if(*offset > 0 && out_pos <= *offset) {
+    REST.set_response_status(response, REST.status.BAD_OPTION);
+    return;
+  }
+  if(*offset == 0) {
+    br_rd_stats.lookups++;
+  }
+  REST.set_header_content_type(response, REST.type.APPLICATION_LINK_FORMAT);
+  REST.set_response_payload(response, buffer,
+                            out_pos - out_start < out_size ?
+                            out_pos - out_start : out_size);
+  *offset = out_pos > out_start + out_size ? out_start + out_size : -1;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_rd_init(void)
+{
+  memset(buckets, NONE, sizeof(buckets));
+  /* The engine takes the first resource whose URL starts the request's
+     when it has sub-resources: rd-lookup goes before rd */
+  rest_activate_resource(&resource_rd_lookup);
+  rest_activate_resource(&resource_rd);
+  ctimer_set(&expire_timer, EXPIRE_INTERVAL * CLOCK_SECOND, expire, NULL);
+}
+/*---------------------------------------------------------------------------*/
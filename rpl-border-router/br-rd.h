@@ -0,0 +1,71 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Resource directory at the border router
+ *
+ *         The thermostats register their resources with the router when
+ *         they join (smart-thermostat/rd-client.c): a POST on /rd with the
+ *         endpoint name, lifetime and room in the query (ep, lt, room) and
+ *         their links in CoRE link format as payload, in Block1 pieces when
+ *         it does not fit one frame. The router answers 2.01 with the
+ *         location rd/<n> of the registration, which the mote POSTs to
+ *         again before the lifetime ends; registrations left to expire are
+ *         dropped.
+ *
+ *         Clients then find the motes with one query to the router instead
+ *         of a GET of /.well-known/core on each:
+ *         rd-lookup/res?rt=Data&room=kitchen lists the matching resources
+ *         with the absolute URI of each, rd-lookup/ep?room=kitchen the
+ *         registrations themselves. Registrations are chained in hash
+ *         buckets by room, and each distinct link, the same on most motes,
+ *         is kept once with the hash of its resource type, so a lookup
+ *         walks one chain and tests a bit per link.
+ */
+
+#ifndef __BR_RD_H__
+#define __BR_RD_H__
+
+#include "contiki.h"
+
+struct br_rd_stats {
+  uint16_t registrations; /* new and replaced */
+  uint16_t refreshes;
+  uint16_t expired;
+  uint16_t lookups;
+  uint8_t endpoints;      /* registered now */
+  uint8_t refused;        /* registrations without room left */
+};
+
+extern struct br_rd_stats br_rd_stats;
+
+/* Activates the resources; the REST engine must be running. */
+void br_rd_init(void);
+
+#endif /* __BR_RD_H__ */
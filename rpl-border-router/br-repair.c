@@ -0,0 +1,218 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Automatic DODAG repair at the border router
+ */
+
+#include "contiki.h"
+#include "net/uip-ds6.h"
+#include "net/rpl/rpl-private.h"
+#include "slip-bridge.h"
+#include "br-repair.h"
+
+#include <stdio.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Seconds between health checks */
+#ifndef BR_REPAIR_CONF_INTERVAL
+#define BR_REPAIR_INTERVAL 60
+#else
+#define BR_REPAIR_INTERVAL BR_REPAIR_CONF_INTERVAL
+#endif
+
+/* The mesh is degraded when this percentage of the routes is missing,
+   or when this many packets for the mesh found no route in an interval */
+#ifndef BR_REPAIR_CONF_LOSS
+#define BR_REPAIR_LOSS 25
+#else
+#define BR_REPAIR_LOSS BR_REPAIR_CONF_LOSS
+#endif
+#ifndef BR_REPAIR_CONF_BOUNCES
+#define BR_REPAIR_BOUNCES 5
+#else
+#define BR_REPAIR_BOUNCES BR_REPAIR_CONF_BOUNCES
+#endif
+
+/* Minimum seconds between two global repairs */
+#ifndef BR_REPAIR_CONF_HOLDOFF
+#define BR_REPAIR_HOLDOFF 600
+#else
+#define BR_REPAIR_HOLDOFF BR_REPAIR_CONF_HOLDOFF
+#endif
+
+/* Seconds after which a repair that did not bring the routes back is
+   given up: the current table becomes the new baseline. */
+#ifndef BR_REPAIR_CONF_SETTLE
+#define BR_REPAIR_SETTLE 300
+#else
+#define BR_REPAIR_SETTLE BR_REPAIR_CONF_SETTLE
+#endif
+
+#define STATE_IDLE   0
+#define STATE_LOCAL  1
+#define STATE_GLOBAL 2
+
+struct br_repair_stats br_repair_stats;
+
+static struct ctimer check_timer;
+static struct uip_ds6_notification notification;
+static uint8_t state;
+static unsigned long repair_start;
+static unsigned long last_global;
+static uint16_t last_bounced;
+/* Set when a repair did not stop the failures, e.g. the host keeps
+   polling a mote that is gone, until an interval is quiet again */
+static uint8_t bounces_ignored;
+/*---------------------------------------------------------------------------*/
+static void
+converged(void)
+{
+  uint16_t elapsed;
+
+  elapsed = clock_seconds() - repair_start;
+  br_repair_stats.last_convergence = elapsed;
+  if(elapsed > br_repair_stats.max_convergence) {
+    br_repair_stats.max_convergence = elapsed;
+  }
+  br_repair_stats.converging = 0;
+  printf("Routes back after %s repair in %u s\n",
+         state == STATE_GLOBAL ? "global" : "local", elapsed);
+  state = STATE_IDLE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_changed(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+              int num_routes)
+{
+  if(event == UIP_DS6_NOTIFICATION_ROUTE_ADD) {
+    br_repair_stats.added++;
+    if(br_repair_stats.converging &&
+       num_routes >= br_repair_stats.baseline &&
+       slip_bridge_stats.tx_bounced == last_bounced) {
+      converged();
+    }
+  } else if(event == UIP_DS6_NOTIFICATION_ROUTE_RM) {
+    br_repair_stats.removed++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+local_repair(rpl_instance_t *instance)
+{
+  /* A new DTSN makes the children send their DAOs again; faster DIOs
+     help detached motes find the DODAG. */
+  RPL_LOLLIPOP_INCREMENT(instance->dtsn_out);
+  rpl_reset_dio_timer(instance);
+  br_repair_stats.local++;
+  printf("Routes missing, requesting DAOs\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+global_repair(void)
+{
+  rpl_repair_root(RPL_DEFAULT_INSTANCE);
+  last_global = clock_seconds();
+  br_repair_stats.global++;
+  printf("Routes still missing, initiating global repair\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(void *ptr)
+{
+  rpl_instance_t *instance;
+  uint16_t routes;
+  uint8_t degraded;
+
+  ctimer_reset(&check_timer);
+
+  instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+  if(instance == NULL) {
+    return;
+  }
+
+  routes = uip_ds6_route_num_routes();
+  br_repair_stats.bounced = slip_bridge_stats.tx_bounced - last_bounced;
+  last_bounced = slip_bridge_stats.tx_bounced;
+
+  if(br_repair_stats.bounced < BR_REPAIR_BOUNCES) {
+    bounces_ignored = 0;
+  }
+  degraded = (uint32_t)routes * 100 <
+    (uint32_t)br_repair_stats.baseline * (100 - BR_REPAIR_LOSS) ||
+    (br_repair_stats.bounced >= BR_REPAIR_BOUNCES && !bounces_ignored);
+
+  PRINTF("br-repair: %u routes (baseline %u), +%u -%u, %u bounced\n",
+         routes, br_repair_stats.baseline, br_repair_stats.added,
+         br_repair_stats.removed, br_repair_stats.bounced);
+  br_repair_stats.added = 0;
+  br_repair_stats.removed = 0;
+
+  if(br_repair_stats.converging) {
+    if(routes >= br_repair_stats.baseline && br_repair_stats.bounced == 0) {
+      converged();
+    } else if(clock_seconds() - repair_start >= BR_REPAIR_SETTLE) {
+      printf("Routes not back after %u s, %u routes from now on\n",
+             BR_REPAIR_SETTLE, routes);
+      br_repair_stats.converging = 0;
+      br_repair_stats.baseline = routes;
+      bounces_ignored = br_repair_stats.bounced >= BR_REPAIR_BOUNCES;
+      state = STATE_IDLE;
+    } else if(state == STATE_LOCAL && degraded &&
+              (last_global == 0 ||
+               clock_seconds() - last_global >= BR_REPAIR_HOLDOFF)) {
+      global_repair();
+      state = STATE_GLOBAL;
+    }
+    return;
+  }
+
+  if(!degraded) {
+    if(routes > br_repair_stats.baseline) {
+      br_repair_stats.baseline = routes;
+    }
+    return;
+  }
+
+  local_repair(instance);
+  state = STATE_LOCAL;
+  repair_start = clock_seconds();
+  br_repair_stats.converging = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_repair_init(void)
+{
+  uip_ds6_notification_add(&notification, route_changed);
+  last_bounced = slip_bridge_stats.tx_bounced;
+  ctimer_set(&check_timer, BR_REPAIR_INTERVAL * CLOCK_SECOND, check, NULL);
+}
+/*---------------------------------------------------------------------------*/
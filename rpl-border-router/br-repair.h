@@ -0,0 +1,64 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Automatic DODAG repair at the border router
+ *
+ *         The route table and the forwarding failures of the SLIP
+ *         interface are checked periodically. When routes go missing or
+ *         packets for the mesh find no route, the root first asks for new
+ *         DAOs (local repair) and, if that does not help, starts a new
+ *         DODAG version (global repair), at most once per hold-off period.
+ *         The time from each repair until the route table is complete
+ *         again is recorded.
+ */
+
+#ifndef __BR_REPAIR_H__
+#define __BR_REPAIR_H__
+
+#include "contiki.h"
+
+struct br_repair_stats {
+  uint16_t baseline;          /* routes while the mesh was healthy */
+  uint16_t local;             /* DAO refresh requests */
+  uint16_t global;            /* new DODAG versions */
+  uint16_t added;             /* routes added, last interval */
+  uint16_t removed;           /* routes removed or expired, last interval */
+  uint16_t bounced;           /* packets without route, last interval */
+  uint16_t last_convergence;  /* seconds from repair to full route table */
+  uint16_t max_convergence;
+  uint8_t converging;         /* a repair is waiting for the routes */
+};
+
+extern struct br_repair_stats br_repair_stats;
+
+/* Starts monitoring; the DODAG must be running. */
+void br_repair_init(void);
+
+#endif /* __BR_REPAIR_H__ */
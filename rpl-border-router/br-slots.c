@@ -0,0 +1,258 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Notification slots assigned by the border router
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "br-slots.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Period of the thermostat notifications */
+#ifndef BR_SLOTS_CONF_PERIOD
+#define BR_SLOTS_PERIOD (5 * CLOCK_SECOND)
+#else
+#define BR_SLOTS_PERIOD BR_SLOTS_CONF_PERIOD
+#endif
+
+/* Seconds between rounds, which also correct the drift of the motes */
+#ifndef BR_SLOTS_CONF_INTERVAL
+#define BR_SLOTS_INTERVAL 60
+#else
+#define BR_SLOTS_INTERVAL BR_SLOTS_CONF_INTERVAL
+#endif
+
+/* Seconds from a new route to the round that includes it, during which
+   further joins are gathered */
+#define BR_SLOTS_JOIN_DELAY 5
+
+/* Local port of the POSTs, where the answers come back */
+#define BR_SLOTS_PORT 61620
+#define COAP_PORT     5683
+
+#define IID_LEN 8
+
+struct br_slots_stats br_slots_stats;
+
+static struct uip_udp_conn *conn;
+static struct uip_ds6_notification route_notification;
+static struct etimer cycle_timer;
+static struct etimer round_timer;
+static struct etimer send_timer;
+static clock_time_t cycle_start;
+
+/* Round in progress: the mote of rank rank is sent its slot next, after
+   the one of interface identifier last_iid */
+static uint8_t total;
+static uint8_t rank;
+static uint8_t last_iid[IID_LEN];
+static uint16_t mid;
+
+PROCESS(br_slots_process, "Notification slots");
+
+/*---------------------------------------------------------------------------*/
+/* Route of the smallest interface identifier after after, or the first
+   one with after NULL */
+static uip_ds6_route_t *
+route_after(const uint8_t *after)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *best = NULL;
+
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    if(after != NULL && memcmp(&r->ipaddr.u8[8], after, IID_LEN) <= 0) {
+      continue;
+    }
+    if(best == NULL || memcmp(&r->ipaddr.u8[8], &best->ipaddr.u8[8],
+                              IID_LEN) < 0) {
+      best = r;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+/* Middle of slot k of the current round, so that the POST does not meet
+   the notification of the mote at the start of it */
+static clock_time_t
+slot_time(uint8_t k)
+{
+  return cycle_start + (clock_time_t)(((uint32_t)BR_SLOTS_PERIOD * (2 * k + 1))
+                                      / (2 * total));
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_send(void)
+{
+  clock_time_t at;
+  clock_time_t now;
+
+  now = clock_time();
+  at = slot_time(rank);
+  while(CLOCK_LT(at, now)) {
+    at += BR_SLOTS_PERIOD;
+  }
+  etimer_set(&send_timer, at - now);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_slot(const uip_ipaddr_t *mote)
+{
+  uint8_t buf[32];
+  clock_time_t elapsed;
+  int len;
+
+  elapsed = (clock_time() - cycle_start) % BR_SLOTS_PERIOD;
+
+  /* NON POST without token, Uri-Path "slot", then the payload */
+  mid++;
+  buf[0] = 0x50;
+  buf[1] = 0x02;
+  buf[2] = mid >> 8;
+  buf[3] = mid & 0xff;
+  buf[4] = 0xb4;
+  memcpy(&buf[5], "slot", 4);
+  buf[9] = 0xff;
+  len = 10 + snprintf((char *)&buf[10], sizeof(buf) - 10, "s=%u&n=%u&t=%u",
+                      rank, total,
+                      (unsigned)((uint32_t)elapsed * 1000 / CLOCK_SECOND));
+
+  PRINTF("br-slots: slot %u of %u to ", rank, total);
+  PRINT6ADDR(mote);
+  PRINTF("\n");
+  uip_udp_packet_sendto(conn, buf, len, mote, UIP_HTONS(COAP_PORT));
+  br_slots_stats.sent++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_round(void)
+{
+  uip_ds6_route_t *r;
+  uint16_t n;
+
+  n = 0;
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    n++;
+  }
+  total = n > 255 ? 255 : n;
+  rank = 0;
+  br_slots_stats.motes = total;
+  if(total > 0) {
+    br_slots_stats.rounds++;
+    schedule_send();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+next_send(void)
+{
+  uip_ds6_route_t *r;
+
+  r = route_after(rank == 0 ? NULL : last_iid);
+  if(r == NULL) {
+    /* Routes removed during the round */
+    total = 0;
+    return;
+  }
+  memcpy(last_iid, &r->ipaddr.u8[8], IID_LEN);
+  send_slot(&r->ipaddr);
+  if(++rank < total) {
+    schedule_send();
+  } else {
+    total = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_changed(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+              int num_routes)
+{
+  if(event == UIP_DS6_NOTIFICATION_ROUTE_ADD) {
+    process_poll(&br_slots_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(br_slots_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  conn = udp_new(NULL, 0, NULL);
+  udp_bind(conn, UIP_HTONS(BR_SLOTS_PORT));
+  cycle_start = clock_time();
+  etimer_set(&cycle_timer, BR_SLOTS_PERIOD);
+  etimer_set(&round_timer, BR_SLOTS_JOIN_DELAY * CLOCK_SECOND);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == tcpip_event && uip_newdata()) {
+      /* NON 2.04 Changed */
+      if(uip_datalen() >= 4 && ((uint8_t *)uip_appdata)[1] == 0x44) {
+        br_slots_stats.changed++;
+      }
+    } else if(ev == PROCESS_EVENT_POLL) {
+      /* A mote joined: assign it soon, with those that follow it */
+      if(etimer_expired(&round_timer) ||
+         etimer_expiration_time(&round_timer) - clock_time() >
+         BR_SLOTS_JOIN_DELAY * CLOCK_SECOND) {
+        etimer_set(&round_timer, BR_SLOTS_JOIN_DELAY * CLOCK_SECOND);
+      }
+    } else if(ev == PROCESS_EVENT_TIMER && data == &cycle_timer) {
+      cycle_start += BR_SLOTS_PERIOD;
+      etimer_reset(&cycle_timer);
+    } else if(ev == PROCESS_EVENT_TIMER && data == &round_timer) {
+      if(total == 0) {
+        etimer_set(&round_timer, BR_SLOTS_INTERVAL * CLOCK_SECOND);
+        start_round();
+      } else {
+        /* Still sending the previous round */
+        etimer_set(&round_timer, BR_SLOTS_JOIN_DELAY * CLOCK_SECOND);
+      }
+    } else if(ev == PROCESS_EVENT_TIMER && data == &send_timer) {
+      if(total > 0) {
+        next_send();
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+br_slots_init(void)
+{
+  uip_ds6_notification_add(&route_notification, route_changed);
+  process_start(&br_slots_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
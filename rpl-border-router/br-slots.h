@@ -0,0 +1,61 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Notification slots assigned by the border router
+ *
+ *         The thermostats notify their temperature once per period, each
+ *         in a slot of it (see smart-thermostat/notify-slot.h). The router
+ *         keeps the reference period and, every BR_SLOTS_INTERVAL and soon
+ *         after a mote joins, spreads the motes it has a route to evenly
+ *         over it: with n motes, the k-th in the order of the interface
+ *         identifiers gets slot k of n. Each mote is sent a non-confirmable
+ *         CoAP POST on /slot with its slot and the time since the period
+ *         started; the POSTs themselves go out in the slots they assign,
+ *         so that they are spread over the period as well.
+ */
+
+#ifndef __BR_SLOTS_H__
+#define __BR_SLOTS_H__
+
+#include "contiki.h"
+
+struct br_slots_stats {
+  uint16_t rounds;        /* assignments of all the motes */
+  uint16_t sent;          /* POSTs to the motes */
+  uint16_t changed;       /* 2.04 answers from the motes */
+  uint8_t motes;          /* spread over the period in the last round */
+};
+
+extern struct br_slots_stats br_slots_stats;
+
+/* Starts assigning slots; the DODAG must be running. */
+void br_slots_init(void);
+
+#endif /* __BR_SLOTS_H__ */
@@ -0,0 +1,260 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Packet trace of the border router
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "sys/rtimer.h"
+#include "br-trace.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* The drivers wrapped to see the radio side */
+#ifdef BR_TRACE_CONF_MAC
+#define BR_TRACE_MAC BR_TRACE_CONF_MAC
+#else
+#define BR_TRACE_MAC csma_driver
+#endif
+#ifdef BR_TRACE_CONF_NETWORK
+#define BR_TRACE_NETWORK BR_TRACE_CONF_NETWORK
+#else
+#define BR_TRACE_NETWORK sicslowpan_driver
+#endif
+
+extern const struct mac_driver BR_TRACE_MAC;
+extern const struct network_driver BR_TRACE_NETWORK;
+
+#define UIP_IP_BUF     ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define COAP_PORT      5683
+#define DISPATCH_FRAGN 0xe0   /* 6LoWPAN subsequent fragment */
+
+struct br_trace_record br_trace[BR_TRACE_RECORDS];
+uint8_t br_trace_next;
+
+/* A frame from the radio being processed, recorded when it leaves again */
+static uint8_t pending;
+static struct br_trace_record received;
+
+/*---------------------------------------------------------------------------*/
+/* Seconds and ticks change together on the MSP430 clock, so the ticks
+   within the second complete the seconds into a 32-bit time. */
+static void
+stamp(struct br_trace_record *r)
+{
+  unsigned long seconds;
+  clock_time_t ticks;
+
+  do {
+    seconds = clock_seconds();
+    ticks = clock_time();
+  } while(seconds != clock_seconds());
+  r->ticks = (uint32_t)seconds * CLOCK_SECOND + ticks % CLOCK_SECOND;
+  r->rtimer = RTIMER_NOW();
+}
+/*---------------------------------------------------------------------------*/
+static struct br_trace_record *
+new_record(void)
+{
+  struct br_trace_record *r;
+
+  r = &br_trace[br_trace_next];
+  br_trace_next = (br_trace_next + 1) % BR_TRACE_RECORDS;
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(struct br_trace_record *r)
+{
+  uint8_t *ip = &uip_buf[UIP_LLH_LEN];
+  uint8_t *end = ip + uip_len;
+  uint8_t *next = ip + UIP_IPH_LEN;
+  uint8_t proto;
+
+  r->len = uip_len;
+  memcpy(r->src, &ip[8 + 12], 4);
+  memcpy(r->dst, &ip[24 + 12], 4);
+  proto = ip[6];
+  if(proto == UIP_PROTO_HBHO && next + 2 <= end) {
+    /* RPL option on packets inside the mesh */
+    proto = next[0];
+    next += (next[1] + 1) * 8;
+  }
+  r->proto = proto;
+  r->mid = 0;
+  r->code = 0;
+  r->type = 0;
+  if(proto == UIP_PROTO_UDP && next + UIP_UDPH_LEN + 4 <= end &&
+     (((next[0] << 8) | next[1]) == COAP_PORT ||
+      ((next[2] << 8) | next[3]) == COAP_PORT)) {
+    next += UIP_UDPH_LEN;
+    if((next[0] >> 6) == 1) {
+      r->flags |= BR_TRACE_COAP;
+      r->type = (next[0] >> 4) & 0x03;
+      r->code = next[1];
+      r->mid = (next[2] << 8) | next[3];
+    }
+  } else if(proto == UIP_PROTO_ICMP6 && next < end) {
+    r->type = next[0];
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The frame received is not forwarded: only its link-layer sender and
+   length are known */
+static void
+flush_received(void)
+{
+  struct br_trace_record *r;
+
+  r = new_record();
+  *r = received;
+  r->flags |= BR_TRACE_NO_IP;
+  memset(r->dst, 0, sizeof(r->dst));
+  r->proto = 0;
+  r->mid = 0;
+  r->code = 0;
+  r->type = 0;
+  pending = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_trace_ip(uint8_t dir)
+{
+  struct br_trace_record *r;
+
+  if(pending && dir != BR_TRACE_RADIO_IN) {
+    if(uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr)) {
+      /* An answer of the router itself, e.g. a DIO to a DIS or a CoAP
+         response, sent while the frame for it is processed */
+      flush_received();
+    } else {
+      /* The frame received earlier is this packet, now known in full */
+      r = new_record();
+      *r = received;
+      fill(r);
+      pending = 0;
+    }
+  }
+  r = new_record();
+  stamp(r);
+  r->flags = dir;
+  fill(r);
+}
+/*---------------------------------------------------------------------------*/
+static void
+network_init(void)
+{
+  BR_TRACE_NETWORK.init();
+}
+/*---------------------------------------------------------------------------*/
+static void
+network_input(void)
+{
+  const rimeaddr_t *sender;
+
+  /* Stamped now, detailed if the packet is forwarded */
+  stamp(&received);
+  received.flags = BR_TRACE_RADIO_IN;
+  received.len = packetbuf_datalen();
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  memcpy(received.src, &sender->u8[RIMEADDR_SIZE - 4], 4);
+  pending = 1;
+
+  BR_TRACE_NETWORK.input();
+
+  if(pending) {
+    /* For the router itself, a fragment, or dropped */
+    flush_received();
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct network_driver br_trace_network_driver = {
+  "br-trace",
+  network_init,
+  network_input
+};
+/*---------------------------------------------------------------------------*/
+static void
+mac_init(void)
+{
+  BR_TRACE_MAC.init();
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_send(mac_callback_t sent, void *ptr)
+{
+  if((((uint8_t *)packetbuf_dataptr())[0] & 0xf8) != DISPATCH_FRAGN) {
+    /* uip_buf still holds the packet being compressed into the frame */
+    br_trace_ip(BR_TRACE_RADIO_OUT);
+  }
+  BR_TRACE_MAC.send(sent, ptr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+mac_input(void)
+{
+  BR_TRACE_MAC.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_on(void)
+{
+  return BR_TRACE_MAC.on();
+}
+/*---------------------------------------------------------------------------*/
+static int
+mac_off(int keep_radio_on)
+{
+  return BR_TRACE_MAC.off(keep_radio_on);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+mac_channel_check_interval(void)
+{
+  return BR_TRACE_MAC.channel_check_interval();
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver br_trace_mac_driver = {
+  "br-trace",
+  mac_init,
+  mac_send,
+  mac_input,
+  mac_on,
+  mac_off,
+  mac_channel_check_interval
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,93 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Packet trace of the border router
+ *
+ *         The metadata of the packets crossing the router are kept in a
+ *         small ring: when, which way (from or to the host over SLIP,
+ *         from or to the mesh over the radio), the last 32 bits of both
+ *         addresses, the upper protocol, the length and, for CoAP, the
+ *         type, code and message ID. The same message ID seen coming in
+ *         on one side and leaving on the other gives the time it spent in
+ *         the router, and its timestamps on both sides of a mote exchange
+ *         the time spent in the mesh.
+ *
+ *         The SLIP side is captured by slip-bridge.c. The radio side is
+ *         captured by wrapping the MAC driver (frames handed to it for
+ *         sending, first fragments only) and the network driver (frames
+ *         received). Received frames are completed with the IPv6 details
+ *         once the packet is forwarded; those for the router itself keep
+ *         only the link-layer sender.
+ *
+ *         The ring is served as text at http://[router]/dump, oldest
+ *         first, and tools/trace2pcap turns it into a pcap file.
+ */
+
+#ifndef __BR_TRACE_H__
+#define __BR_TRACE_H__
+
+#include "contiki.h"
+
+#ifdef BR_TRACE_CONF_RECORDS
+#define BR_TRACE_RECORDS BR_TRACE_CONF_RECORDS
+#else
+#define BR_TRACE_RECORDS 32
+#endif
+
+#define BR_TRACE_SLIP_IN   0
+#define BR_TRACE_SLIP_OUT  1
+#define BR_TRACE_RADIO_IN  2
+#define BR_TRACE_RADIO_OUT 3
+#define BR_TRACE_DIR       0x03
+#define BR_TRACE_COAP      0x04   /* type, code and mid are set */
+#define BR_TRACE_NO_IP     0x08   /* only the link-layer sender is known */
+
+struct br_trace_record {
+  uint32_t ticks;         /* clock ticks since boot */
+  uint16_t rtimer;        /* RTIMER_NOW(), for the time within the tick */
+  uint8_t flags;
+  uint8_t proto;          /* after the hop-by-hop options, if any */
+  uint16_t len;           /* of the IPv6 packet, or of the frame */
+  uint8_t src[4];
+  uint8_t dst[4];
+  uint16_t mid;
+  uint8_t code;
+  uint8_t type;           /* CoAP type, or ICMPv6 type */
+};
+
+/* Oldest record first: br_trace[(br_trace_next + i) % BR_TRACE_RECORDS]
+   for i from 0, skipping those with a zero length */
+extern struct br_trace_record br_trace[BR_TRACE_RECORDS];
+extern uint8_t br_trace_next;
+
+/* Records the IPv6 packet in uip_buf as seen in direction dir */
+void br_trace_ip(uint8_t dir);
+
+#endif /* __BR_TRACE_H__ */
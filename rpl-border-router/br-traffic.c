@@ -0,0 +1,130 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Per-mote traffic counters of the border router
+ */
+
+#include "contiki.h"
+#include "br-traffic.h"
+
+#include <string.h>
+
+#define OTHER (&br_traffic[BR_TRAFFIC_ENTRIES])
+
+struct br_traffic br_traffic[BR_TRAFFIC_ENTRIES + 1];
+
+static uint8_t prefix[8];
+static uint8_t prefix_set;
+/*---------------------------------------------------------------------------*/
+static uint32_t
+packets(const struct br_traffic *t)
+{
+  return (uint32_t)t->down_packets + t->up_packets + t->no_route;
+}
+/*---------------------------------------------------------------------------*/
+static struct br_traffic *
+lookup(const uip_ipaddr_t *addr)
+{
+  struct br_traffic *t;
+  struct br_traffic *quietest;
+
+  if(!prefix_set || memcmp(addr, prefix, 8) != 0) {
+    return NULL;
+  }
+
+  quietest = NULL;
+  for(t = br_traffic; t < OTHER; t++) {
+    if(packets(t) == 0) {
+      if(quietest == NULL || packets(quietest) > 0) {
+        quietest = t;
+      }
+    } else if(memcmp(t->iid, &addr->u8[8], 8) == 0) {
+      return t;
+    } else if(quietest == NULL || packets(t) < packets(quietest)) {
+      quietest = t;
+    }
+  }
+
+  /* Make room by moving the quietest mote to "other" */
+  OTHER->down_packets += quietest->down_packets;
+  OTHER->up_packets += quietest->up_packets;
+  OTHER->down_bytes += quietest->down_bytes;
+  OTHER->up_bytes += quietest->up_bytes;
+  OTHER->no_route += quietest->no_route;
+  memset(quietest, 0, sizeof(*quietest));
+  memcpy(quietest->iid, &addr->u8[8], 8);
+  return quietest;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_traffic_set_prefix(const uip_ipaddr_t *new_prefix)
+{
+  if(!prefix_set || memcmp(prefix, new_prefix, 8) != 0) {
+    memset(br_traffic, 0, sizeof(br_traffic));
+    memcpy(prefix, new_prefix, 8);
+    prefix_set = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_traffic_down(const uip_ipaddr_t *dest, uint16_t len)
+{
+  struct br_traffic *t;
+
+  t = lookup(dest);
+  if(t != NULL) {
+    t->down_packets++;
+    t->down_bytes += len;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_traffic_up(const uip_ipaddr_t *src, uint16_t len)
+{
+  struct br_traffic *t;
+
+  t = lookup(src);
+  if(t != NULL) {
+    t->up_packets++;
+    t->up_bytes += len;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_traffic_no_route(const uip_ipaddr_t *dest)
+{
+  struct br_traffic *t;
+
+  t = lookup(dest);
+  if(t != NULL) {
+    t->no_route++;
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,68 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Per-mote traffic counters of the border router
+ *
+ *         Packets crossing the SLIP link are counted per mote, keyed by
+ *         the interface identifier under the mesh prefix like the routes.
+ *         The table keeps the busiest motes; traffic of motes pushed out
+ *         of it is added to a common "other" entry.
+ */
+
+#ifndef __BR_TRAFFIC_H__
+#define __BR_TRAFFIC_H__
+
+#include "net/uip.h"
+
+#ifdef BR_TRAFFIC_CONF_ENTRIES
+#define BR_TRAFFIC_ENTRIES BR_TRAFFIC_CONF_ENTRIES
+#else
+#define BR_TRAFFIC_ENTRIES 16
+#endif
+
+struct br_traffic {
+  uint8_t iid[8];
+  uint16_t down_packets;  /* from the host to the mote */
+  uint16_t up_packets;    /* from the mote to the host */
+  uint32_t down_bytes;
+  uint32_t up_bytes;
+  uint16_t no_route;      /* packets for the mote not forwarded, no route */
+};
+
+/* In use entries have some packets; the last one is "other" */
+extern struct br_traffic br_traffic[BR_TRAFFIC_ENTRIES + 1];
+
+void br_traffic_set_prefix(const uip_ipaddr_t *prefix);
+
+void br_traffic_down(const uip_ipaddr_t *dest, uint16_t len);
+void br_traffic_up(const uip_ipaddr_t *src, uint16_t len);
+void br_traffic_no_route(const uip_ipaddr_t *dest);
+
+#endif /* __BR_TRAFFIC_H__ */
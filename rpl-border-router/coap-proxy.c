@@ -0,0 +1,1155 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         CoAP proxy towards the motes, with a response cache
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "erbium.h"
+#include "er-coap-13.h"
+#include "er-coap-13-transactions.h"
+#include "er-coap-13-separate.h"
+#include "coap-proxy.h"
+#if COAP_PROXY_COCOA
+#include "coap-rto.h"
+#endif
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#ifndef UIP_IP_BUF
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#endif
+#ifndef UIP_UDP_BUF
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#endif
+
+#ifndef COAP_PROXY_CONF_CACHE_ENTRIES
+#define COAP_PROXY_CACHE_ENTRIES 4
+#else
+#define COAP_PROXY_CACHE_ENTRIES COAP_PROXY_CONF_CACHE_ENTRIES
+#endif
+
+/* Timeouts of the requests to the motes from their measured RTTs
+   (coap-rto.c) rather than the fixed COAP_RESPONSE_TIMEOUT */
+#ifdef COAP_PROXY_CONF_COCOA
+#define COAP_PROXY_COCOA COAP_PROXY_CONF_COCOA
+#else
+#define COAP_PROXY_COCOA 0
+#endif
+
+/* Mesh requests in flight, and upstream requests that may wait on each */
+#ifndef COAP_PROXY_CONF_PENDING
+#define COAP_PROXY_PENDING 2
+#else
+#define COAP_PROXY_PENDING COAP_PROXY_CONF_PENDING
+#endif
+#ifndef COAP_PROXY_CONF_WAITERS
+#define COAP_PROXY_WAITERS 3
+#else
+#define COAP_PROXY_WAITERS COAP_PROXY_CONF_WAITERS
+#endif
+
+/* Local port for requests to the motes. Ports 0xF0B0-0xF0BF compress to
+   four bits in 6LoWPAN. */
+#ifndef COAP_PROXY_CONF_PORT
+#define COAP_PROXY_PORT 61617
+#else
+#define COAP_PROXY_PORT COAP_PROXY_CONF_PORT
+#endif
+
+/* Observe relay: mote resources observed on behalf of upstream clients,
+   the upstream observers each of them can serve, and how long a relay
+   may stay silent before it is registered again with the mote. */
+#ifndef COAP_PROXY_CONF_RELAYS
+#define COAP_PROXY_RELAYS 4
+#else
+#define COAP_PROXY_RELAYS COAP_PROXY_CONF_RELAYS
+#endif
+#ifndef COAP_PROXY_CONF_RELAY_OBSERVERS
+#define COAP_PROXY_RELAY_OBSERVERS 3
+#else
+#define COAP_PROXY_RELAY_OBSERVERS COAP_PROXY_CONF_RELAY_OBSERVERS
+#endif
+#ifndef COAP_PROXY_CONF_RELAY_TIMEOUT
+#define COAP_PROXY_RELAY_TIMEOUT 30
+#else
+#define COAP_PROXY_RELAY_TIMEOUT COAP_PROXY_CONF_RELAY_TIMEOUT
+#endif
+/* Resource whose values may also come aggregated over the mesh
+   (coap_proxy_deliver()); a relay for it is registered with the mote only
+   once they have stayed away for COAP_PROXY_RELAY_TIMEOUT. */
+#ifdef COAP_PROXY_CONF_FED_PATH
+#define COAP_PROXY_FED_PATH COAP_PROXY_CONF_FED_PATH
+#endif
+/* Registrations waiting for the first value from the mote */
+#define RELAY_WAITERS 2
+/* Every n-th notification to an upstream observer is confirmable */
+#define RELAY_REFRESH_INTERVAL 20
+#define RELAY_CHECK_INTERVAL (5 * CLOCK_SECOND)
+/* Seconds before an unanswered registration is sent again */
+#define RELAY_RETRY 5
+
+#define PATH_LEN   16
+#define QUERY_LEN  12
+#define BODY_LEN   16
+
+struct cache_entry {
+  uip_ipaddr_t mote;
+  char path[PATH_LEN];
+  unsigned long expires;          /* clock_seconds(), 0 if unused */
+  int content_format;
+  uint8_t len;
+  uint8_t payload[REST_MAX_CHUNK_SIZE];
+};
+
+#define PENDING_FREE    0
+#define PENDING_WAITING 1
+
+struct pending {
+  struct ctimer timer;
+  uip_ipaddr_t mote;
+  char path[PATH_LEN];
+  char query[QUERY_LEN];
+  uint8_t body[BODY_LEN];
+  uint8_t body_len;
+  int content_format;
+  uint8_t state;
+  uint8_t method;
+  uint16_t mid;
+  uint8_t token[2];
+  uint8_t retransmissions;
+  uint8_t waiting;
+#if COAP_PROXY_COCOA
+  clock_time_t sent;              /* first transmission */
+  clock_time_t timeout;
+#endif
+  coap_separate_t upstream[COAP_PROXY_WAITERS];
+};
+
+struct relay_observer {
+  uip_ipaddr_t addr;
+  uint16_t port;                  /* 0 if unused */
+  uint16_t con_mid;               /* confirmable notification in flight */
+  uint8_t token_len;
+  uint8_t token[COAP_TOKEN_LEN];
+};
+
+#define RELAY_FREE        0
+#define RELAY_REGISTER    1       /* registration to be sent to the mote */
+#define RELAY_REGISTERING 2
+#define RELAY_ACTIVE      3
+#define RELAY_FED_WAIT    4       /* waiting for values over the mesh */
+
+struct relay {
+  uip_ipaddr_t mote;
+  char path[PATH_LEN];
+  unsigned long last_seen;        /* last notification or registration */
+  uint32_t obs_counter;           /* Observe sequence towards upstream */
+  uint8_t state;
+  uint8_t token[2];
+  uint8_t fed;                    /* values come over the mesh */
+  coap_proxy_callback_t callback; /* kept for the router itself if set */
+  struct relay_observer observers[COAP_PROXY_RELAY_OBSERVERS];
+};
+
+struct relay_waiter {
+  struct relay *relay;            /* NULL if unused */
+  coap_separate_t request;
+};
+
+struct coap_proxy_stats coap_proxy_stats;
+
+static struct cache_entry cache[COAP_PROXY_CACHE_ENTRIES];
+static struct pending pending[COAP_PROXY_PENDING];
+static struct relay relays[COAP_PROXY_RELAYS];
+static struct relay_waiter relay_waiters[RELAY_WAITERS];
+static struct uip_udp_conn *mesh_conn;
+static uint16_t next_token;
+
+/* The response being relayed, copied out of uip_buf before anything else
+   is sent. */
+static uint8_t response_payload[REST_MAX_CHUNK_SIZE];
+
+PROCESS(coap_proxy_process, "CoAP proxy");
+
+void mote_handler(void *request, void *response, uint8_t *buffer,
+                  uint16_t preferred_size, int32_t *offset);
+RESOURCE(mote, METHOD_GET | METHOD_POST | METHOD_PUT | HAS_SUB_RESOURCES,
+         "m", "title=\"Mote proxy: m/<iid>/<path>\"");
+void announce_handler(void *request, void *response, uint8_t *buffer,
+                      uint16_t preferred_size, int32_t *offset);
+RESOURCE(announce, METHOD_POST, "announce", "title=\"Mote joined: r=<ms>\"");
+/*---------------------------------------------------------------------------*/
+static void
+new_token(uint8_t *token)
+{
+  next_token++;
+  token[0] = next_token >> 8;
+  token[1] = next_token & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static int
+same_resource(const uip_ipaddr_t *mote, const char *path,
+              const uip_ipaddr_t *other_mote, const char *other_path,
+              int other_len)
+{
+  return uip_ipaddr_cmp(mote, other_mote) &&
+    strncmp(path, other_path, other_len) == 0 && path[other_len] == '\0';
+}
+/*---------------------------------------------------------------------------*/
+static int
+hexval(char c)
+{
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if(c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if(c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Splits "m/212:7402:2:202/status" into the mote address, built from our
+   own prefix and the given interface identifier, and the mote path. */
+static int
+parse_url(const char *url, int len, uip_ipaddr_t *mote,
+          const char **path, int *path_len)
+{
+  uip_ds6_addr_t *own;
+  uint16_t group = 0;
+  int groups = 0;
+  int digits = 0;
+  int i;
+  int d;
+
+  if(len < 3 || url[1] != '/') {
+    return 0;
+  }
+  own = uip_ds6_get_global(-1);
+  if(own == NULL) {
+    return 0;
+  }
+  memcpy(mote, &own->ipaddr, 8);
+
+  for(i = 2; i < len && url[i] != '/'; i++) {
+    if(url[i] == ':') {
+      if(digits == 0 || groups == 3) {
+        return 0;
+      }
+      mote->u16[4 + groups++] = UIP_HTONS(group);
+      group = 0;
+      digits = 0;
+    } else {
+      d = hexval(url[i]);
+      if(d < 0 || ++digits > 4) {
+        return 0;
+      }
+      group = (group << 4) | d;
+    }
+  }
+  if(digits == 0 || groups != 3 || i + 1 >= len) {
+    return 0;
+  }
+  mote->u16[7] = UIP_HTONS(group);
+
+  *path = &url[i + 1];
+  *path_len = len - i - 1;
+  return *path_len < PATH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+static struct cache_entry *
+cache_lookup(const uip_ipaddr_t *mote, const char *path, int path_len)
+{
+  int i;
+
+  for(i = 0; i < COAP_PROXY_CACHE_ENTRIES; i++) {
+    if(cache[i].expires > clock_seconds() &&
+       same_resource(&cache[i].mote, cache[i].path, mote, path, path_len)) {
+      return &cache[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_store(const uip_ipaddr_t *mote, const char *path, uint32_t max_age,
+            int content_format, uint8_t len)
+{
+  struct cache_entry *e;
+  int i;
+
+  if(max_age == 0 || len > sizeof(e->payload)) {
+    return;
+  }
+  /* Replace the same resource, else the entry that expires first */
+  e = &cache[0];
+  for(i = 0; i < COAP_PROXY_CACHE_ENTRIES; i++) {
+    if(uip_ipaddr_cmp(&cache[i].mote, mote) &&
+       strcmp(cache[i].path, path) == 0) {
+      e = &cache[i];
+      break;
+    }
+    if(cache[i].expires < e->expires) {
+      e = &cache[i];
+    }
+  }
+  uip_ipaddr_copy(&e->mote, mote);
+  strcpy(e->path, path);
+  e->expires = clock_seconds() + max_age;
+  e->content_format = content_format;
+  e->len = len;
+  memcpy(e->payload, response_payload, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+cache_invalidate(const uip_ipaddr_t *mote)
+{
+  int i;
+
+  for(i = 0; i < COAP_PROXY_CACHE_ENTRIES; i++) {
+    if(uip_ipaddr_cmp(&cache[i].mote, mote)) {
+      cache[i].expires = 0;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+answer_from_cache(void *response, uint8_t *buffer, struct cache_entry *e)
+{
+  coap_proxy_stats.hits++;
+  if(e->content_format >= 0) {
+    REST.set_header_content_type(response, e->content_format);
+  }
+  REST.set_header_max_age(response, e->expires - clock_seconds());
+  memcpy(buffer, e->payload, e->len);
+  REST.set_response_payload(response, buffer, e->len);
+}
+/*---------------------------------------------------------------------------*/
+/* Sends a separate response; observe is the Observe option, or -1 */
+static void
+resume_upstream(coap_separate_t *request, uint8_t code, int content_format,
+                uint32_t max_age, int32_t observe, uint8_t len)
+{
+  coap_transaction_t *t;
+  coap_packet_t response[1];
+
+  t = coap_new_transaction(request->mid, &request->addr, request->port);
+  if(t == NULL) {
+    PRINTF("coap-proxy: no transaction to answer upstream\n");
+    return;
+  }
+  coap_separate_resume(response, request, code);
+  if(observe >= 0) {
+    coap_set_header_observe(response, observe);
+  }
+  if(content_format >= 0) {
+    coap_set_header_content_type(response, content_format);
+  }
+  if(max_age > 0) {
+    coap_set_header_max_age(response, max_age);
+  }
+  if(len > 0) {
+    coap_set_payload(response, response_payload, len);
+  }
+  t->packet_len = coap_serialize_message(response, t->packet);
+  coap_send_transaction(t);
+}
+/*---------------------------------------------------------------------------*/
+static void
+finish(struct pending *p, uint8_t code, int content_format, uint32_t max_age,
+       uint8_t len)
+{
+  int i;
+
+  ctimer_stop(&p->timer);
+  for(i = 0; i < p->waiting; i++) {
+    resume_upstream(&p->upstream[i], code, content_format, max_age, -1, len);
+  }
+  p->state = PENDING_FREE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_request(void *ptr)
+{
+  struct pending *p = ptr;
+  coap_packet_t request[1];
+  uint8_t buf[COAP_MAX_HEADER_SIZE + BODY_LEN];
+  size_t len;
+
+  if(p->retransmissions > COAP_MAX_RETRANSMIT) {
+    PRINTF("coap-proxy: no answer from ");
+    PRINT6ADDR(&p->mote);
+    PRINTF("\n");
+    coap_proxy_stats.timeouts++;
+#if COAP_PROXY_COCOA
+    coap_rto_giveup(&p->mote);
+#endif
+    finish(p, GATEWAY_TIMEOUT_5_04, -1, 0, 0);
+    return;
+  }
+
+  coap_init_message(request, COAP_TYPE_CON, p->method, p->mid);
+  coap_set_header_token(request, p->token, sizeof(p->token));
+  coap_set_header_uri_path(request, p->path);
+  if(p->query[0] != '\0') {
+    coap_set_header_uri_query(request, p->query);
+  }
+  if(p->content_format >= 0) {
+    coap_set_header_content_type(request, p->content_format);
+  }
+  if(p->body_len > 0) {
+    coap_set_payload(request, p->body, p->body_len);
+  }
+  len = coap_serialize_message(request, buf);
+  uip_udp_packet_sendto(mesh_conn, buf, len, &p->mote,
+                        UIP_HTONS(COAP_DEFAULT_PORT));
+  if(p->retransmissions == 0) {
+    coap_proxy_stats.requests++;
+  } else {
+    coap_proxy_stats.retransmissions++;
+  }
+
+#if COAP_PROXY_COCOA
+  if(p->retransmissions == 0) {
+    p->sent = clock_time();
+    p->timeout = coap_rto_start(&p->mote);
+  } else {
+    p->timeout = coap_rto_backoff(&p->mote, p->timeout);
+  }
+  ctimer_set(&p->timer, p->timeout, send_request, p);
+#else
+  ctimer_set(&p->timer,
+             (COAP_RESPONSE_TIMEOUT * CLOCK_SECOND) << p->retransmissions,
+             send_request, p);
+#endif
+  p->retransmissions++;
+}
+/*---------------------------------------------------------------------------*/
+static struct pending *
+pending_lookup(const uip_ipaddr_t *mote, const char *path, int path_len)
+{
+  int i;
+
+  for(i = 0; i < COAP_PROXY_PENDING; i++) {
+    if(pending[i].state != PENDING_FREE && pending[i].method == COAP_GET &&
+       same_resource(&pending[i].mote, pending[i].path, mote, path, path_len)) {
+      return &pending[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct pending *
+pending_new(coap_packet_t *request, const uip_ipaddr_t *mote,
+            const char *path, int path_len)
+{
+  struct pending *p;
+  const char *query;
+  const uint8_t *body;
+  int query_len;
+  int body_len;
+  int i;
+
+  query_len = coap_get_header_uri_query(request, &query);
+  body_len = coap_get_payload(request, &body);
+  if(query_len >= QUERY_LEN || body_len > BODY_LEN) {
+    return NULL;
+  }
+  for(i = 0, p = NULL; i < COAP_PROXY_PENDING; i++) {
+    if(pending[i].state == PENDING_FREE) {
+      p = &pending[i];
+      break;
+    }
+  }
+  if(p == NULL) {
+    return NULL;
+  }
+
+  uip_ipaddr_copy(&p->mote, mote);
+  memcpy(p->path, path, path_len);
+  p->path[path_len] = '\0';
+  memcpy(p->query, query, query_len);
+  p->query[query_len] = '\0';
+  memcpy(p->body, body, body_len);
+  p->body_len = body_len;
+  p->content_format = body_len > 0 ?
+    (int)coap_get_header_content_type(request) : -1;
+  p->method = request->code;
+  p->mid = coap_get_mid();
+  new_token(p->token);
+  p->retransmissions = 0;
+  p->waiting = 0;
+  p->state = PENDING_WAITING;
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+static struct relay *
+relay_lookup(const uip_ipaddr_t *mote, const char *path, int path_len)
+{
+  int i;
+
+  for(i = 0; i < COAP_PROXY_RELAYS; i++) {
+    if(relays[i].state != RELAY_FREE &&
+       same_resource(&relays[i].mote, relays[i].path, mote, path, path_len)) {
+      return &relays[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct relay *
+relay_new(const uip_ipaddr_t *mote, const char *path, int path_len)
+{
+  struct relay *r;
+  int i;
+
+  for(i = 0; i < COAP_PROXY_RELAYS; i++) {
+    r = &relays[i];
+    if(r->state == RELAY_FREE) {
+      memset(r, 0, sizeof(struct relay));
+      uip_ipaddr_copy(&r->mote, mote);
+      memcpy(r->path, path, path_len);
+      r->path[path_len] = '\0';
+      new_token(r->token);
+      r->state = RELAY_REGISTER;
+#ifdef COAP_PROXY_FED_PATH
+      if(strcmp(r->path, COAP_PROXY_FED_PATH) == 0) {
+        r->state = RELAY_FED_WAIT;
+        r->fed = 1;
+        r->last_seen = clock_seconds();
+      }
+#endif
+      return r;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+relay_has_clients(struct relay *r)
+{
+  int i;
+
+  if(r->callback != NULL) {
+    return 1;
+  }
+  for(i = 0; i < COAP_PROXY_RELAY_OBSERVERS; i++) {
+    if(r->observers[i].port != 0) {
+      return 1;
+    }
+  }
+  for(i = 0; i < RELAY_WAITERS; i++) {
+    if(relay_waiters[i].relay == r) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct relay_observer *
+relay_add_observer(struct relay *r, const uip_ipaddr_t *addr, uint16_t port,
+                   const uint8_t *token, uint8_t token_len)
+{
+  struct relay_observer *o;
+  struct relay_observer *free_slot = NULL;
+  int i;
+
+  /* One observation per client endpoint and resource, as in Erbium */
+  for(i = 0; i < COAP_PROXY_RELAY_OBSERVERS; i++) {
+    o = &r->observers[i];
+    if(o->port == port && uip_ipaddr_cmp(&o->addr, addr)) {
+      free_slot = o;
+      break;
+    }
+    if(o->port == 0 && free_slot == NULL) {
+      free_slot = o;
+    }
+  }
+  if(free_slot == NULL) {
+    return NULL;
+  }
+  o = free_slot;
+  uip_ipaddr_copy(&o->addr, addr);
+  o->port = port;
+  o->con_mid = 0;
+  o->token_len = token_len;
+  memcpy(o->token, token, token_len);
+  return o;
+}
+/*---------------------------------------------------------------------------*/
+static void
+relay_remove_observer(const uip_ipaddr_t *mote, const char *path, int path_len,
+                      const uip_ipaddr_t *addr, uint16_t port)
+{
+  struct relay *r;
+  int i;
+
+  r = relay_lookup(mote, path, path_len);
+  if(r == NULL) {
+    return;
+  }
+  for(i = 0; i < COAP_PROXY_RELAY_OBSERVERS; i++) {
+    if(r->observers[i].port == port &&
+       uip_ipaddr_cmp(&r->observers[i].addr, addr)) {
+      r->observers[i].port = 0;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Outcome of a confirmable notification: drop observers that are gone */
+static void
+relay_observer_check(void *data, void *response)
+{
+  struct relay_observer *o = data;
+  coap_packet_t *const ack = (coap_packet_t *)response;
+
+  if(o->con_mid == 0) {
+    /* The slot was given to another observer meanwhile */
+    return;
+  }
+  o->con_mid = 0;
+  if(ack == NULL || ack->type == COAP_TYPE_RST) {
+    PRINTF("coap-proxy: upstream observer gone\n");
+    o->port = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+relay_notify(struct relay *r, struct relay_observer *o, uint8_t code,
+             int content_format, uint32_t max_age, uint8_t len)
+{
+  coap_packet_t notification[1];
+  coap_transaction_t *t = NULL;
+  uint8_t buf[COAP_MAX_HEADER_SIZE + REST_MAX_CHUNK_SIZE];
+  uint16_t mid;
+
+  mid = coap_get_mid();
+  if(code == CONTENT_2_05 && r->obs_counter % RELAY_REFRESH_INTERVAL == 0) {
+    t = coap_new_transaction(mid, &o->addr, o->port);
+  }
+  coap_init_message(notification, t ? COAP_TYPE_CON : COAP_TYPE_NON, code,
+                    mid);
+  coap_set_header_token(notification, o->token, o->token_len);
+  if(code == CONTENT_2_05) {
+    coap_set_header_observe(notification, r->obs_counter);
+    if(max_age > 0) {
+      coap_set_header_max_age(notification, max_age);
+    }
+  }
+  if(content_format >= 0) {
+    coap_set_header_content_type(notification, content_format);
+  }
+  if(len > 0) {
+    coap_set_payload(notification, response_payload, len);
+  }
+
+  if(t != NULL) {
+    o->con_mid = mid;
+    t->callback = relay_observer_check;
+    t->callback_data = o;
+    t->packet_len = coap_serialize_message(notification, t->packet);
+    coap_send_transaction(t);
+  } else {
+    coap_send_message(&o->addr, o->port, buf,
+                      coap_serialize_message(notification, buf));
+  }
+  coap_proxy_stats.notifications++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+relay_register(struct relay *r)
+{
+  coap_packet_t request[1];
+  uint8_t buf[COAP_MAX_HEADER_SIZE];
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, coap_get_mid());
+  coap_set_header_token(request, r->token, sizeof(r->token));
+  coap_set_header_uri_path(request, r->path);
+  coap_set_header_observe(request, 0);
+  uip_udp_packet_sendto(mesh_conn, buf, coap_serialize_message(request, buf),
+                        &r->mote, UIP_HTONS(COAP_DEFAULT_PORT));
+  coap_proxy_stats.registrations++;
+  r->state = RELAY_REGISTERING;
+  r->last_seen = clock_seconds();
+}
+/*---------------------------------------------------------------------------*/
+/* A response or notification for a relayed observation arrived. The value
+   is fanned out to all upstream observers and answers the registrations
+   waiting for it. */
+static void
+relay_input(struct relay *r, coap_packet_t *message, int content_format,
+            uint32_t max_age, uint8_t len)
+{
+  struct relay_waiter *w;
+  uint32_t observe;
+  uint8_t ok;
+  int i;
+
+  ok = message->code == CONTENT_2_05 &&
+    coap_get_header_observe(message, &observe);
+  if(ok) {
+    r->state = RELAY_ACTIVE;
+    r->last_seen = clock_seconds();
+    r->obs_counter++;
+    cache_store(&r->mote, r->path, max_age, content_format, len);
+    if(r->callback != NULL) {
+      r->callback(&r->mote, r->path, response_payload, len);
+    }
+  }
+
+  for(i = 0; i < COAP_PROXY_RELAY_OBSERVERS; i++) {
+    if(r->observers[i].port != 0) {
+      relay_notify(r, &r->observers[i], message->code, content_format,
+                   max_age, len);
+      if(!ok) {
+        /* A notification without Observe ends the observation */
+        r->observers[i].port = 0;
+      }
+    }
+  }
+  for(i = 0; i < RELAY_WAITERS; i++) {
+    w = &relay_waiters[i];
+    if(w->relay != r) {
+      continue;
+    }
+    resume_upstream(&w->request, message->code, content_format, max_age,
+                    ok ? (int32_t)r->obs_counter : -1, len);
+    if(ok) {
+      relay_add_observer(r, &w->request.addr, w->request.port,
+                         w->request.token, w->request.token_len);
+    }
+    w->relay = NULL;
+  }
+
+  if(!ok) {
+    if(r->callback != NULL) {
+      /* Kept for the router: try again after the relay timeout */
+      r->state = RELAY_ACTIVE;
+      r->last_seen = clock_seconds();
+    } else {
+      r->state = RELAY_FREE;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sends due registrations; periodically also re-registers relays the mote
+   went silent on (reboot, route change) and releases unused ones. The
+   mote drops its observer on the RST to its next notification. Relays
+   whose values stopped coming over the mesh are registered the same way. */
+static void
+relay_check(uint8_t periodic)
+{
+  struct relay *r;
+  int i;
+  int j;
+
+  for(i = 0; i < COAP_PROXY_RELAYS; i++) {
+    r = &relays[i];
+    if(r->state == RELAY_FREE) {
+      continue;
+    }
+    if(periodic && !relay_has_clients(r)) {
+      r->state = RELAY_FREE;
+    } else if(r->state == RELAY_REGISTER) {
+      relay_register(r);
+    } else if(periodic && clock_seconds() - r->last_seen >=
+              (r->state == RELAY_REGISTERING ? RELAY_RETRY :
+               COAP_PROXY_RELAY_TIMEOUT)) {
+      if(r->state == RELAY_REGISTERING) {
+        /* Do not keep new clients waiting on a mote that is not answering;
+           they will ask again. */
+        for(j = 0; j < RELAY_WAITERS; j++) {
+          if(relay_waiters[j].relay == r) {
+            resume_upstream(&relay_waiters[j].request, GATEWAY_TIMEOUT_5_04,
+                            -1, 0, -1, 0);
+            relay_waiters[j].relay = NULL;
+          }
+        }
+      }
+      PRINTF("coap-proxy: registering again with ");
+      PRINT6ADDR(&r->mote);
+      PRINTF("\n");
+      relay_register(r);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+relay_subscribe(coap_packet_t *request, void *response, uint8_t *buffer,
+                const uip_ipaddr_t *mote, const char *path, int path_len)
+{
+  struct relay *r;
+  struct relay_waiter *w;
+  struct cache_entry *e;
+  int i;
+
+  r = relay_lookup(mote, path, path_len);
+  if(r == NULL) {
+    r = relay_new(mote, path, path_len);
+    if(r == NULL) {
+      REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+      return;
+    }
+    process_poll(&coap_proxy_process);
+  }
+
+  e = cache_lookup(mote, path, path_len);
+  if(r->state == RELAY_ACTIVE && e != NULL) {
+    if(relay_add_observer(r, &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
+                          request->token, request->token_len) == NULL) {
+      REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+      return;
+    }
+    coap_set_header_observe(response, r->obs_counter);
+    answer_from_cache(response, buffer, e);
+    return;
+  }
+
+  /* Wait for the first value from the mote */
+  for(i = 0, w = NULL; i < RELAY_WAITERS; i++) {
+    if(relay_waiters[i].relay == NULL) {
+      w = &relay_waiters[i];
+      break;
+    }
+  }
+  if(w == NULL) {
+    REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+    return;
+  }
+  w->relay = r;
+  coap_separate_accept(request, &w->request);
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_handler(void *request, void *response, uint8_t *buffer,
+             uint16_t preferred_size, int32_t *offset)
+{
+  coap_packet_t *const coap_req = (coap_packet_t *)request;
+  struct cache_entry *e;
+  struct pending *p;
+  uip_ipaddr_t mote;
+  uint32_t observe;
+  const char *url;
+  const char *path;
+  int url_len;
+  int path_len;
+  int i;
+
+  url_len = REST.get_url(request, &url);
+  if(!parse_url(url, url_len, &mote, &path, &path_len)) {
+    REST.set_response_status(response, REST.status.BAD_REQUEST);
+    return;
+  }
+
+  if(coap_req->code == COAP_GET && coap_get_header_observe(request, &observe)) {
+    if(observe == 0) {
+      relay_subscribe(coap_req, response, buffer, &mote, path, path_len);
+      return;
+    }
+    /* Deregistration, answered like a plain GET */
+    relay_remove_observer(&mote, path, path_len,
+                          &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport);
+  }
+
+  if(coap_req->code == COAP_GET) {
+    e = cache_lookup(&mote, path, path_len);
+    if(e != NULL) {
+      answer_from_cache(response, buffer, e);
+      return;
+    }
+    p = pending_lookup(&mote, path, path_len);
+    if(p != NULL) {
+      /* A retransmission of a request we already wait on takes its slot */
+      for(i = 0; i < p->waiting; i++) {
+        if(p->upstream[i].port == UIP_UDP_BUF->srcport &&
+           uip_ipaddr_cmp(&p->upstream[i].addr, &UIP_IP_BUF->srcipaddr) &&
+           p->upstream[i].token_len == coap_req->token_len &&
+           memcmp(p->upstream[i].token, coap_req->token,
+                  coap_req->token_len) == 0) {
+          break;
+        }
+      }
+      if(i == COAP_PROXY_WAITERS) {
+        REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+        return;
+      }
+      if(i == p->waiting) {
+        p->waiting++;
+        coap_proxy_stats.coalesced++;
+      }
+      coap_separate_accept(request, &p->upstream[i]);
+      return;
+    }
+  }
+
+  p = pending_new(coap_req, &mote, path, path_len);
+  if(p == NULL) {
+    REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+    return;
+  }
+  coap_separate_accept(request, &p->upstream[p->waiting++]);
+  /* uip_buf still holds the upstream request and the separate ACK built
+     from it: send to the mote once the engine is done with them. */
+  ctimer_set(&p->timer, 0, send_request, p);
+}
+/*---------------------------------------------------------------------------*/
+/* A mote rebooted or changed parent (fast-join.c of the thermostat): its
+   observations are registered again now rather than after the relay
+   timeout, and its cached responses are dropped. */
+void
+announce_handler(void *request, void *response, uint8_t *buffer,
+                 uint16_t preferred_size, int32_t *offset)
+{
+  const char *value;
+  uint32_t routable = 0;
+  int len;
+  int i;
+
+  len = REST.get_post_variable(request, "r", &value);
+  for(i = 0; i < len && value[i] >= '0' && value[i] <= '9'; i++) {
+    routable = routable * 10 + (value[i] - '0');
+  }
+  coap_proxy_stats.announces++;
+  coap_proxy_stats.last_routable = routable;
+  PRINTF("coap-proxy: announce from ");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF(", routable after %lu ms\n", (unsigned long)routable);
+
+  cache_invalidate(&UIP_IP_BUF->srcipaddr);
+  for(i = 0; i < COAP_PROXY_RELAYS; i++) {
+    if(relays[i].state != RELAY_FREE && !relays[i].fed &&
+       uip_ipaddr_cmp(&relays[i].mote, &UIP_IP_BUF->srcipaddr)) {
+      relays[i].state = RELAY_REGISTER;
+    }
+  }
+  process_poll(&coap_proxy_process);
+  REST.set_response_status(response, REST.status.CHANGED);
+}
+/*---------------------------------------------------------------------------*/
+static void
+mesh_input(void)
+{
+  coap_packet_t message[1];
+  coap_packet_t ack[1];
+  struct pending *p;
+  struct relay *r;
+  const uint8_t *payload;
+  uint8_t buf[4];
+  uint32_t max_age;
+  int content_format;
+  int len;
+  int i;
+
+  if(coap_parse_message(message, uip_appdata, uip_datalen()) != NO_ERROR) {
+    return;
+  }
+  if(message->token_len != 2) {
+    return;
+  }
+  for(i = 0, p = NULL; i < COAP_PROXY_PENDING; i++) {
+    if(pending[i].state != PENDING_FREE &&
+       memcmp(pending[i].token, message->token, 2) == 0) {
+      p = &pending[i];
+      break;
+    }
+  }
+  for(i = 0, r = NULL; p == NULL && i < COAP_PROXY_RELAYS; i++) {
+    if(relays[i].state != RELAY_FREE &&
+       memcmp(relays[i].token, message->token, 2) == 0) {
+      r = &relays[i];
+      break;
+    }
+  }
+
+#if COAP_PROXY_COCOA
+  if(p != NULL && message->type == COAP_TYPE_ACK &&
+     p->retransmissions <= COAP_MAX_RETRANSMIT) {
+    /* First answer to the request: an empty or piggybacked ACK */
+    coap_rto_measure(&p->mote, clock_time() - p->sent,
+                     p->retransmissions - 1);
+  }
+#endif
+  if(p != NULL && message->code == 0) {
+    if(message->type == COAP_TYPE_RST) {
+      finish(p, BAD_GATEWAY_5_02, -1, 0, 0);
+    } else if(message->type == COAP_TYPE_ACK) {
+      /* Empty ACK: a separate response will follow, stop retransmitting
+         and only wait for it until the exchange would have given up */
+      p->retransmissions = COAP_MAX_RETRANSMIT + 1;
+      ctimer_set(&p->timer, COAP_RESPONSE_TIMEOUT * CLOCK_SECOND *
+                 (1 << COAP_MAX_RETRANSMIT), send_request, p);
+    }
+    return;
+  }
+
+  /* Copy what is relayed before uip_buf is reused for sending. */
+  len = coap_get_payload(message, &payload);
+  if(len > (int)sizeof(response_payload)) {
+    len = sizeof(response_payload);
+  }
+  memcpy(response_payload, payload, len);
+  content_format = (int)coap_get_header_content_type(message);
+  max_age = COAP_DEFAULT_MAX_AGE;
+  coap_get_header_max_age(message, &max_age);
+
+  if(message->type == COAP_TYPE_CON ||
+     (message->type == COAP_TYPE_NON && p == NULL && r == NULL)) {
+    /* Acknowledge confirmable messages; reset unknown exchanges, such as
+       notifications of a relay that is no longer needed. */
+    coap_init_message(ack, p == NULL && r == NULL ? COAP_TYPE_RST :
+                      COAP_TYPE_ACK, 0, message->mid);
+    uip_udp_packet_sendto(mesh_conn, buf, coap_serialize_message(ack, buf),
+                          &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport);
+  }
+  if(r != NULL) {
+    if(message->code != 0) {
+      r->fed = 0;
+      relay_input(r, message, content_format, max_age, len);
+    }
+    return;
+  }
+  if(p == NULL) {
+    return;
+  }
+
+  if(p->method == COAP_GET) {
+    if(message->code == CONTENT_2_05) {
+      cache_store(&p->mote, p->path, max_age, content_format, len);
+    }
+  } else if(message->code < BAD_REQUEST_4_00) {
+    /* The mote changed state: its cached representations are stale */
+    cache_invalidate(&p->mote);
+  }
+  finish(p, message->code, content_format,
+         message->code == CONTENT_2_05 ? max_age : 0, len);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coap_proxy_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  mesh_conn = udp_new(NULL, 0, NULL);
+  udp_bind(mesh_conn, UIP_HTONS(COAP_PROXY_PORT));
+  etimer_set(&et, RELAY_CHECK_INTERVAL);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == tcpip_event && uip_newdata()) {
+      mesh_input();
+    } else if(ev == PROCESS_EVENT_POLL) {
+      relay_check(0);
+    } else if(ev == PROCESS_EVENT_TIMER && data == &et) {
+      relay_check(1);
+      etimer_reset(&et);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_proxy_observe(const uip_ipaddr_t *mote, const char *path,
+                   coap_proxy_callback_t callback)
+{
+  struct relay *r;
+  int len;
+
+  len = strlen(path);
+  if(len >= PATH_LEN) {
+    return 0;
+  }
+  r = relay_lookup(mote, path, len);
+  if(r == NULL) {
+    r = relay_new(mote, path, len);
+    if(r == NULL) {
+      return 0;
+    }
+    process_poll(&coap_proxy_process);
+  }
+  r->callback = callback;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_proxy_unobserve(const uip_ipaddr_t *mote, const char *path)
+{
+  struct relay *r;
+
+  r = relay_lookup(mote, path, strlen(path));
+  if(r != NULL) {
+    /* Released by the next check unless upstream clients still use it */
+    r->callback = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_proxy_deliver(const uip_ipaddr_t *mote, const char *path,
+                   const uint8_t *payload, uint8_t len, uint32_t max_age)
+{
+  coap_packet_t message[1];
+  struct relay *r;
+
+  r = relay_lookup(mote, path, strlen(path));
+  if(r == NULL) {
+    return 0;
+  }
+  if(!r->fed) {
+    /* The notifications of the observation registered with the mote get
+       a RST from now on, which ends it */
+    new_token(r->token);
+    r->fed = 1;
+  }
+  if(len > sizeof(response_payload)) {
+    len = sizeof(response_payload);
+  }
+  memcpy(response_payload, payload, len);
+  coap_init_message(message, COAP_TYPE_NON, CONTENT_2_05, 0);
+  coap_set_header_observe(message, 0);
+  relay_input(r, message, REST.type.TEXT_PLAIN, max_age, len);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_proxy_init(void)
+{
+  rest_activate_resource(&resource_mote);
+  rest_activate_resource(&resource_announce);
+  process_start(&coap_proxy_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
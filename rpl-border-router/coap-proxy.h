@@ -0,0 +1,93 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         CoAP proxy towards the motes, with a response cache
+ *
+ *         Upstream clients address a mote resource through the border
+ *         router as coap://[router]/m/<iid>/<path>, where <iid> is the
+ *         interface identifier of the mote under the mesh prefix, e.g.
+ *         /m/212:7402:2:202/status. GET responses are cached per mote and
+ *         path for their Max-Age, and concurrent GETs for the same
+ *         resource share a single request over the mesh.
+ *
+ *         An observe request on such a resource is relayed: the router
+ *         holds a single observation per mote resource and fans each
+ *         notification out to all upstream observers. The observation is
+ *         registered again when the mote goes silent, e.g. after a reboot
+ *         or a route change. The router itself can hold such observations
+ *         too, to get the values of the motes without an upstream client.
+ *
+ *         Thermostats built with WITH_FAST_JOIN=1 post /announce on the
+ *         DODAG ID after a reboot or a parent change, and their relays are
+ *         registered again right away.
+ */
+
+#ifndef __COAP_PROXY_H__
+#define __COAP_PROXY_H__
+
+#include "contiki.h"
+#include "net/uip.h"
+
+struct coap_proxy_stats {
+  uint16_t hits;          /* answered from the cache */
+  uint16_t coalesced;     /* joined a request already on its way */
+  uint16_t requests;      /* requests sent over the mesh */
+  uint16_t timeouts;      /* requests the mote never answered */
+  uint16_t retransmissions; /* of requests to the motes */
+  uint16_t registrations; /* observe registrations sent to motes */
+  uint16_t notifications; /* notifications sent upstream */
+  uint16_t announces;     /* motes that joined or changed parent */
+  uint32_t last_routable; /* ms from boot to routable of the last one */
+};
+
+extern struct coap_proxy_stats coap_proxy_stats;
+
+/* Called with each value of a resource the router observes */
+typedef void (*coap_proxy_callback_t)(const uip_ipaddr_t *mote,
+                                      const char *path,
+                                      const uint8_t *payload, uint8_t len);
+
+/* Activates the proxy resource; the REST engine must be running. */
+void coap_proxy_init(void);
+
+/* Keeps an observation of a mote resource for the router, shared with
+   upstream observers of the same resource. Returns 0 if all relays are
+   in use. */
+int coap_proxy_observe(const uip_ipaddr_t *mote, const char *path,
+                       coap_proxy_callback_t callback);
+void coap_proxy_unobserve(const uip_ipaddr_t *mote, const char *path);
+
+/* A value of a mote resource that reached the router by other means than
+   a notification, e.g. aggregated over the mesh; handled as one. Returns
+   0 if nobody observes the resource. */
+int coap_proxy_deliver(const uip_ipaddr_t *mote, const char *path,
+                       const uint8_t *payload, uint8_t len, uint32_t max_age);
+
+#endif /* __COAP_PROXY_H__ */
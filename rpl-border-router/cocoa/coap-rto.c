@@ -0,0 +1,213 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Retransmission timeouts per peer, after CoCoA
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "coap-rto.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* RTOs are kept within these, in ms */
+#ifdef COAP_RTO_CONF_MIN
+#define COAP_RTO_MIN COAP_RTO_CONF_MIN
+#else
+#define COAP_RTO_MIN 250
+#endif
+#define COAP_RTO_MAX 32000
+
+/* Longest single timeout, well within the 16-bit clock */
+#define TIMEOUT_MAX (60 * CLOCK_SECOND)
+
+/* Weak estimates only from exchanges with at most this many
+   retransmissions: later ones cannot tell which transmission was
+   answered. */
+#define WEAK_RETRANSMISSIONS 2
+
+struct coap_rto_peer coap_rto_peers[COAP_RTO_PEERS];
+
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+to_ticks(uint16_t ms)
+{
+  return (clock_time_t)((uint32_t)ms * CLOCK_SECOND / 1000);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+to_ms(clock_time_t ticks)
+{
+  uint32_t ms;
+
+  ms = (uint32_t)ticks * 1000 / CLOCK_SECOND;
+  return ms > 0xffff ? 0xffff : ms;
+}
+/*---------------------------------------------------------------------------*/
+/* An RTO without new estimates goes back towards the default: a short one
+   after 16 RTOs, a long one after 4. */
+static void
+age(struct coap_rto_peer *p, uint16_t now)
+{
+  uint16_t idle;
+
+  idle = now - p->updated;
+  if(p->rto < 1000 && idle > 16 * (uint32_t)p->rto / 1000) {
+    p->rto = p->rto * 2 > COAP_RTO_DEFAULT ? COAP_RTO_DEFAULT : p->rto * 2;
+    p->updated = now;
+  } else if(p->rto > 3000 && idle > 4 * (uint32_t)p->rto / 1000) {
+    p->rto = (COAP_RTO_DEFAULT + p->rto) / 2;
+    p->updated = now;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static struct coap_rto_peer *
+lookup(const uip_ipaddr_t *addr)
+{
+  struct coap_rto_peer *p;
+  struct coap_rto_peer *oldest = NULL;
+  uint16_t now;
+  int i;
+
+  now = clock_seconds();
+  for(i = 0; i < COAP_RTO_PEERS; i++) {
+    p = &coap_rto_peers[i];
+    if(p->rto != 0 && uip_ipaddr_cmp(&p->addr, addr)) {
+      age(p, now);
+      p->used = now;
+      return p;
+    }
+    if(oldest == NULL || p->rto == 0 ||
+       (oldest->rto != 0 && (uint16_t)(now - p->used) >
+        (uint16_t)(now - oldest->used))) {
+      oldest = p;
+    }
+  }
+  p = oldest;
+  memset(p, 0, sizeof(struct coap_rto_peer));
+  uip_ipaddr_copy(&p->addr, addr);
+  p->rto = COAP_RTO_DEFAULT;
+  p->updated = now;
+  p->used = now;
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+/* RFC 6298 with gains 1/8 and 1/4; returns SRTT + k RTTVAR */
+static uint32_t
+estimate(uint16_t *srtt, uint16_t *rttvar, uint16_t rtt, uint8_t k)
+{
+  uint16_t diff;
+
+  if(*srtt == 0) {
+    *srtt = rtt > 0 ? rtt : 1;
+    *rttvar = rtt / 2;
+  } else {
+    diff = *srtt > rtt ? *srtt - rtt : rtt - *srtt;
+    *rttvar = ((uint32_t)*rttvar * 3 + diff) / 4;
+    *srtt = ((uint32_t)*srtt * 7 + rtt) / 8;
+  }
+  return *srtt + (uint32_t)k * *rttvar;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+coap_rto_start(const uip_ipaddr_t *peer)
+{
+  struct coap_rto_peer *p;
+  uint16_t rto;
+
+  p = lookup(peer);
+  p->exchanges++;
+  /* Between RTO and 1.5 RTO, so that peers sharing a loss do not
+     retransmit together */
+  rto = p->rto + random_rand() % (p->rto / 2 + 1);
+  return to_ticks(rto);
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+coap_rto_backoff(const uip_ipaddr_t *peer, clock_time_t timeout)
+{
+  struct coap_rto_peer *p;
+  uint32_t next;
+
+  p = lookup(peer);
+  p->retransmissions++;
+  if(p->rto < 1000) {
+    next = (uint32_t)timeout * 3;
+  } else if(p->rto > 3000) {
+    next = (uint32_t)timeout * 3 / 2;
+  } else {
+    next = (uint32_t)timeout * 2;
+  }
+  return next > TIMEOUT_MAX ? TIMEOUT_MAX : next;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_rto_measure(const uip_ipaddr_t *peer, clock_time_t rtt,
+                 uint8_t retransmissions)
+{
+  struct coap_rto_peer *p;
+  uint32_t rto;
+  uint16_t ms;
+
+  if(retransmissions > WEAK_RETRANSMISSIONS) {
+    return;
+  }
+  p = lookup(peer);
+  ms = to_ms(rtt);
+  p->rtt = ms;
+  if(retransmissions == 0) {
+    rto = estimate(&p->strong_srtt, &p->strong_rttvar, ms, 4);
+    rto = (rto + p->rto) / 2;
+  } else {
+    rto = estimate(&p->weak_srtt, &p->weak_rttvar, ms, 1);
+    rto = (rto + 3 * (uint32_t)p->rto) / 4;
+  }
+  if(rto < COAP_RTO_MIN) {
+    rto = COAP_RTO_MIN;
+  } else if(rto > COAP_RTO_MAX) {
+    rto = COAP_RTO_MAX;
+  }
+  p->rto = rto;
+  p->updated = clock_seconds();
+  PRINTF("coap-rto: ");
+  PRINT6ADDR(peer);
+  PRINTF(" RTT %u ms (%s), RTO %u ms\n", ms,
+         retransmissions == 0 ? "strong" : "weak", p->rto);
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_rto_giveup(const uip_ipaddr_t *peer)
+{
+  lookup(peer)->giveups++;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,95 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Retransmission timeouts per peer, after CoCoA
+ *
+ *         Each peer has its own RTO, started at 2 s and fed by two
+ *         estimators in the manner of RFC 6298: the strong one with RTTs
+ *         of exchanges answered without retransmission, the weak one with
+ *         those answered after one or two retransmissions, measured from
+ *         the first transmission. A strong estimate moves the RTO halfway
+ *         towards it, a weak one a quarter of the way. The first timeout
+ *         of an exchange is drawn between RTO and 1.5 RTO, and the next
+ *         ones back off by 3 for an RTO below 1 s, by 1.5 above 3 s and by
+ *         2 in between. An RTO left without new estimates drifts back
+ *         towards the default.
+ *
+ *         The proxy of the border router times its requests to the motes
+ *         with it, and the thermostats their own confirmable messages
+ *         (../smart-thermostat/cocoa).
+ */
+
+#ifndef __COAP_RTO_H__
+#define __COAP_RTO_H__
+
+#include "contiki.h"
+#include "net/uip.h"
+
+/* Peers remembered, the least recently used one is replaced */
+#ifdef COAP_RTO_CONF_PEERS
+#define COAP_RTO_PEERS COAP_RTO_CONF_PEERS
+#else
+#define COAP_RTO_PEERS 6
+#endif
+
+#define COAP_RTO_DEFAULT 2000     /* ms */
+
+struct coap_rto_peer {
+  uip_ipaddr_t addr;
+  uint16_t rto;                 /* ms, 0 if the entry is unused */
+  uint16_t strong_srtt;         /* ms, 0 before the first estimate */
+  uint16_t strong_rttvar;
+  uint16_t weak_srtt;
+  uint16_t weak_rttvar;
+  uint16_t rtt;                 /* last measured */
+  uint16_t updated;             /* clock_seconds() of the last estimate */
+  uint16_t used;                /* and of the last exchange */
+  uint16_t exchanges;
+  uint16_t retransmissions;
+  uint16_t giveups;
+};
+
+extern struct coap_rto_peer coap_rto_peers[COAP_RTO_PEERS];
+
+/* First timeout of a new exchange with peer */
+clock_time_t coap_rto_start(const uip_ipaddr_t *peer);
+
+/* Timeout after a retransmission, the previous one being timeout */
+clock_time_t coap_rto_backoff(const uip_ipaddr_t *peer, clock_time_t timeout);
+
+/* An answer came rtt after the first transmission, itself followed by
+   retransmissions more */
+void coap_rto_measure(const uip_ipaddr_t *peer, clock_time_t rtt,
+                      uint8_t retransmissions);
+
+/* The exchange was abandoned */
+void coap_rto_giveup(const uip_ipaddr_t *peer);
+
+#endif /* __COAP_RTO_H__ */
@@ -115,7 +115,7 @@ PT_THREAD(send_headers(struct httpd_state *s, const char *statushdr))
   /*   s->ptr = http_content_type_binary; */
   /* } */
   /* SEND_STRING(&s->sout, s->ptr); */
-  SEND_STRING(&s->sout, http_content_type_html);
+  SEND_STRING(&s->sout, httpd_simple_get_content_type(&s->filename[1]));
   PSOCK_END(&s->sout);
 }
 /*---------------------------------------------------------------------------*/
@@ -68,6 +68,8 @@ void httpd_init(void);
 void httpd_appcall(void *state);
 
 httpd_simple_script_t httpd_simple_get_script(const char *name);
+/* Content-type header, with the empty line ending the headers */
+const char *httpd_simple_get_content_type(const char *name);
 
 #define SEND_STRING(s, str) PSOCK_SEND(s, (uint8_t *)str, strlen(str))
 
@@ -0,0 +1,197 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Aggregation of temperature readings on the way up the DODAG
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "mesh-agg.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+struct mesh_agg_stats mesh_agg_stats;
+
+static struct uip_udp_conn *conn;
+static struct ctimer window_timer;
+static uint8_t held[MESH_AGG_READINGS][MESH_AGG_READING_LEN];
+static uint8_t count;
+static uint8_t seq;
+static uint8_t packet[MESH_AGG_HEADER_LEN +
+                      MESH_AGG_READINGS * MESH_AGG_READING_LEN];
+
+PROCESS(mesh_agg_process, "Mesh aggregation");
+
+/*---------------------------------------------------------------------------*/
+static void
+flush(void)
+{
+  uip_ipaddr_t *parent;
+  int len;
+
+  ctimer_stop(&window_timer);
+  if(count == 0) {
+    return;
+  }
+  /* The default route is the preferred parent */
+  parent = uip_ds6_defrt_choose();
+  if(parent == NULL) {
+    mesh_agg_stats.dropped += count;
+    count = 0;
+    return;
+  }
+  packet[0] = MESH_AGG_VERSION;
+  packet[1] = count;
+  len = count * MESH_AGG_READING_LEN;
+  memcpy(&packet[MESH_AGG_HEADER_LEN], held, len);
+  PRINTF("mesh-agg: %u readings to ", count);
+  PRINT6ADDR(parent);
+  PRINTF("\n");
+  uip_udp_packet_sendto(conn, packet, MESH_AGG_HEADER_LEN + len, parent,
+                        UIP_HTONS(MESH_AGG_PORT));
+  mesh_agg_stats.packets++;
+  mesh_agg_stats.readings += count;
+  count = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+window_expired(void *ptr)
+{
+  flush();
+}
+/*---------------------------------------------------------------------------*/
+static void
+hold(const uint8_t *reading)
+{
+  uint8_t *h;
+  int i;
+
+  for(i = 0; i < count; i++) {
+    h = held[i];
+    if(memcmp(&h[MESH_AGG_IID], &reading[MESH_AGG_IID], 8) == 0) {
+      /* Keep the newer of the two */
+      if((int8_t)(reading[MESH_AGG_SEQ] - h[MESH_AGG_SEQ]) > 0) {
+        memcpy(h, reading, MESH_AGG_READING_LEN);
+      }
+      mesh_agg_stats.replaced++;
+      return;
+    }
+  }
+  if(count == MESH_AGG_READINGS) {
+    flush();
+  }
+  memcpy(held[count], reading, MESH_AGG_READING_LEN);
+  if(count++ == 0) {
+    /* The window does not move: the first reading waits the longest */
+    ctimer_set(&window_timer, MESH_AGG_WINDOW, window_expired, NULL);
+  }
+  if(count == MESH_AGG_READINGS) {
+    flush();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+  uint8_t data[sizeof(packet)];
+  uint8_t *reading;
+  uint8_t n;
+  int i;
+
+  /* Copied out: a full window is sent from uip_buf meanwhile */
+  if(uip_datalen() < MESH_AGG_HEADER_LEN || uip_datalen() > sizeof(data)) {
+    return;
+  }
+  memcpy(data, uip_appdata, uip_datalen());
+  n = data[1];
+  if(data[0] != MESH_AGG_VERSION ||
+     uip_datalen() != MESH_AGG_HEADER_LEN + n * MESH_AGG_READING_LEN) {
+    return;
+  }
+  for(i = 0; i < n; i++) {
+    reading = &data[MESH_AGG_HEADER_LEN + i * MESH_AGG_READING_LEN];
+    mesh_agg_stats.received++;
+    if(++reading[MESH_AGG_HOPS] > MESH_AGG_MAX_HOPS) {
+      mesh_agg_stats.dropped++;
+      continue;
+    }
+    hold(reading);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mesh_agg_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  conn = udp_new(NULL, 0, NULL);
+  udp_bind(conn, UIP_HTONS(MESH_AGG_PORT));
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == tcpip_event && uip_newdata()) {
+      input();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+mesh_agg_init(void)
+{
+  process_start(&mesh_agg_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+mesh_agg_report(uint16_t temp, uint8_t max_age)
+{
+  uint8_t reading[MESH_AGG_READING_LEN];
+  uip_ds6_addr_t *lladdr;
+
+  lladdr = uip_ds6_get_link_local(-1);
+  if(conn == NULL || lladdr == NULL) {
+    return;
+  }
+  memcpy(&reading[MESH_AGG_IID], &lladdr->ipaddr.u8[8], 8);
+  reading[MESH_AGG_SEQ] = ++seq;
+  reading[MESH_AGG_HOPS] = 0;
+  reading[MESH_AGG_MAX_AGE] = max_age;
+  reading[MESH_AGG_TEMP] = temp >> 8;
+  reading[MESH_AGG_TEMP + 1] = temp & 0xff;
+  hold(reading);
+  if(uip_ds6_route_head() == NULL) {
+    /* No children: nothing to wait for */
+    flush();
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,105 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Aggregation of temperature readings on the way up the DODAG
+ *
+ *         Each thermostat sends its reading once per period to its
+ *         preferred parent instead of through the border router's
+ *         observation. A parent holds the readings of its subtree for at
+ *         most MESH_AGG_WINDOW, merges them with its own and sends them on
+ *         in one packet, so that near the root there is one frame per
+ *         window and child of the root instead of one per room. The border
+ *         router unpacks them into notifications of the motes' resources
+ *         (../br-mesh-agg.c). A mote without children sends its reading
+ *         right away.
+ *
+ *         Packets are UDP between link-local neighbours, on MESH_AGG_PORT:
+ *         a version byte, the count, then per reading the interface
+ *         identifier of the mote, its sequence number, the hops travelled,
+ *         the Max-Age and the temperature. A newer reading of a mote
+ *         replaces an older one still held.
+ *
+ *         Built by the thermostats when the directory is added to
+ *         PROJECTDIRS (make WITH_MESH_AGG=1); the border router only uses
+ *         the format.
+ */
+
+#ifndef __MESH_AGG_H__
+#define __MESH_AGG_H__
+
+#include "contiki.h"
+
+#define MESH_AGG_PORT    61621
+#define MESH_AGG_VERSION 1
+
+/* Readings held and sent in one packet, 13 bytes each: a packet must fit
+   one 802.15.4 frame with compressed link-local headers. */
+#ifdef MESH_AGG_CONF_READINGS
+#define MESH_AGG_READINGS MESH_AGG_CONF_READINGS
+#else
+#define MESH_AGG_READINGS 5
+#endif
+
+/* Longest a reading waits at each hop for others to share the packet */
+#ifdef MESH_AGG_CONF_WINDOW
+#define MESH_AGG_WINDOW MESH_AGG_CONF_WINDOW
+#else
+#define MESH_AGG_WINDOW CLOCK_SECOND
+#endif
+
+/* Readings that travelled this far are dropped: a routing loop */
+#define MESH_AGG_MAX_HOPS 16
+
+#define MESH_AGG_HEADER_LEN  2     /* version, count */
+#define MESH_AGG_READING_LEN 13
+/* Offsets in a reading; the temperature is big-endian */
+#define MESH_AGG_IID     0
+#define MESH_AGG_SEQ     8
+#define MESH_AGG_HOPS    9
+#define MESH_AGG_MAX_AGE 10
+#define MESH_AGG_TEMP    11
+
+struct mesh_agg_stats {
+  uint16_t packets;       /* sent to the parent */
+  uint16_t readings;      /* sent to the parent, own included */
+  uint16_t received;      /* readings from children */
+  uint16_t replaced;      /* older readings of a mote dropped for newer */
+  uint16_t dropped;       /* no parent, no room or looping */
+};
+
+extern struct mesh_agg_stats mesh_agg_stats;
+
+/* Starts listening for the readings of the children */
+void mesh_agg_init(void);
+
+/* Own reading of the period */
+void mesh_agg_report(uint16_t temp, uint8_t max_age);
+
+#endif /* __MESH_AGG_H__ */
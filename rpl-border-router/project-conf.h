@@ -51,4 +51,125 @@
 #define WEBSERVER_CONF_CFS_CONNS 2
 #endif
 
+/* Keep prefix and DODAG configuration in Coffee to restart the DAG
+   without waiting for the host. Enabled from the Makefile (WITH_PERSIST). */
+#ifndef BR_CONF_PERSIST
+#define BR_CONF_PERSIST 0
+#endif
+
+/* Header-compressed framing on the SLIP link, negotiated by the host with
+   "?H". Enabled from the Makefile (WITH_SLIP_HC). */
+#ifndef SLIP_BRIDGE_CONF_HC
+#define SLIP_BRIDGE_CONF_HC 0
+#endif
+
+/* Receive SLIP frames into a byte ring that holds several of them, instead
+   of the single frame buffer of slip.c. Enabled from the Makefile
+   (WITH_SLIP_RX_POOL). */
+#ifndef SLIP_BRIDGE_CONF_RX_POOL
+#define SLIP_BRIDGE_CONF_RX_POOL 0
+#endif
+
+/* Forward commands from the host before queued telemetry, and hold the
+   telemetry while the radio queue is nearly full. Needs the receive ring.
+   Enabled from the Makefile (WITH_PRIORITY). */
+#ifndef SLIP_BRIDGE_CONF_PRIORITY
+#define SLIP_BRIDGE_CONF_PRIORITY 0
+#endif
+
+/* Request DAOs or start a new DODAG version when routes go missing.
+   Enabled from the Makefile (WITH_AUTO_REPAIR). */
+#ifndef BR_CONF_AUTO_REPAIR
+#define BR_CONF_AUTO_REPAIR 0
+#endif
+
+/* Count packets per mote on the SLIP link. Enabled from the Makefile
+   (WITH_TRAFFIC). */
+#ifndef BR_CONF_TRAFFIC
+#define BR_CONF_TRAFFIC 0
+#endif
+
+/* House and room temperature aggregates on the CoAP proxy. Enabled from
+   the Makefile (WITH_AGGREGATE). */
+#ifndef BR_CONF_AGGREGATE
+#define BR_CONF_AGGREGATE 0
+#endif
+
+/* Readings aggregated over the mesh, handed to the CoAP proxy. Enabled
+   from the Makefile (WITH_MESH_AGG). */
+#ifndef BR_CONF_MESH_AGG
+#define BR_CONF_MESH_AGG 0
+#endif
+#if BR_CONF_MESH_AGG
+#define COAP_PROXY_CONF_FED_PATH "temperature"
+#endif
+
+/* Notification slots sent to the thermostats. Enabled from the Makefile
+   (WITH_SLOTS). */
+#ifndef BR_CONF_SLOTS
+#define BR_CONF_SLOTS 0
+#endif
+
+/* Resource directory for the thermostats on the CoAP engine. Enabled from
+   the Makefile (WITH_RD). */
+#ifndef BR_CONF_RD
+#define BR_CONF_RD 0
+#endif
+
+/* Several border routers on one mesh, see br-multi.h. Enabled from the
+   Makefile (WITH_MULTI_BR), which also sets the router number and the
+   DODAG preference. */
+#ifndef BR_CONF_MULTI
+#define BR_CONF_MULTI 0
+#endif
+#ifndef BR_CONF_ID
+#define BR_CONF_ID 0
+#endif
+#ifndef BR_CONF_PREFERENCE
+#define BR_CONF_PREFERENCE 0
+#endif
+
+/* Packet trace at http://[router]/dump. Enabled from the Makefile
+   (WITH_TRACE). The radio side is seen through drivers wrapping the
+   configured ones (see br-trace.c). */
+#ifndef BR_CONF_TRACE
+#define BR_CONF_TRACE 0
+#endif
+#if BR_CONF_TRACE
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC     br_trace_mac_driver
+#undef NETSTACK_CONF_NETWORK
+#define NETSTACK_CONF_NETWORK br_trace_network_driver
+#endif
+
+/* Routes kept by the compact route store (WITH_ROUTE_STORE) */
+#ifndef ROUTE_STORE_CONF_ROUTES
+#define ROUTE_STORE_CONF_ROUTES 100
+#endif
+
+#if WITH_COAP
+/* Erbium on the border router, sized like on the motes */
+#ifndef REST_MAX_CHUNK_SIZE
+#define REST_MAX_CHUNK_SIZE 64
+#endif
+#ifndef COAP_MAX_OPEN_TRANSACTIONS
+#define COAP_MAX_OPEN_TRANSACTIONS 4
+#endif
+#if BR_CONF_AGGREGATE
+/* Rooms of the aggregates: as many thermostats as the 10 routes they
+   keep, smart-thermostat-simulation's included */
+#ifndef BR_AGGREGATE_CONF_ROOMS
+#define BR_AGGREGATE_CONF_ROOMS 10
+#endif
+/* One relay per room for the aggregates, two left for upstream clients */
+#ifndef COAP_PROXY_CONF_RELAYS
+#define COAP_PROXY_CONF_RELAYS (BR_AGGREGATE_CONF_ROOMS + 2)
+#endif
+/* One directory registration per room */
+#ifndef BR_RD_CONF_ENDPOINTS
+#define BR_RD_CONF_ENDPOINTS BR_AGGREGATE_CONF_ROOMS
+#endif
+#endif
+#endif /* WITH_COAP */
+
 #endif /* __PROJECT_ROUTER_CONF_H__ */
@@ -0,0 +1,64 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Compact replacement for the uIP routing table
+ *
+ *         Built instead of core/net/uip-ds6-route.c when the directory is
+ *         added to PROJECTDIRS (make WITH_ROUTE_STORE=1).
+ */
+
+#ifndef __ROUTE_STORE_H__
+#define __ROUTE_STORE_H__
+
+#include "net/uip.h"
+
+/* Number of /128 routes under the node's /64 prefix */
+#ifdef ROUTE_STORE_CONF_ROUTES
+#define ROUTE_STORE_ROUTES ROUTE_STORE_CONF_ROUTES
+#else
+#define ROUTE_STORE_ROUTES 100
+#endif
+
+struct route_store_stats {
+  uint16_t peak;        /* most routes held at once */
+  uint16_t evicted;     /* live routes dropped to make room */
+  uint16_t rejected;    /* not a /128 under the prefix, or no room */
+};
+
+extern struct route_store_stats route_store_stats;
+
+/**
+ * Set the /64 prefix all routes live under. Routes learned under a
+ * previous prefix are removed. Without a call, the prefix of the first
+ * route added is used.
+ */
+void route_store_set_prefix(const uip_ipaddr_t *prefix);
+
+#endif /* __ROUTE_STORE_H__ */
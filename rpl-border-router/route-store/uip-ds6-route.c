@@ -0,0 +1,666 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Routing table kept as interface identifiers under a single /64
+ *         prefix, with hashed lookup and second-chance (approximate LRU)
+ *         eviction. It implements the uip-ds6-route.h interface so that
+ *         RPL and tcpip use it unchanged.
+ *
+ *         A route takes 16 bytes instead of the 30 of a uip_ds6_route_t.
+ *         Callers still get uip_ds6_route_t pointers: routes are expanded
+ *         on demand into a few views, which are written back to the table
+ *         when they are reused. A pointer stays valid until
+ *         ROUTE_STORE_VIEWS other routes have been looked at, which covers
+ *         how RPL and tcpip use them.
+ */
+
+#include "net/uip-ds6.h"
+#include "net/uip.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "net/nbr-table.h"
+#include "route-store.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if !UIP_CONF_IPV6_RPL
+#error "The route store keeps RPL route state, build with RPL"
+#endif
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if ROUTE_STORE_ROUTES > 254
+#error "ROUTE_STORE_CONF_ROUTES must be below 255"
+#endif
+
+/* Hash buckets, a power of two */
+#ifdef ROUTE_STORE_CONF_BUCKETS
+#define ROUTE_STORE_BUCKETS ROUTE_STORE_CONF_BUCKETS
+#else
+#define ROUTE_STORE_BUCKETS 32
+#endif
+
+/* Routes expanded to uip_ds6_route_t at the same time */
+#ifdef ROUTE_STORE_CONF_VIEWS
+#define ROUTE_STORE_VIEWS ROUTE_STORE_CONF_VIEWS
+#else
+#define ROUTE_STORE_VIEWS 4
+#endif
+
+#define NONE 0xff
+
+/* Lifetimes are kept in seconds; longer ones than this never expire */
+#define LIFETIME_INFINITE 0xffff
+
+#define FLAG_LEARNED_FROM 0x03
+#define FLAG_NOPATH       0x04
+#define FLAG_REFERENCED   0x08
+
+struct nexthop {
+  uint8_t routes;
+};
+
+struct route {
+  uint8_t iid[8];
+  struct nexthop *nexthop;   /* NULL when free */
+  void *dag;
+  uint16_t lifetime;
+  uint8_t next;              /* hash chain, or free list */
+  uint8_t flags;
+};
+
+struct view {
+  uip_ds6_route_t route;
+  uint8_t index;
+};
+
+struct route_store_stats route_store_stats;
+
+/* Next hops are neighbors: keep them in the neighbor table so that their
+   routes go away with them. */
+NBR_TABLE(struct nexthop, nexthops);
+
+static struct route routes[ROUTE_STORE_ROUTES];
+static uint8_t buckets[ROUTE_STORE_BUCKETS];
+static uint8_t free_head;
+static uint8_t hand;
+static struct view views[ROUTE_STORE_VIEWS];
+static uint8_t view_next;
+static uip_ipaddr_t prefix;
+static uint8_t prefix_set;
+static int num_routes;
+
+LIST(defaultrouterlist);
+MEMB(defaultroutermemb, uip_ds6_defrt_t, UIP_DS6_DEFRT_NB);
+
+LIST(notificationlist);
+
+static void rm_nexthop_callback(nbr_table_item_t *ptr);
+/*---------------------------------------------------------------------------*/
+static void
+call_route_callback(int event, uip_ipaddr_t *route,
+                    uip_ipaddr_t *nexthop)
+{
+  int num;
+  struct uip_ds6_notification *n;
+
+  for(n = list_head(notificationlist);
+      n != NULL;
+      n = list_item_next(n)) {
+    if(event == UIP_DS6_NOTIFICATION_DEFRT_ADD ||
+       event == UIP_DS6_NOTIFICATION_DEFRT_RM) {
+      num = list_length(defaultrouterlist);
+    } else {
+      num = num_routes;
+    }
+    n->callback(event, route, nexthop, num);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_notification_add(struct uip_ds6_notification *n,
+                         uip_ds6_notification_callback c)
+{
+  if(n != NULL && c != NULL) {
+    n->callback = c;
+    list_add(notificationlist, n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_notification_rm(struct uip_ds6_notification *n)
+{
+  list_remove(notificationlist, n);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+hash(const uint8_t *iid)
+{
+  uint8_t h;
+  uint8_t i;
+
+  h = 0;
+  for(i = 0; i < 8; i++) {
+    h = (h * 31) + iid[i];
+  }
+  return h & (ROUTE_STORE_BUCKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+find(const uip_ipaddr_t *ipaddr)
+{
+  uint8_t i;
+
+  for(i = buckets[hash(&ipaddr->u8[8])]; i != NONE; i = routes[i].next) {
+    if(memcmp(routes[i].iid, &ipaddr->u8[8], 8) == 0) {
+      return i;
+    }
+  }
+  return NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_back(struct view *v)
+{
+  struct route *e;
+
+  e = &routes[v->index];
+  e->dag = v->route.state.dag;
+  e->lifetime = v->route.state.lifetime >= LIFETIME_INFINITE ?
+    LIFETIME_INFINITE : v->route.state.lifetime;
+  e->flags = (e->flags & FLAG_REFERENCED) |
+    (v->route.state.learned_from & FLAG_LEARNED_FROM) |
+    (v->route.state.nopath_received ? FLAG_NOPATH : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+sync_views(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < ROUTE_STORE_VIEWS; i++) {
+    if(views[i].index != NONE) {
+      write_back(&views[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+unbind(uint8_t index)
+{
+  uint8_t i;
+
+  for(i = 0; i < ROUTE_STORE_VIEWS; i++) {
+    if(views[i].index == index) {
+      views[i].index = NONE;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+view(uint8_t index)
+{
+  struct view *v;
+  struct route *e;
+  uint8_t i;
+
+  for(i = 0; i < ROUTE_STORE_VIEWS; i++) {
+    if(views[i].index == index) {
+      return &views[i].route;
+    }
+  }
+
+  v = &views[view_next];
+  view_next = (view_next + 1) % ROUTE_STORE_VIEWS;
+  if(v->index != NONE) {
+    write_back(v);
+  }
+
+  e = &routes[index];
+  v->index = index;
+  memcpy(&v->route.ipaddr, &prefix, 8);
+  memcpy(&v->route.ipaddr.u8[8], e->iid, 8);
+  v->route.length = 128;
+  v->route.state.dag = e->dag;
+  v->route.state.lifetime = e->lifetime == LIFETIME_INFINITE ?
+    0xffffffff : e->lifetime;
+  v->route.state.learned_from = e->flags & FLAG_LEARNED_FROM;
+  v->route.state.nopath_received = (e->flags & FLAG_NOPATH) != 0;
+  return &v->route;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ipaddr_t *
+nexthop_ipaddr(struct nexthop *n)
+{
+  return uip_ds6_nbr_ipaddr_from_lladdr(
+      (uip_lladdr_t *)nbr_table_get_lladdr(nexthops, n));
+}
+/*---------------------------------------------------------------------------*/
+static void
+release_nexthop(struct nexthop *n)
+{
+  if(--n->routes == 0) {
+    nbr_table_remove(nexthops, n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+rm_index(uint8_t index)
+{
+  struct route *e;
+  uint8_t *link;
+  uip_ipaddr_t ipaddr;
+  struct nexthop *n;
+
+  e = &routes[index];
+  for(link = &buckets[hash(e->iid)]; *link != NONE;
+      link = &routes[*link].next) {
+    if(*link == index) {
+      *link = e->next;
+      break;
+    }
+  }
+  unbind(index);
+
+  memcpy(&ipaddr, &prefix, 8);
+  memcpy(&ipaddr.u8[8], e->iid, 8);
+  n = e->nexthop;
+  e->nexthop = NULL;
+  e->next = free_head;
+  free_head = index;
+  num_routes--;
+
+  PRINTF("route-store: removed ");
+  PRINT6ADDR(&ipaddr);
+  PRINTF(", %u left\n", num_routes);
+
+  call_route_callback(UIP_DS6_NOTIFICATION_ROUTE_RM, &ipaddr,
+                      nexthop_ipaddr(n));
+  release_nexthop(n);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rm_nexthop(struct nexthop *n)
+{
+  uint8_t i;
+
+  for(i = 0; i < ROUTE_STORE_ROUTES && n->routes > 0; i++) {
+    if(routes[i].nexthop == n) {
+      /* The last removal may free the neighbor table entry */
+      if(n->routes == 1) {
+        rm_index(i);
+        return;
+      }
+      rm_index(i);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+rm_nexthop_callback(nbr_table_item_t *ptr)
+{
+  rm_nexthop((struct nexthop *)ptr);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+evict(void)
+{
+  uint8_t tries;
+  uint8_t victim;
+
+  /* Second chance: routes used for forwarding since the hand last
+     passed are skipped once. */
+  sync_views();
+  for(tries = 0; tries < 2 * ROUTE_STORE_ROUTES; tries++) {
+    victim = hand;
+    hand = (hand + 1) % ROUTE_STORE_ROUTES;
+    if(routes[victim].flags & FLAG_REFERENCED) {
+      routes[victim].flags &= ~FLAG_REFERENCED;
+    } else {
+      break;
+    }
+  }
+  rm_index(victim);
+  route_store_stats.evicted++;
+  PRINTF("route-store: evicted, %u evicted so far\n",
+         route_store_stats.evicted);
+  return free_head;
+}
+/*---------------------------------------------------------------------------*/
+void
+route_store_set_prefix(const uip_ipaddr_t *new_prefix)
+{
+  uint8_t i;
+
+  if(prefix_set && uip_ipaddr_prefixcmp(&prefix, new_prefix, 64)) {
+    return;
+  }
+  for(i = 0; i < ROUTE_STORE_ROUTES; i++) {
+    if(routes[i].nexthop != NULL) {
+      rm_index(i);
+    }
+  }
+  memcpy(&prefix, new_prefix, 8);
+  prefix_set = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_init(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < ROUTE_STORE_ROUTES; i++) {
+    routes[i].nexthop = NULL;
+    routes[i].next = i + 1 < ROUTE_STORE_ROUTES ? i + 1 : NONE;
+  }
+  free_head = 0;
+  memset(buckets, NONE, sizeof(buckets));
+  for(i = 0; i < ROUTE_STORE_VIEWS; i++) {
+    views[i].index = NONE;
+  }
+  nbr_table_register(nexthops, (nbr_table_callback *)rm_nexthop_callback);
+
+  memb_init(&defaultroutermemb);
+  list_init(defaultrouterlist);
+  list_init(notificationlist);
+}
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+uip_ds6_route_nexthop(uip_ds6_route_t *route)
+{
+  if(route != NULL && ((struct view *)route)->index != NONE) {
+    return nexthop_ipaddr(routes[((struct view *)route)->index].nexthop);
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_head(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < ROUTE_STORE_ROUTES; i++) {
+    if(routes[i].nexthop != NULL) {
+      return view(i);
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_next(uip_ds6_route_t *r)
+{
+  uint8_t i;
+
+  if(r != NULL) {
+    for(i = ((struct view *)r)->index + 1; i < ROUTE_STORE_ROUTES; i++) {
+      if(routes[i].nexthop != NULL) {
+        return view(i);
+      }
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_ds6_route_num_routes(void)
+{
+  return num_routes;
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_lookup(uip_ipaddr_t *addr)
+{
+  uint8_t i;
+
+  if(!prefix_set || !uip_ipaddr_prefixcmp(&prefix, addr, 64)) {
+    return NULL;
+  }
+  i = find(addr);
+  if(i == NONE) {
+    return NULL;
+  }
+  routes[i].flags |= FLAG_REFERENCED;
+  return view(i);
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
+                  uip_ipaddr_t *nexthop)
+{
+  const uip_lladdr_t *nexthop_lladdr;
+  struct nexthop *n;
+  struct route *e;
+  uint8_t i;
+  uint8_t h;
+
+  nexthop_lladdr = uip_ds6_nbr_lladdr_from_ipaddr(nexthop);
+  if(nexthop_lladdr == NULL) {
+    PRINTF("route-store: next hop link-layer address unknown\n");
+    return NULL;
+  }
+
+  if(!prefix_set) {
+    memcpy(&prefix, ipaddr, 8);
+    prefix_set = 1;
+  }
+  if(length != 128 || !uip_ipaddr_prefixcmp(&prefix, ipaddr, 64)) {
+    PRINTF("route-store: not a host route under the prefix ");
+    PRINT6ADDR(ipaddr);
+    PRINTF("/%u\n", length);
+    route_store_stats.rejected++;
+    return NULL;
+  }
+
+  n = nbr_table_get_from_lladdr(nexthops, (rimeaddr_t *)nexthop_lladdr);
+  if(n == NULL) {
+    n = nbr_table_add_lladdr(nexthops, (rimeaddr_t *)nexthop_lladdr);
+    if(n == NULL) {
+      PRINTF("route-store: no room for the next hop\n");
+      route_store_stats.rejected++;
+      return NULL;
+    }
+    n->routes = 0;
+  }
+
+  i = find(ipaddr);
+  if(i != NONE) {
+    e = &routes[i];
+    if(e->nexthop != n) {
+      n->routes++;
+      release_nexthop(e->nexthop);
+      e->nexthop = n;
+    }
+  } else {
+    /* Hold a route on the next hop so that eviction cannot release it */
+    n->routes++;
+    i = free_head;
+    if(i == NONE) {
+      i = evict();
+    }
+    e = &routes[i];
+    free_head = e->next;
+
+    memcpy(e->iid, &ipaddr->u8[8], 8);
+    e->nexthop = n;
+    e->dag = NULL;
+    e->lifetime = 0;
+    e->flags = 0;
+    h = hash(e->iid);
+    e->next = buckets[h];
+    buckets[h] = i;
+
+    num_routes++;
+    if(num_routes > route_store_stats.peak) {
+      route_store_stats.peak = num_routes;
+    }
+    call_route_callback(UIP_DS6_NOTIFICATION_ROUTE_ADD, ipaddr, nexthop);
+  }
+  e->flags |= FLAG_REFERENCED;
+
+  PRINTF("route-store: ");
+  PRINT6ADDR(ipaddr);
+  PRINTF(" via ");
+  PRINT6ADDR(nexthop);
+  PRINTF(", %u routes\n", num_routes);
+
+  return view(i);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_rm(uip_ds6_route_t *route)
+{
+  if(route != NULL && ((struct view *)route)->index != NONE) {
+    rm_index(((struct view *)route)->index);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop)
+{
+  const uip_lladdr_t *nexthop_lladdr;
+  struct nexthop *n;
+
+  nexthop_lladdr = uip_ds6_nbr_lladdr_from_ipaddr(nexthop);
+  if(nexthop_lladdr == NULL) {
+    return;
+  }
+  n = nbr_table_get_from_lladdr(nexthops, (rimeaddr_t *)nexthop_lladdr);
+  if(n != NULL) {
+    rm_nexthop(n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Default routers, as in core/net/uip-ds6-route.c */
+uip_ds6_defrt_t *
+uip_ds6_defrt_add(uip_ipaddr_t *ipaddr, unsigned long interval)
+{
+  uip_ds6_defrt_t *d;
+
+  d = uip_ds6_defrt_lookup(ipaddr);
+  if(d == NULL) {
+    d = memb_alloc(&defaultroutermemb);
+    if(d == NULL) {
+      PRINTF("uip_ds6_defrt_add: could not add default route to ");
+      PRINT6ADDR(ipaddr);
+      PRINTF(", out of memory\n");
+      return NULL;
+    }
+    list_push(defaultrouterlist, d);
+  }
+
+  uip_ipaddr_copy(&d->ipaddr, ipaddr);
+  if(interval != 0) {
+    stimer_set(&d->lifetime, interval);
+    d->isinfinite = 0;
+  } else {
+    d->isinfinite = 1;
+  }
+
+  call_route_callback(UIP_DS6_NOTIFICATION_DEFRT_ADD, ipaddr, ipaddr);
+  return d;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_defrt_rm(uip_ds6_defrt_t *defrt)
+{
+  uip_ds6_defrt_t *d;
+
+  /* Make sure that the defrt is in the list before we remove it. */
+  for(d = list_head(defaultrouterlist);
+      d != NULL;
+      d = list_item_next(d)) {
+    if(d == defrt) {
+      PRINTF("Removing default route\n");
+      list_remove(defaultrouterlist, defrt);
+      memb_free(&defaultroutermemb, defrt);
+      call_route_callback(UIP_DS6_NOTIFICATION_DEFRT_RM,
+                          &defrt->ipaddr, &defrt->ipaddr);
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_defrt_t *
+uip_ds6_defrt_lookup(uip_ipaddr_t *ipaddr)
+{
+  uip_ds6_defrt_t *d;
+
+  for(d = list_head(defaultrouterlist);
+      d != NULL;
+      d = list_item_next(d)) {
+    if(uip_ipaddr_cmp(&d->ipaddr, ipaddr)) {
+      return d;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+uip_ds6_defrt_choose(void)
+{
+  uip_ds6_defrt_t *d;
+  uip_ds6_nbr_t *bestnbr;
+  uip_ipaddr_t *addr;
+
+  addr = NULL;
+  for(d = list_head(defaultrouterlist);
+      d != NULL;
+      d = list_item_next(d)) {
+    bestnbr = uip_ds6_nbr_lookup(&d->ipaddr);
+    if(bestnbr != NULL && bestnbr->state != NBR_INCOMPLETE) {
+      return &d->ipaddr;
+    } else {
+      addr = &d->ipaddr;
+    }
+  }
+  return addr;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_defrt_periodic(void)
+{
+  uip_ds6_defrt_t *d;
+
+  d = list_head(defaultrouterlist);
+  while(d != NULL) {
+    if(!d->isinfinite &&
+       stimer_expired(&d->lifetime)) {
+      PRINTF("uip_ds6_defrt_periodic: defrt lifetime expired\n");
+      uip_ds6_defrt_rm(d);
+      d = list_head(defaultrouterlist);
+    } else {
+      d = list_item_next(d);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -42,8 +42,22 @@
 #include "net/uip-ds6.h"
 #include "dev/slip.h"
 #include "dev/uart1.h"
+#include "slip-bridge.h"
 #include <string.h>
 
+#if SLIP_BRIDGE_CONF_HC
+#include "slip-hc.h"
+#endif
+#if SLIP_BRIDGE_CONF_PRIORITY
+#include "net/queuebuf.h"
+#endif
+#if BR_CONF_TRAFFIC
+#include "br-traffic.h"
+#endif
+#if BR_CONF_TRACE
+#include "br-trace.h"
+#endif
+
 #define UIP_IP_BUF        ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 
 #define DEBUG DEBUG_PRINT
@@ -51,7 +65,13 @@
 
 void set_prefix_64(uip_ipaddr_t *);
 
+struct slip_bridge_stats slip_bridge_stats;
+
 static uip_ipaddr_t last_sender;
+#if SLIP_BRIDGE_CONF_HC
+/* Set once the host has asked for compressed framing with "?H" */
+static uint8_t hc_enabled;
+#endif
 /*---------------------------------------------------------------------------*/
 static void
 slip_input_callback(void)
@@ -69,6 +89,12 @@ slip_input_callback(void)
       PRINT6ADDR(&prefix);
       PRINTF("\n");
       set_prefix_64(&prefix);
+#if SLIP_BRIDGE_CONF_HC
+      slip_hc_set_context(prefix.u8);
+      /* A host end that (re)started; it asks with "?H" right after if
+         it compresses, otherwise it only understands plain frames */
+      hc_enabled = 0;
+#endif
     }
   } else if (uip_buf[0] == '?') {
     PRINTF("Got request message of type %c\n", uip_buf[1]);
@@ -85,19 +111,358 @@ slip_input_callback(void)
       slip_send();
       
     }
+#if SLIP_BRIDGE_CONF_HC
+    if(uip_buf[1] == 'H') {
+      /* Acknowledge, from now on both directions may be compressed */
+      uip_buf[0] = '!';
+      uip_len = 2;
+      slip_send();
+      hc_enabled = 1;
+    }
+#endif
     uip_len = 0;
   }
+#if SLIP_BRIDGE_CONF_HC
+  else if(uip_buf[0] == SLIP_HC_DISPATCH) {
+    uip_len = slip_hc_decompress(&uip_buf[UIP_LLH_LEN], uip_len,
+                                 UIP_BUFSIZE - UIP_LLH_LEN);
+    if(uip_len == 0) {
+      PRINTF("slip-bridge: dropping malformed compressed frame\n");
+      return;
+    }
+  }
+#endif
   /* Save the last sender received over SLIP to avoid bouncing the
      packet back if no route is found */
   uip_ipaddr_copy(&last_sender, &UIP_IP_BUF->srcipaddr);
+#if BR_CONF_TRAFFIC
+  if(uip_len > 0) {
+    br_traffic_down(&UIP_IP_BUF->destipaddr, uip_len);
+  }
+#endif
+#if BR_CONF_TRACE
+  if(uip_len > 0) {
+    br_trace_ip(BR_TRACE_SLIP_IN);
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if SLIP_BRIDGE_CONF_RX_POOL
+/* Reception bypasses slip.c: frames are decoded in the UART interrupt
+   straight into a byte ring, each one preceded by its 16-bit length.
+   A frame only takes the room it needs, so a burst of CoAP-sized packets
+   fits in the space of a few full uIP buffers. uIP has a single packet
+   buffer, so each frame is still copied once into uip_buf when its turn
+   comes. */
+#ifdef SLIP_BRIDGE_CONF_RX_BUFSIZE
+#define RX_BUFSIZE SLIP_BRIDGE_CONF_RX_BUFSIZE
+#else
+#define RX_BUFSIZE (3 * UIP_BUFSIZE)
+#endif
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+#define WRAP(i) ((i) >= RX_BUFSIZE ? (i) - RX_BUFSIZE : (i))
+
+#if SLIP_BRIDGE_CONF_PRIORITY
+/* Commands (CoAP POST, PUT and DELETE, or a DSCP of CS5 and above) are
+   forwarded before older frames. The header also holds the time the
+   frame was received, and the top bits of the length hold its state. */
+#define RX_HDR        4
+#define RX_DONE       0x80  /* forwarded ahead of older frames */
+#define RX_CLASSIFIED 0x40
+#define RX_COMMAND    0x20
+#define RX_LEN_MASK   0x1f
+
+/* While fewer radio queue buffers than this are free, other frames wait
+   so that commands still find one, but not longer than the hold time */
+#ifdef SLIP_BRIDGE_CONF_RESERVED_QUEUEBUFS
+#define RESERVED_QUEUEBUFS SLIP_BRIDGE_CONF_RESERVED_QUEUEBUFS
+#else
+#define RESERVED_QUEUEBUFS 1
+#endif
+#ifdef SLIP_BRIDGE_CONF_HOLD
+#define HOLD SLIP_BRIDGE_CONF_HOLD
+#else
+#define HOLD (CLOCK_SECOND / 4)
+#endif
+
+#define DSCP_CS5     40
+#define COAP_PORT    5683
+#define COAP_POST    2
+#define COAP_DELETE  4
+/* Enough for the IPv6, UDP and first CoAP bytes, also once expanded from
+   a compressed frame */
+#define CLASSIFY_LEN 50
+#else
+#define RX_HDR        2
+#define RX_LEN_MASK   0xff
+#endif
+
+#define NO_FRAME RX_BUFSIZE
+
+static uint8_t rx_ring[RX_BUFSIZE];
+static volatile uint16_t rx_head;  /* where the frame being received starts */
+static volatile uint16_t rx_tail;  /* oldest frame not yet processed */
+static uint16_t rx_len;
+static uint8_t rx_esc;
+static uint8_t rx_dropping;
+
+PROCESS(slip_bridge_process, "SLIP bridge");
+/*---------------------------------------------------------------------------*/
+static int
+rx_byte(unsigned char c)
+{
+  uint16_t used;
+#if SLIP_BRIDGE_CONF_PRIORITY
+  clock_time_t now;
+#endif
+
+  if(c == SLIP_END) {
+    if(rx_len > 0 && !rx_dropping) {
+      rx_ring[rx_head] = rx_len >> 8;
+      rx_ring[WRAP(rx_head + 1)] = rx_len & 0xff;
+#if SLIP_BRIDGE_CONF_PRIORITY
+      now = clock_time();
+      rx_ring[WRAP(rx_head + 2)] = now >> 8;
+      rx_ring[WRAP(rx_head + 3)] = now & 0xff;
+#endif
+      rx_head = WRAP(WRAP(rx_head + RX_HDR) + rx_len);
+      used = WRAP(rx_head + RX_BUFSIZE - rx_tail);
+      if(used > slip_bridge_stats.rx_peak) {
+        slip_bridge_stats.rx_peak = used;
+      }
+      slip_bridge_stats.rx_frames++;
+      process_poll(&slip_bridge_process);
+    }
+    rx_len = 0;
+    rx_esc = 0;
+    rx_dropping = 0;
+    return 1;
+  }
+  if(rx_dropping) {
+    return 0;
+  }
+  if(c == SLIP_ESC) {
+    rx_esc = 1;
+    return 0;
+  }
+  if(rx_esc) {
+    rx_esc = 0;
+    if(c == SLIP_ESC_END) {
+      c = SLIP_END;
+    } else if(c == SLIP_ESC_ESC) {
+      c = SLIP_ESC;
+    }
+  }
+
+  if(rx_len >= UIP_BUFSIZE - UIP_LLH_LEN) {
+    slip_bridge_stats.rx_oversize++;
+    rx_dropping = 1;
+    return 0;
+  }
+  /* Header, data so far and this byte must fit in the free space,
+     leaving one byte so that a full ring does not look empty. */
+  if(rx_len + RX_HDR + 1 > WRAP(rx_tail + RX_BUFSIZE - rx_head - 1)) {
+    slip_bridge_stats.rx_dropped++;
+    rx_dropping = 1;
+    return 0;
+  }
+  rx_ring[WRAP(WRAP(rx_head + RX_HDR) + rx_len)] = c;
+  rx_len++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+frame_len(uint16_t frame)
+{
+  return ((rx_ring[frame] & RX_LEN_MASK) << 8) | rx_ring[WRAP(frame + 1)];
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+frame_next(uint16_t frame)
+{
+  return WRAP(WRAP(frame + RX_HDR) + frame_len(frame));
 }
 /*---------------------------------------------------------------------------*/
 static void
+frame_copy(uint16_t frame, uint8_t *buf, uint16_t len)
+{
+  uint16_t pos;
+  uint16_t i;
+
+  pos = WRAP(frame + RX_HDR);
+  for(i = 0; i < len; i++) {
+    buf[i] = rx_ring[pos];
+    pos = WRAP(pos + 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if SLIP_BRIDGE_CONF_PRIORITY
+static clock_time_t
+frame_time(uint16_t frame)
+{
+  return (rx_ring[WRAP(frame + 2)] << 8) | rx_ring[WRAP(frame + 3)];
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+classify(uint16_t frame)
+{
+  uint8_t hdr[2 * CLASSIFY_LEN];
+  uint16_t len;
+  uint8_t dscp;
+
+  len = frame_len(frame);
+  if(len > CLASSIFY_LEN) {
+    len = CLASSIFY_LEN;
+  }
+  frame_copy(frame, hdr, len);
+
+  if(hdr[0] == '!' || hdr[0] == '?') {
+    /* Tunnel configuration */
+    return RX_COMMAND;
+  }
+#if SLIP_BRIDGE_CONF_HC
+  if(hdr[0] == SLIP_HC_DISPATCH) {
+    len = slip_hc_decompress(hdr, len, sizeof(hdr));
+  }
+#endif
+  if(len < UIP_IPUDPH_LEN || (hdr[0] & 0xf0) != 0x60) {
+    return 0;
+  }
+
+  dscp = ((hdr[0] & 0x0f) << 2) | (hdr[1] >> 6);
+  if(dscp >= DSCP_CS5) {
+    return RX_COMMAND;
+  }
+  if(hdr[6] == UIP_PROTO_UDP && len >= UIP_IPUDPH_LEN + 2 &&
+     ((hdr[42] << 8) | hdr[43]) == COAP_PORT &&
+     hdr[UIP_IPUDPH_LEN + 1] >= COAP_POST &&
+     hdr[UIP_IPUDPH_LEN + 1] <= COAP_DELETE) {
+    return RX_COMMAND;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+account(uint16_t frame)
+{
+  uint8_t class;
+  uint32_t ms;
+
+  class = (rx_ring[frame] & RX_COMMAND) ? 1 : 0;
+  ms = (uint32_t)(clock_time_t)(clock_time() - frame_time(frame)) * 1000 /
+    CLOCK_SECOND;
+  slip_bridge_stats.class_frames[class]++;
+  slip_bridge_stats.class_total_ms[class] += ms;
+  if(ms > slip_bridge_stats.class_max_ms[class]) {
+    slip_bridge_stats.class_max_ms[class] = ms;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The frame to forward next: the oldest command, else the oldest frame.
+   Returns NO_FRAME if the others must wait for the radio queue. */
+static uint16_t
+next_frame(void)
+{
+  uint16_t frame;
+  uint16_t oldest;
+
+  oldest = NO_FRAME;
+  for(frame = rx_tail; frame != rx_head; frame = frame_next(frame)) {
+    if(rx_ring[frame] & RX_DONE) {
+      continue;
+    }
+    if(!(rx_ring[frame] & RX_CLASSIFIED)) {
+      rx_ring[frame] |= RX_CLASSIFIED | classify(frame);
+    }
+    if(rx_ring[frame] & RX_COMMAND) {
+      return frame;
+    }
+    if(oldest == NO_FRAME) {
+      oldest = frame;
+    }
+  }
+
+  if(oldest != NO_FRAME && queuebuf_numfree() < RESERVED_QUEUEBUFS &&
+     (clock_time_t)(clock_time() - frame_time(oldest)) < HOLD) {
+    return NO_FRAME;
+  }
+  return oldest;
+}
+#endif /* SLIP_BRIDGE_CONF_PRIORITY */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(slip_bridge_process, ev, data)
+{
+#if SLIP_BRIDGE_CONF_PRIORITY
+  static struct etimer hold_timer;
+#endif
+  uint16_t frame;
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+#if SLIP_BRIDGE_CONF_PRIORITY
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL ||
+                        (ev == PROCESS_EVENT_TIMER && data == &hold_timer));
+#else
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+#endif
+
+    while(rx_tail != rx_head) {
+#if SLIP_BRIDGE_CONF_PRIORITY
+      frame = next_frame();
+      if(frame == NO_FRAME) {
+        /* Look again at the next clock tick */
+        etimer_set(&hold_timer, 1);
+        break;
+      }
+      len = frame_len(frame);
+      frame_copy(frame, &uip_buf[UIP_LLH_LEN], len);
+      account(frame);
+      rx_ring[frame] |= RX_DONE;
+      /* Release the room of the frames forwarded so far before the
+         packet is processed, which may take a while when it is forwarded
+         over the radio. */
+      while(rx_tail != rx_head && (rx_ring[rx_tail] & RX_DONE)) {
+        rx_tail = frame_next(rx_tail);
+      }
+#else
+      frame = rx_tail;
+      len = frame_len(frame);
+      frame_copy(frame, &uip_buf[UIP_LLH_LEN], len);
+      /* Release the room before the packet is processed, which may take
+         a while when it is forwarded over the radio. */
+      rx_tail = frame_next(frame);
+#endif
+
+      uip_len = len;
+      slip_input_callback();
+      if(uip_len > 0) {
+        tcpip_input();
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* SLIP_BRIDGE_CONF_RX_POOL */
+/*---------------------------------------------------------------------------*/
+static void
 init(void)
 {
   slip_arch_init(BAUD2UBR(115200));
+#if SLIP_BRIDGE_CONF_RX_POOL
+  uart1_set_input(rx_byte);
+  process_start(&slip_bridge_process, NULL);
+#else
   process_start(&slip_process, NULL);
   slip_set_input_callback(slip_input_callback);
+#endif
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -106,6 +471,10 @@ output(void)
   if(uip_ipaddr_cmp(&last_sender, &UIP_IP_BUF->srcipaddr)) {
     /* Do not bounce packets back over SLIP if the packet was received
        over SLIP */
+    slip_bridge_stats.tx_bounced++;
+#if BR_CONF_TRAFFIC
+    br_traffic_no_route(&UIP_IP_BUF->destipaddr);
+#endif
     PRINTF("slip-bridge: Destination off-link but no route src=");
     PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
     PRINTF(" dst=");
@@ -113,6 +482,21 @@ output(void)
     PRINTF("\n");
   } else {
  //   PRINTF("SUT: %u\n", uip_len);
+#if BR_CONF_TRAFFIC
+    br_traffic_up(&UIP_IP_BUF->srcipaddr, uip_len);
+#endif
+#if BR_CONF_TRACE
+    br_trace_ip(BR_TRACE_SLIP_OUT);
+#endif
+#if SLIP_BRIDGE_CONF_HC
+    if(hc_enabled) {
+      uint16_t len = slip_hc_compress(&uip_buf[UIP_LLH_LEN], uip_len);
+      if(len > 0) {
+        uip_len = len;
+      }
+    }
+#endif
+    slip_bridge_stats.tx_frames++;
     slip_send();
   }
 }
@@ -0,0 +1,57 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Slip fallback interface: counters shared with the web page
+ */
+
+#ifndef __SLIP_BRIDGE_H__
+#define __SLIP_BRIDGE_H__
+
+#include "contiki.h"
+
+struct slip_bridge_stats {
+  uint16_t rx_frames;
+  uint16_t rx_dropped;    /* receive buffer full */
+  uint16_t rx_oversize;   /* longer than the uIP buffer */
+  uint16_t rx_peak;       /* highest receive buffer occupancy, in bytes */
+  uint16_t tx_frames;
+  uint16_t tx_bounced;    /* no route, not sent back to the host */
+#if SLIP_BRIDGE_CONF_PRIORITY
+  /* Time frames from the host waited at the router, by class:
+     0 for telemetry and the rest, 1 for commands */
+  uint16_t class_frames[2];
+  uint16_t class_max_ms[2];
+  uint32_t class_total_ms[2];
+#endif
+};
+
+extern struct slip_bridge_stats slip_bridge_stats;
+
+#endif /* __SLIP_BRIDGE_H__ */
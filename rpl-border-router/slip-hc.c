@@ -0,0 +1,243 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Header compression for IPv6 packets on the SLIP link
+ */
+
+#include "slip-hc.h"
+#include <string.h>
+
+#define IP_HLEN     40
+#define UDP_HLEN    8
+#define IPUDP_HLEN  (IP_HLEN + UDP_HLEN)
+#define PROTO_UDP   17
+
+/* Flags byte */
+#define FLAG_TF     0x08  /* traffic class and flow label inline */
+#define FLAG_UDP    0x04  /* next header is a compressed UDP header */
+#define SAM_SHIFT   6
+#define DAM_SHIFT   4
+
+/* Address modes */
+#define ADDR_INLINE 0     /* full 128 bits */
+#define ADDR_CTX64  1     /* context prefix, 64-bit IID inline */
+#define ADDR_CTX16  2     /* context prefix, IID 0:0:0:xxxx */
+#define ADDR_LL64   3     /* fe80::/64, 64-bit IID inline */
+
+static uint8_t context[8];
+static uint8_t context_set;
+static const uint8_t zeros[6];
+static const uint8_t linklocal[8] = { 0xfe, 0x80 };
+/*---------------------------------------------------------------------------*/
+void
+slip_hc_set_context(const uint8_t *prefix)
+{
+  memcpy(context, prefix, sizeof(context));
+  context_set = 1;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+compress_addr(uint8_t **p, const uint8_t *addr)
+{
+  if(context_set && memcmp(addr, context, 8) == 0) {
+    if(memcmp(addr + 8, zeros, 6) == 0) {
+      memcpy(*p, addr + 14, 2);
+      *p += 2;
+      return ADDR_CTX16;
+    }
+    memcpy(*p, addr + 8, 8);
+    *p += 8;
+    return ADDR_CTX64;
+  }
+  if(memcmp(addr, linklocal, 8) == 0) {
+    memcpy(*p, addr + 8, 8);
+    *p += 8;
+    return ADDR_LL64;
+  }
+  memcpy(*p, addr, 16);
+  *p += 16;
+  return ADDR_INLINE;
+}
+/*---------------------------------------------------------------------------*/
+static const uint8_t *
+decompress_addr(const uint8_t *p, const uint8_t *end, uint8_t *addr,
+                uint8_t mode)
+{
+  switch(mode) {
+  case ADDR_CTX64:
+  case ADDR_LL64:
+    if(p + 8 > end) {
+      return NULL;
+    }
+    memcpy(addr, mode == ADDR_CTX64 ? context : linklocal, 8);
+    memcpy(addr + 8, p, 8);
+    return p + 8;
+  case ADDR_CTX16:
+    if(p + 2 > end) {
+      return NULL;
+    }
+    memcpy(addr, context, 8);
+    memset(addr + 8, 0, 6);
+    memcpy(addr + 14, p, 2);
+    return p + 2;
+  default:
+    if(p + 16 > end) {
+      return NULL;
+    }
+    memcpy(addr, p, 16);
+    return p + 16;
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+slip_hc_compress(uint8_t *buf, uint16_t len)
+{
+  uint8_t hdr[IPUDP_HLEN];
+  uint8_t *p;
+  uint8_t flags;
+  uint16_t hlen;
+  uint16_t plen;
+
+  if(len < IP_HLEN || (buf[0] & 0xf0) != 0x60) {
+    return 0;
+  }
+  plen = (buf[4] << 8) | buf[5];
+  if(plen + IP_HLEN != len) {
+    return 0;
+  }
+
+  flags = 0;
+  hlen = IP_HLEN;
+  /* The UDP length can only be elided if it spans the whole payload. */
+  if(buf[6] == PROTO_UDP && len >= IPUDP_HLEN &&
+     ((buf[IP_HLEN + 4] << 8) | buf[IP_HLEN + 5]) == plen) {
+    flags |= FLAG_UDP;
+    hlen = IPUDP_HLEN;
+  }
+  memcpy(hdr, buf, hlen);
+
+  /* The compressed header is never longer than the original one, so it
+     can be written over it before the payload is moved down. */
+  p = buf + 2;
+  *p++ = hdr[7];
+  if((hdr[0] & 0x0f) != 0 || hdr[1] != 0 || hdr[2] != 0 || hdr[3] != 0) {
+    flags |= FLAG_TF;
+    memcpy(p, hdr, 4);
+    p += 4;
+  }
+  if(!(flags & FLAG_UDP)) {
+    *p++ = hdr[6];
+  }
+  flags |= compress_addr(&p, &hdr[8]) << SAM_SHIFT;
+  flags |= compress_addr(&p, &hdr[24]) << DAM_SHIFT;
+  if(flags & FLAG_UDP) {
+    memcpy(p, &hdr[IP_HLEN], 4);
+    memcpy(p + 4, &hdr[IP_HLEN + 6], 2);
+    p += 6;
+  }
+  buf[0] = SLIP_HC_DISPATCH;
+  buf[1] = flags;
+
+  memmove(p, buf + hlen, len - hlen);
+  return (uint16_t)(p - buf) + len - hlen;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+slip_hc_decompress(uint8_t *buf, uint16_t len, uint16_t size)
+{
+  uint8_t hdr[IPUDP_HLEN];
+  const uint8_t *p;
+  const uint8_t *end;
+  uint8_t flags;
+  uint16_t hlen;
+  uint16_t datalen;
+  uint16_t plen;
+
+  if(len < 3 || buf[0] != SLIP_HC_DISPATCH) {
+    return 0;
+  }
+  flags = buf[1];
+  p = buf + 2;
+  end = buf + len;
+
+  memset(hdr, 0, sizeof(hdr));
+  hdr[0] = 0x60;
+  hdr[7] = *p++;
+  if(flags & FLAG_TF) {
+    if(p + 4 > end) {
+      return 0;
+    }
+    memcpy(hdr, p, 4);
+    p += 4;
+  }
+  if(flags & FLAG_UDP) {
+    hdr[6] = PROTO_UDP;
+    hlen = IPUDP_HLEN;
+  } else {
+    if(p + 1 > end) {
+      return 0;
+    }
+    hdr[6] = *p++;
+    hlen = IP_HLEN;
+  }
+  p = decompress_addr(p, end, &hdr[8], (flags >> SAM_SHIFT) & 3);
+  if(p == NULL) {
+    return 0;
+  }
+  p = decompress_addr(p, end, &hdr[24], (flags >> DAM_SHIFT) & 3);
+  if(p == NULL) {
+    return 0;
+  }
+  if(flags & FLAG_UDP) {
+    if(p + 6 > end) {
+      return 0;
+    }
+    memcpy(&hdr[IP_HLEN], p, 4);
+    memcpy(&hdr[IP_HLEN + 6], p + 4, 2);
+    p += 6;
+  }
+
+  datalen = end - p;
+  if(hlen + datalen > size) {
+    return 0;
+  }
+  plen = hlen - IP_HLEN + datalen;
+  hdr[4] = plen >> 8;
+  hdr[5] = plen & 0xff;
+  if(flags & FLAG_UDP) {
+    hdr[IP_HLEN + 4] = plen >> 8;
+    hdr[IP_HLEN + 5] = plen & 0xff;
+  }
+
+  memmove(buf + hlen, p, datalen);
+  memcpy(buf, hdr, hlen);
+  return hlen + datalen;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,69 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Header compression for IPv6 packets on the SLIP link
+ *
+ *         Compressed frames start with SLIP_HC_DISPATCH, which cannot be
+ *         confused with an IPv6 packet (0x6.) or with the '!', '?' and
+ *         '\r' frames of the tunslip6 protocol. The layout is
+ *
+ *           dispatch | flags | hop limit | [tc/flow 4] | [next header 1]
+ *           | src | dst | [udp src port 2, dst port 2, checksum 2] | data
+ *
+ *         The payload and UDP lengths are elided and rebuilt from the
+ *         frame length. Addresses under the shared /64 context (the prefix
+ *         handed out by the host) and link-local addresses carry only
+ *         their interface identifier, and only its last 16 bits when the
+ *         upper 48 bits are zero (e.g. aaaa::1).
+ *
+ *         The code has no Contiki dependencies so that the host side of
+ *         the tunnel can use the same file.
+ */
+
+#ifndef __SLIP_HC_H__
+#define __SLIP_HC_H__
+
+#include <stdint.h>
+
+#define SLIP_HC_DISPATCH '#'
+
+/* Sets the /64 prefix used as compression context; both ends of the link
+   must use the same one. */
+void slip_hc_set_context(const uint8_t *prefix);
+
+/* Compresses the IPv6 packet in buf in place. Returns the compressed
+   length, or 0 if the packet was left untouched. */
+uint16_t slip_hc_compress(uint8_t *buf, uint16_t len);
+
+/* Expands the compressed frame in buf in place into an IPv6 packet of at
+   most size bytes. Returns the packet length, or 0 on a malformed frame. */
+uint16_t slip_hc_decompress(uint8_t *buf, uint16_t len, uint16_t size);
+
+#endif /* __SLIP_HC_H__ */
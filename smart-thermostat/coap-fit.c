@@ -0,0 +1,164 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Responses sized to a single radio frame
+ */
+
+#include "contiki.h"
+#include "erbium.h"
+#include "er-coap-13.h"
+#include "coap-fit.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#define BLOCK_MIN 16
+#define BLOCK2_OPTION 4   /* header and up to 3 bytes of value */
+#define OBSERVE_OPTION 4  /* added by the engine after the handler */
+
+/*---------------------------------------------------------------------------*/
+static uint8_t
+uint_len(uint32_t value)
+{
+  uint8_t len = 0;
+
+  while(value > 0) {
+    len++;
+    value >>= 8;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+coap_fit_room(void *request, void *response)
+{
+  coap_packet_t *const req = (coap_packet_t *)request;
+  coap_packet_t *const resp = (coap_packet_t *)response;
+  uint16_t header;
+
+  /* Fixed header, token and payload marker; the options used by the
+     thermostat have small deltas, one byte of option header each */
+  header = 4 + req->token_len + 1;
+  if(IS_OPTION(resp, COAP_OPTION_ETAG)) {
+    header += 1 + resp->etag_len;
+  }
+  if(IS_OPTION(req, COAP_OPTION_OBSERVE)) {
+    header += OBSERVE_OPTION;
+  }
+  if(IS_OPTION(resp, COAP_OPTION_CONTENT_TYPE)) {
+    header += 1 + uint_len(resp->content_type);
+  }
+  if(IS_OPTION(resp, COAP_OPTION_MAX_AGE)) {
+    header += 1 + uint_len(resp->max_age);
+  }
+  return header < COAP_FIT_UDP_ROOM ? COAP_FIT_UDP_ROOM - header : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_fit_begin(struct coap_fit *fit, uint8_t *buffer,
+               uint16_t preferred_size, int32_t offset)
+{
+  /* Without Block2 in the request, offset is 0 and preferred_size
+     REST_MAX_CHUNK_SIZE */
+  fit->buffer = buffer;
+  fit->start = offset;
+  fit->size = preferred_size;
+  fit->len = 0;
+  fit->total = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_fit_write(struct coap_fit *fit, const char *text, uint16_t len)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++, fit->total++) {
+    if(fit->total >= fit->start && fit->len < fit->size) {
+      fit->buffer[fit->len++] = text[i];
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_fit_printf(struct coap_fit *fit, const char *format, ...)
+{
+  char text[COAP_FIT_PRINTF_MAX];
+  va_list ap;
+  int len;
+
+  va_start(ap, format);
+  len = vsnprintf(text, sizeof(text), format, ap);
+  va_end(ap);
+  if(len >= (int)sizeof(text)) {
+    PRINTF("coap-fit: text of %d bytes cut\n", len);
+    len = sizeof(text) - 1;
+  }
+  if(len > 0) {
+    coap_fit_write(fit, text, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_fit_end(struct coap_fit *fit, void *request, void *response,
+             int32_t *offset)
+{
+  uint16_t room;
+  uint16_t size;
+
+  if(coap_get_header_block2(request, NULL, NULL, NULL, NULL)) {
+    /* A block of the size of the client; the engine adds the option */
+    if(fit->start > 0 && fit->start >= fit->total) {
+      /* Left to the engine, which answers 4.02 */
+      return;
+    }
+    REST.set_response_payload(response, fit->buffer, fit->len);
+    *offset = fit->start + fit->len < fit->total ? fit->start + fit->len : -1;
+    return;
+  }
+
+  room = coap_fit_room(request, response);
+  if(fit->total <= fit->size &&
+     (fit->total <= room || fit->total <= BLOCK_MIN)) {
+    REST.set_response_payload(response, fit->buffer, fit->len);
+    return;
+  }
+
+  /* The first block; the engine leaves the response alone while *offset
+     stays 0 */
+  room = room > BLOCK2_OPTION ? room - BLOCK2_OPTION : 0;
+  for(size = BLOCK_MIN; size * 2 <= room && size * 2 <= fit->size; size *= 2);
+  PRINTF("coap-fit: %ld bytes, blocks of %u\n", (long)fit->total, size);
+  coap_set_header_block2(response, 0, 1, size);
+  REST.set_response_payload(response, fit->buffer, size);
+}
+/*---------------------------------------------------------------------------*/
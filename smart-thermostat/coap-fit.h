@@ -0,0 +1,91 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Responses sized to a single radio frame
+ *
+ *         A 6LoWPAN fragment lost anywhere in the mesh loses the whole
+ *         packet, so the responses of the thermostat are kept to what one
+ *         802.15.4 frame carries after its headers. The representation is
+ *         written through a struct coap_fit, which keeps only the part the
+ *         response carries and counts the rest. If the whole of it fits in
+ *         the frame after the CoAP header of the response, it is sent as
+ *         is. Otherwise the first block is sent with a Block2 option, of
+ *         the largest size that fits, and the client asks for the next
+ *         ones with that size; each request for a block writes the
+ *         representation again and keeps that block. Blocks are never
+ *         larger than REST_MAX_CHUNK_SIZE, so nothing is cut off either.
+ *
+ *         A representation produced in blocks by offset (such as the
+ *         weekly program) can fill in buffer, len and total itself between
+ *         coap_fit_begin() and coap_fit_end().
+ */
+
+#ifndef __COAP_FIT_H__
+#define __COAP_FIT_H__
+
+#include "contiki.h"
+
+/* UDP payload of one frame: 127 bytes less the FCS (2), the MAC header
+   with long addresses (21), the compressed IPv6 header with an inline
+   destination (12), the RPL hop-by-hop option (8) and the UDP header (8),
+   which is not compressed after the option */
+#ifdef COAP_FIT_CONF_UDP_ROOM
+#define COAP_FIT_UDP_ROOM COAP_FIT_CONF_UDP_ROOM
+#else
+#define COAP_FIT_UDP_ROOM 76
+#endif
+
+/* Longest text of a single coap_fit_printf() */
+#define COAP_FIT_PRINTF_MAX 32
+
+struct coap_fit {
+  uint8_t *buffer;        /* of the handler, for the part kept */
+  int32_t start;          /* offset of that part in the representation */
+  uint16_t size;          /* room in buffer */
+  uint16_t len;           /* bytes kept */
+  int32_t total;          /* bytes written */
+};
+
+/* Arguments of the resource handler */
+void coap_fit_begin(struct coap_fit *fit, uint8_t *buffer,
+                    uint16_t preferred_size, int32_t offset);
+
+void coap_fit_write(struct coap_fit *fit, const char *text, uint16_t len);
+void coap_fit_printf(struct coap_fit *fit, const char *format, ...);
+
+/* Sets the payload, and Block2 if needed. Call after the other options
+   of the response are set. */
+void coap_fit_end(struct coap_fit *fit, void *request, void *response,
+                  int32_t *offset);
+
+/* Payload bytes left in the frame of the response as it stands */
+uint16_t coap_fit_room(void *request, void *response);
+
+#endif /* __COAP_FIT_H__ */
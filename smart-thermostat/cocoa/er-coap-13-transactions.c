@@ -0,0 +1,202 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Erbium transactions timed per peer, after CoCoA
+ *
+ *         Built instead of apps/er-coap-13/er-coap-13-transactions.c when
+ *         the directory is added to PROJECTDIRS (make WITH_COCOA=1). It is
+ *         the same transaction layer, except for the timeouts of
+ *         confirmable messages: the first one comes from the RTO of the
+ *         peer and the next ones from its backoff
+ *         (../rpl-border-router/cocoa/coap-rto.h), and the RTT of every
+ *         answered exchange is fed back to the estimator. This covers the
+ *         confirmable notifications of the observed resources and the
+ *         client requests of the mote, e.g. the registrations with the
+ *         resource directory.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+
+#include "er-coap-13-transactions.h"
+#include "er-coap-13-observing.h"
+#include "coap-rto.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
+LIST(transactions_list);
+
+/* First transmission of the confirmable transactions, by memb index;
+   0 when no RTT is to be measured */
+static clock_time_t sent[COAP_MAX_OPEN_TRANSACTIONS];
+
+static struct process *transaction_handler_process = NULL;
+/*---------------------------------------------------------------------------*/
+static int
+index_of(coap_transaction_t *t)
+{
+  return t - (coap_transaction_t *)transactions_memb.mem;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_register_as_transaction_handler()
+{
+  transaction_handler_process = PROCESS_CURRENT();
+}
+/*---------------------------------------------------------------------------*/
+coap_transaction_t *
+coap_new_transaction(uint16_t mid, uip_ipaddr_t *addr, uint16_t port)
+{
+  coap_transaction_t *t = memb_alloc(&transactions_memb);
+
+  if(t) {
+    t->mid = mid;
+    t->retrans_counter = 0;
+
+    /* save client address */
+    uip_ipaddr_copy(&t->addr, addr);
+    t->port = port;
+    sent[index_of(t)] = 0;
+
+    list_add(transactions_list, t); /* List itself makes sure same element is not added twice. */
+  }
+
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_send_transaction(coap_transaction_t *t)
+{
+  struct process *process_actual;
+  restful_response_handler callback;
+  void *callback_data;
+
+  PRINTF("Sending transaction %u\n", t->mid);
+
+  coap_send_message(&t->addr, t->port, t->packet, t->packet_len);
+
+  if(COAP_TYPE_CON ==
+     ((COAP_HEADER_TYPE_MASK & t->packet[0]) >> COAP_HEADER_TYPE_POSITION)) {
+    if(t->retrans_counter < COAP_MAX_RETRANSMIT) {
+      /* Not timed out yet. */
+      PRINTF("Keeping transaction %u\n", t->mid);
+
+      if(t->retrans_counter == 0) {
+        t->retrans_timer.timer.interval = coap_rto_start(&t->addr);
+        /* Never 0, which means not measuring */
+        sent[index_of(t)] = clock_time() | 1;
+      } else {
+        t->retrans_timer.timer.interval =
+          coap_rto_backoff(&t->addr, t->retrans_timer.timer.interval);
+      }
+      PRINTF("Timeout %u of %u: %lu ticks\n", t->retrans_counter, t->mid,
+             (unsigned long)t->retrans_timer.timer.interval);
+
+      /* The timer must belong to the process that checks the
+         transactions, not to the one sending */
+      process_actual = PROCESS_CURRENT();
+      process_current = transaction_handler_process;
+      etimer_restart(&t->retrans_timer); /* interval updated above */
+      process_current = process_actual;
+    } else {
+      /* timeout */
+      PRINTF("Timeout\n");
+      callback = t->callback;
+      callback_data = t->callback_data;
+
+      coap_rto_giveup(&t->addr);
+      sent[index_of(t)] = 0;
+
+      /* handle observers */
+      coap_remove_observer_by_client(&t->addr, t->port);
+
+      coap_clear_transaction(t);
+
+      if(callback) {
+        callback(callback_data, NULL);
+      }
+    }
+  } else {
+    coap_clear_transaction(t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_clear_transaction(coap_transaction_t *t)
+{
+  int i;
+
+  if(t) {
+    PRINTF("Freeing transaction %u: %p\n", t->mid, t);
+
+    /* A confirmable transaction still pending is only cleared by the
+       engine, when its ACK or RST came in */
+    i = index_of(t);
+    if(sent[i] != 0) {
+      coap_rto_measure(&t->addr, clock_time() - sent[i], t->retrans_counter);
+      sent[i] = 0;
+    }
+
+    etimer_stop(&t->retrans_timer);
+    list_remove(transactions_list, t);
+    memb_free(&transactions_memb, t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+coap_transaction_t *
+coap_get_transaction_by_mid(uint16_t mid)
+{
+  coap_transaction_t *t = NULL;
+
+  for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+    if(t->mid == mid) {
+      PRINTF("Found transaction for MID %u: %p\n", t->mid, t);
+      return t;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_check_transactions()
+{
+  coap_transaction_t *t = NULL;
+
+  for(t = (coap_transaction_t *)list_head(transactions_list); t; t = t->next) {
+    if(etimer_expired(&t->retrans_timer)) {
+      ++(t->retrans_counter);
+      PRINTF("Retransmitting %u (%u)\n", t->mid, t->retrans_counter);
+      coap_send_transaction(t);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,191 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Fast join and announcement to the border router
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"   /* dis_output() */
+#include "erbium.h"
+#include "er-coap-13.h"
+#include "fast-join.h"
+
+#include <stdio.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#define ANNOUNCE_PATH "announce"
+
+struct fast_join_stats fast_join_stats;
+
+static struct uip_ds6_notification notification;
+static struct etimer dis_timer;
+static struct etimer announce_timer;
+static clock_time_t dis_interval;
+static uip_ipaddr_t announced;      /* parent at the last announcement */
+
+PROCESS(fast_join_process, "Fast join");
+
+/*---------------------------------------------------------------------------*/
+static uint32_t
+since_boot(void)
+{
+  unsigned long seconds;
+  clock_time_t ticks;
+
+  do {
+    seconds = clock_seconds();
+    ticks = clock_time();
+  } while(seconds != clock_seconds());
+  return seconds * 1000 + (ticks % CLOCK_SECOND) * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_changed(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+              int num_routes)
+{
+  if(event == UIP_DS6_NOTIFICATION_DEFRT_ADD ||
+     event == UIP_DS6_NOTIFICATION_DEFRT_RM) {
+    process_poll(&fast_join_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+announce(void)
+{
+  static uint8_t buf[COAP_MAX_HEADER_SIZE + 24];
+  coap_packet_t message[1];
+  char payload[24];
+  uip_ipaddr_t *parent;
+  rpl_dag_t *dag;
+  int len;
+
+  parent = uip_ds6_defrt_choose();
+  dag = rpl_get_any_dag();
+  if(parent == NULL || dag == NULL) {
+    return;
+  }
+  uip_ipaddr_copy(&announced, parent);
+
+  len = snprintf(payload, sizeof(payload), "r=%lu&c=%u",
+                 (unsigned long)fast_join_stats.routable,
+                 fast_join_stats.changes);
+  coap_init_message(message, COAP_TYPE_NON, COAP_POST, coap_get_mid());
+  coap_set_header_uri_path(message, ANNOUNCE_PATH);
+  coap_set_payload(message, payload, len);
+  coap_send_message(&dag->dag_id, UIP_HTONS(COAP_DEFAULT_PORT), buf,
+                    coap_serialize_message(message, buf));
+  fast_join_stats.announces++;
+  PRINTF("fast-join: announced to ");
+  PRINT6ADDR(&dag->dag_id);
+  PRINTF("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+routes_changed(void)
+{
+  uip_ipaddr_t *parent;
+
+  parent = uip_ds6_defrt_choose();
+  if(parent == NULL) {
+    if(etimer_expired(&dis_timer)) {
+      /* Parent lost: look for another one as at boot */
+      PRINTF("fast-join: no parent\n");
+      etimer_stop(&announce_timer);
+      dis_interval = FAST_JOIN_DIS_MIN;
+      etimer_set(&dis_timer, dis_interval);
+    }
+    return;
+  }
+
+  etimer_stop(&dis_timer);
+  if(fast_join_stats.routable == 0) {
+    fast_join_stats.routable = since_boot();
+    PRINTF("fast-join: routable after %lu ms, %u DIS\n",
+           (unsigned long)fast_join_stats.routable, fast_join_stats.dis);
+  } else if(!uip_ipaddr_cmp(parent, &announced)) {
+    fast_join_stats.changes++;
+  }
+  if(!uip_ipaddr_cmp(parent, &announced)) {
+    etimer_set(&announce_timer, FAST_JOIN_ANNOUNCE_DELAY);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(fast_join_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  uip_ds6_notification_add(&notification, route_changed);
+  dis_interval = FAST_JOIN_DIS_MIN;
+  etimer_set(&dis_timer, dis_interval);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == PROCESS_EVENT_POLL) {
+      routes_changed();
+    } else if(ev == PROCESS_EVENT_TIMER && data == &dis_timer) {
+      if(uip_ds6_defrt_choose() == NULL) {
+        dis_output(NULL);
+        fast_join_stats.dis++;
+        dis_interval *= 2;
+        if(dis_interval > FAST_JOIN_DIS_MAX) {
+          dis_interval = FAST_JOIN_DIS_MAX;
+        }
+        etimer_set(&dis_timer, dis_interval);
+      } else {
+        routes_changed();
+      }
+    } else if(ev == PROCESS_EVENT_TIMER && data == &announce_timer) {
+      announce();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+fast_join_notified(void)
+{
+  if(fast_join_stats.notified == 0) {
+    fast_join_stats.notified = since_boot();
+    PRINTF("fast-join: first notification after %lu ms\n",
+           (unsigned long)fast_join_stats.notified);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+fast_join_init(void)
+{
+  process_start(&fast_join_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,90 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Fast join and announcement to the border router
+ *
+ *         RPL alone sends its first DIS 5 s after boot and then one a
+ *         minute, and a mote waits for the next DIO of a neighbour to
+ *         join. Until the border router relays a notification again, an
+ *         observation of the mote through it also waits for the relay
+ *         timeout. Instead, while the mote has no default route, it sends
+ *         a DIS every FAST_JOIN_DIS_MIN, doubling up to FAST_JOIN_DIS_MAX.
+ *         Once it has a parent, after a reboot or a parent change, it
+ *         waits for its DAO to reach the root and posts
+ *         coap://[DODAG ID]/announce ("r=<ms>&c=<changes>"). The border
+ *         router, which answers on the DODAG ID, then registers its
+ *         observations of the mote again without waiting.
+ *
+ *         The times from boot to the first default route and to the first
+ *         notification (the answer to the first observe registration) are
+ *         printed and kept in fast_join_stats.
+ */
+
+#ifndef __FAST_JOIN_H__
+#define __FAST_JOIN_H__
+
+#include "contiki.h"
+
+#ifdef FAST_JOIN_CONF_DIS_MIN
+#define FAST_JOIN_DIS_MIN FAST_JOIN_CONF_DIS_MIN
+#else
+#define FAST_JOIN_DIS_MIN (CLOCK_SECOND / 4)
+#endif
+
+#ifdef FAST_JOIN_CONF_DIS_MAX
+#define FAST_JOIN_DIS_MAX FAST_JOIN_CONF_DIS_MAX
+#else
+#define FAST_JOIN_DIS_MAX (8 * CLOCK_SECOND)
+#endif
+
+/* Time for the DAO to reach the root before announcing */
+#ifdef FAST_JOIN_CONF_ANNOUNCE_DELAY
+#define FAST_JOIN_ANNOUNCE_DELAY FAST_JOIN_CONF_ANNOUNCE_DELAY
+#else
+#define FAST_JOIN_ANNOUNCE_DELAY (5 * CLOCK_SECOND)
+#endif
+
+struct fast_join_stats {
+  uint32_t routable;      /* ms from boot to the first default route */
+  uint32_t notified;      /* ms from boot to the first notification */
+  uint16_t dis;           /* DIS sent */
+  uint16_t changes;       /* parent changes after the first */
+  uint16_t announces;
+};
+
+extern struct fast_join_stats fast_join_stats;
+
+/* Starts looking for a parent; the REST engine must be running. */
+void fast_join_init(void);
+
+/* A notification is being sent; the first one is timed */
+void fast_join_notified(void);
+
+#endif /* __FAST_JOIN_H__ */
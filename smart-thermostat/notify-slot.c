@@ -0,0 +1,140 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Slotted notification timing
+ */
+
+#include "contiki.h"
+#include "net/rime/rimeaddr.h"
+#include "notify-slot.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+static notify_slot_callback_t callback;
+static struct ctimer timer;
+static clock_time_t next;      /* instant of the next notification */
+static clock_time_t last;      /* of the previous one */
+static uint8_t slot;
+static uint8_t slots;
+static uint8_t assigned;
+
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+slot_offset(void)
+{
+  return (clock_time_t)((uint32_t)NOTIFY_SLOT_PERIOD * slot / slots);
+}
+/*---------------------------------------------------------------------------*/
+static void expired(void *ptr);
+
+static void
+arm(void)
+{
+  clock_time_t now;
+
+  now = clock_time();
+  /* A late timer fires at once but keeps the phase */
+  ctimer_set(&timer, CLOCK_LT(next, now) ? 0 : next - now, expired, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+expired(void *ptr)
+{
+  last = clock_time();
+  next += NOTIFY_SLOT_PERIOD;
+  while(CLOCK_LT(next, last)) {
+    /* Too late for a whole period: skip it rather than catch up */
+    next += NOTIFY_SLOT_PERIOD;
+  }
+  arm();
+  callback();
+}
+/*---------------------------------------------------------------------------*/
+void
+notify_slot_init(notify_slot_callback_t cb)
+{
+  callback = cb;
+  slots = NOTIFY_SLOT_SLOTS;
+  slot = rimeaddr_node_addr.u8[RIMEADDR_SIZE - 1] % slots;
+  assigned = 0;
+  last = clock_time() - NOTIFY_SLOT_PERIOD;
+  next = clock_time() + slot_offset();
+  PRINTF("notify-slot: slot %u of %u\n", slot, slots);
+  arm();
+}
+/*---------------------------------------------------------------------------*/
+int
+notify_slot_assign(uint8_t s, uint8_t n, uint16_t elapsed)
+{
+  clock_time_t now;
+  clock_time_t ticks;
+
+  ticks = (clock_time_t)((uint32_t)elapsed * CLOCK_SECOND / 1000);
+  if(n == 0 || s >= n || ticks >= NOTIFY_SLOT_PERIOD) {
+    return -1;
+  }
+  slot = s;
+  slots = n;
+  assigned = 1;
+
+  now = clock_time();
+  next = now - ticks + slot_offset();
+  while(CLOCK_LT(next, now)) {
+    next += NOTIFY_SLOT_PERIOD;
+  }
+  /* Moving to an earlier slot must not notify twice in a short while */
+  if(CLOCK_LT(next, last + NOTIFY_SLOT_PERIOD / 2)) {
+    next += NOTIFY_SLOT_PERIOD;
+  }
+  PRINTF("notify-slot: assigned %u of %u, next in %u ticks\n",
+         slot, slots, (unsigned)(next - now));
+  arm();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+notify_slot_slot(void)
+{
+  return slot;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+notify_slot_slots(void)
+{
+  return slots;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+notify_slot_assigned(void)
+{
+  return assigned;
+}
+/*---------------------------------------------------------------------------*/
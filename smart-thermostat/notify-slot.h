@@ -0,0 +1,80 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Slotted notification timing
+ *
+ *         Thermostats that boot together would notify in lock-step, every
+ *         period at the same instant, and collide around the border
+ *         router. Instead the period is cut into slots and each mote
+ *         notifies in its own: at first the slot given by the last byte of
+ *         its link-layer address, counted from boot, and once the border
+ *         router has assigned one, the slot it was given, counted from the
+ *         start of the router's period. The router spreads its motes evenly
+ *         over the period and sends the time into it with the assignment,
+ *         which keeps all the rooms in step with the same reference.
+ *
+ *         The timer follows absolute instants, one period apart, so the
+ *         slots do not drift with the processing delays.
+ */
+
+#ifndef __NOTIFY_SLOT_H__
+#define __NOTIFY_SLOT_H__
+
+#include "contiki.h"
+
+#ifdef NOTIFY_SLOT_CONF_PERIOD
+#define NOTIFY_SLOT_PERIOD NOTIFY_SLOT_CONF_PERIOD
+#else
+#define NOTIFY_SLOT_PERIOD (5 * CLOCK_SECOND)
+#endif
+
+/* Slots of the period before the border router assigns one */
+#ifdef NOTIFY_SLOT_CONF_SLOTS
+#define NOTIFY_SLOT_SLOTS NOTIFY_SLOT_CONF_SLOTS
+#else
+#define NOTIFY_SLOT_SLOTS 32
+#endif
+
+/* Called once per period, at the start of the slot */
+typedef void (*notify_slot_callback_t)(void);
+
+/* Starts notifying in the slot of the link-layer address */
+void notify_slot_init(notify_slot_callback_t callback);
+
+/* Slot slot of slots, the period having started elapsed ms ago.
+   Returns 0 on success. */
+int notify_slot_assign(uint8_t slot, uint8_t slots, uint16_t elapsed);
+
+uint8_t notify_slot_slot(void);
+uint8_t notify_slot_slots(void);
+/* 1 once the border router has assigned the slot */
+uint8_t notify_slot_assigned(void);
+
+#endif /* __NOTIFY_SLOT_H__ */
@@ -78,6 +78,22 @@
 #undef UIP_CONF_MAX_ROUTES
 #define UIP_CONF_MAX_ROUTES   10
 
+/* With the compact route store (make WITH_ROUTE_STORE=1) instead: twice
+   the routes for about 150 more bytes, the expanded views included. */
+#ifndef ROUTE_STORE_CONF_ROUTES
+#define ROUTE_STORE_CONF_ROUTES  20
+#endif
+#ifndef ROUTE_STORE_CONF_BUCKETS
+#define ROUTE_STORE_CONF_BUCKETS  8
+#endif
+
+/* Peers with an RTO of their own (make WITH_COCOA=1): the border router,
+   which relays the observations and keeps the directory, and a client
+   observing the mote directly. */
+#ifndef COAP_RTO_CONF_PEERS
+#define COAP_RTO_CONF_PEERS  2
+#endif
+
 /* Reduce 802.15.4 frame queue to save RAM. */
 #undef QUEUEBUF_CONF_NUM
 #define QUEUEBUF_CONF_NUM       4
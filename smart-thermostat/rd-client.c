@@ -0,0 +1,316 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Registration with the resource directory of the border router
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/rpl/rpl.h"
+#include "dev/serial-line.h"
+#include "erbium.h"
+#include "er-coap-13.h"
+#include "er-coap-13-transactions.h"
+#include "rd-client.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#define RD_PATH "rd"
+
+/* Delays between attempts while there is no route or no answer */
+#define RETRY_MIN (5 * CLOCK_SECOND)
+#define RETRY_MAX (160 * CLOCK_SECOND)
+
+/* The 16-bit clock of the Sky counts 255 s at most: the refresh at half
+   the lifetime is waited for in pieces of up to 240 s */
+#define MAX_WAIT 240
+
+/* Link format of the resources, the most the router takes */
+#define LINKS_SIZE 128
+
+#define NAME_LEN 12
+
+/* Missing from the status codes of the engine */
+#define RD_CONTINUE 95          /* 2.31 Continue */
+
+struct rd_client_stats rd_client_stats;
+
+static struct etimer timer;
+static clock_time_t retry;
+static uint16_t refresh_left; /* seconds to wait before the refresh */
+static uip_ipaddr_t rd_addr;
+static char links[LINKS_SIZE];
+static uint16_t links_len;
+static char query[40];
+static char room[NAME_LEN];
+static char location[8];     /* rd/<n> while registered */
+static uint8_t busy;         /* a request is waiting for its answer */
+static uint8_t room_changed;
+static uint8_t block;
+static uint8_t answer;       /* code of the last answer, 0 without one */
+
+PROCESS(rd_client_process, "RD client");
+
+/*---------------------------------------------------------------------------*/
+static void
+add_link(const char *url, const char *attributes)
+{
+  const char *start;
+  const char *p;
+  uint8_t quoted;
+  int len;
+
+  len = strlen(url) + 3;
+  if(links_len + (links_len > 0) + len > LINKS_SIZE) {
+    return;
+  }
+  links_len += snprintf(&links[links_len], LINKS_SIZE - links_len, "%s</%s>",
+                        links_len > 0 ? "," : "", url);
+
+  /* The attributes but the title, which only makes the payload longer */
+  quoted = 0;
+  for(start = p = attributes; ; p++) {
+    if(*p == '"') {
+      quoted = !quoted;
+    }
+    if(*p != '\0' && (*p != ';' || quoted)) {
+      continue;
+    }
+    len = p - start;
+    if(len > 0 && strncmp(start, "title=", 6) != 0 &&
+       links_len + 1 + len <= LINKS_SIZE) {
+      links[links_len++] = ';';
+      memcpy(&links[links_len], start, len);
+      links_len += len;
+    }
+    if(*p == '\0') {
+      break;
+    }
+    start = p + 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+build_links(void)
+{
+  resource_t *r;
+
+  links_len = 0;
+  for(r = (resource_t *)list_head(rest_get_resources()); r != NULL;
+      r = r->next) {
+    if(r->url[0] != '.') {
+      add_link(r->url, r->attributes);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+answered(void *data, void *response)
+{
+  const char *path;
+  int len;
+
+  answer = 0;
+  if(response != NULL) {
+    answer = ((coap_packet_t *)response)->code;
+    len = coap_get_header_location_path(response, &path);
+    if(answer == CREATED_2_01 && len > 0 && len < sizeof(location)) {
+      memcpy(location, path, len);
+      location[len] = '\0';
+    }
+  }
+  process_poll(&rd_client_process);
+}
+/*---------------------------------------------------------------------------*/
+/* POST on rd, piece block of the links, or on the registration */
+static void
+send_request(void)
+{
+  coap_packet_t request[1];
+  coap_transaction_t *t;
+  uint16_t mid;
+  uint16_t offset;
+
+  mid = coap_get_mid();
+  t = coap_new_transaction(mid, &rd_addr, UIP_HTONS(COAP_DEFAULT_PORT));
+  if(t == NULL) {
+    answer = 0;
+    process_poll(&rd_client_process);
+    return;
+  }
+  coap_init_message(request, COAP_TYPE_CON, COAP_POST, mid);
+  if(location[0] != '\0') {
+    coap_set_header_uri_path(request, location);
+  } else {
+    coap_set_header_uri_path(request, RD_PATH);
+    offset = block * RD_CLIENT_BLOCK;
+    coap_set_header_block1(request, block,
+                           offset + RD_CLIENT_BLOCK < links_len,
+                           RD_CLIENT_BLOCK);
+    coap_set_payload(request, &links[offset],
+                     links_len - offset < RD_CLIENT_BLOCK ?
+                     links_len - offset : RD_CLIENT_BLOCK);
+  }
+  coap_set_header_uri_query(request, query);
+  t->callback = answered;
+  t->packet_len = coap_serialize_message(request, t->packet);
+  coap_send_transaction(t);
+  busy = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start(void)
+{
+  rpl_dag_t *dag;
+
+  dag = rpl_get_any_dag();
+  if(dag == NULL || uip_ds6_defrt_choose() == NULL) {
+    etimer_set(&timer, RETRY_MIN);
+    return;
+  }
+  uip_ipaddr_copy(&rd_addr, &dag->dag_id);
+  if(room_changed) {
+    room_changed = 0;
+    location[0] = '\0';
+  }
+  if(location[0] != '\0') {
+    snprintf(query, sizeof(query), "lt=%u", RD_CLIENT_LIFETIME);
+  } else {
+    build_links();
+    snprintf(query, sizeof(query), "ep=tstat-%x%02x&lt=%u&room=%s",
+             uip_lladdr.addr[6], uip_lladdr.addr[7], RD_CLIENT_LIFETIME,
+             room);
+    block = 0;
+  }
+  send_request();
+}
+/*---------------------------------------------------------------------------*/
+static void
+wait_refresh(void)
+{
+  uint16_t piece;
+
+  piece = refresh_left > MAX_WAIT ? MAX_WAIT : refresh_left;
+  refresh_left -= piece;
+  etimer_set(&timer, (clock_time_t)piece * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+static void
+done(void)
+{
+  busy = 0;
+
+  if(location[0] == '\0' && answer == RD_CONTINUE &&
+     (block + 1) * RD_CLIENT_BLOCK < links_len) {
+    block++;
+    send_request();
+    return;
+  }
+  if(answer == CREATED_2_01 || answer == CHANGED_2_04) {
+    if(answer == CREATED_2_01) {
+      rd_client_stats.registrations++;
+      PRINTF("rd-client: registered as %s\n", location);
+    } else {
+      rd_client_stats.refreshes++;
+    }
+    rd_client_stats.registered = 1;
+    retry = RETRY_MIN;
+    if(room_changed) {
+      etimer_set(&timer, 1);
+    } else {
+      refresh_left = RD_CLIENT_LIFETIME / 2;
+      wait_refresh();
+    }
+    return;
+  }
+
+  rd_client_stats.failures++;
+  if(answer == NOT_FOUND_4_04) {
+    /* The router lost the registration */
+    location[0] = '\0';
+    rd_client_stats.registered = 0;
+    etimer_set(&timer, 1);
+    return;
+  }
+  PRINTF("rd-client: no registration (%u), again in %u s\n", answer,
+         (unsigned)(retry / CLOCK_SECOND));
+  etimer_set(&timer, retry);
+  if(retry < RETRY_MAX) {
+    retry *= 2;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rd_client_process, ev, data)
+{
+  const char *line;
+
+  PROCESS_BEGIN();
+
+  snprintf(room, sizeof(room), "room%u", uip_lladdr.addr[7]);
+  retry = RETRY_MIN;
+  etimer_set(&timer, RETRY_MIN);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == serial_line_event_message) {
+      line = data;
+      if(strncmp(line, "room ", 5) == 0 && strlen(line + 5) < NAME_LEN &&
+         line[5] != '\0') {
+        strcpy(room, line + 5);
+        room_changed = 1;
+        if(!busy) {
+          refresh_left = 0;
+          etimer_set(&timer, 1);
+        }
+      }
+    } else if(ev == PROCESS_EVENT_TIMER && data == &timer && !busy) {
+      if(refresh_left > 0) {
+        wait_refresh();
+      } else {
+        start();
+      }
+    } else if(ev == PROCESS_EVENT_POLL && busy) {
+      done();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+rd_client_init(void)
+{
+  process_start(&rd_client_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,79 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Registration with the resource directory of the border router
+ *
+ *         Once the mote has a default route, it registers its resources at
+ *         coap://[DODAG ID]/rd (see rpl-border-router/br-rd.h). The query
+ *         gives its endpoint name (tstat-<last two bytes of the link-layer
+ *         address>), lifetime and room; the payload lists its resources in
+ *         link format without their titles, in Block1 pieces of
+ *         RD_CLIENT_BLOCK bytes so that each request fits a frame. The
+ *         registration is refreshed at half its lifetime. When the router
+ *         has lost it (reboot, expiry) the mote registers again, and when
+ *         the router does not answer it tries again with a doubling delay.
+ *
+ *         The room is "room<Cooja mote ID>" at boot; a line "room <name>"
+ *         on the serial line (write(mote, "room kitchen") from a Cooja
+ *         script) changes it and registers again right away.
+ */
+
+#ifndef __RD_CLIENT_H__
+#define __RD_CLIENT_H__
+
+#include "contiki.h"
+
+/* Seconds, at most 1000 for the refresh timer */
+#ifdef RD_CLIENT_CONF_LIFETIME
+#define RD_CLIENT_LIFETIME RD_CLIENT_CONF_LIFETIME
+#else
+#define RD_CLIENT_LIFETIME 600
+#endif
+
+/* Payload bytes per Block1 piece: 16, 32 or 64 */
+#ifdef RD_CLIENT_CONF_BLOCK
+#define RD_CLIENT_BLOCK RD_CLIENT_CONF_BLOCK
+#else
+#define RD_CLIENT_BLOCK 32
+#endif
+
+struct rd_client_stats {
+  uint16_t registrations; /* 2.01 from the router */
+  uint16_t refreshes;     /* 2.04 from the router */
+  uint16_t failures;      /* no answer or an error */
+  uint8_t registered;
+};
+
+extern struct rd_client_stats rd_client_stats;
+
+/* Starts registering; the resources must be active. */
+void rd_client_init(void);
+
+#endif /* __RD_CLIENT_H__ */
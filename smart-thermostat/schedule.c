@@ -0,0 +1,411 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Weekly setpoint program of the thermostat, kept in flash
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/crc16.h"
+#include "schedule.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#ifndef SCHEDULE_CONF_FILENAME
+#define SCHEDULE_FILENAME "sched"
+#else
+#define SCHEDULE_FILENAME SCHEDULE_CONF_FILENAME
+#endif
+
+/* Bumped whenever struct schedule_record changes layout. */
+#define SCHEDULE_MAGIC 0x5C
+
+/* A transition: quarter hour of the week (0-671) and setpoint (0-60) */
+#define ENTRY(slot, setpoint) (((uint16_t)(slot) << 6) | (setpoint))
+#define ENTRY_SLOT(e)         ((e) >> 6)
+#define ENTRY_SETPOINT(e)     ((e) & 0x3f)
+#define ENTRY_SECOND(e)       (ENTRY_SLOT(e) * SCHEDULE_SLOT)
+
+#define SLOTS_PER_HOUR 4
+#define SLOTS_PER_DAY  (24 * SLOTS_PER_HOUR)
+
+struct schedule_record {
+  uint8_t magic;
+  uint8_t count;
+  uint16_t program[SCHEDULE_TRANSITIONS];
+  uint16_t crc;
+};
+
+static uint16_t program[SCHEDULE_TRANSITIONS];
+static uint8_t count;
+static uint8_t current;               /* transition in effect */
+static unsigned long deadline;        /* clock_seconds() of the next one */
+static struct ctimer timer;
+static schedule_callback_t callback;
+
+static uint8_t time_known;
+static uint32_t week_base;            /* second of the week at boot */
+
+/* Upload in progress */
+static uint16_t upload[SCHEDULE_TRANSITIONS];
+static uint8_t upload_count;
+static uint8_t upload_error;
+static uint8_t field;                 /* day, hour, minute, setpoint */
+static uint8_t digits;
+static uint8_t values[4];
+/*---------------------------------------------------------------------------*/
+static uint32_t
+week_now(void)
+{
+  return (week_base + clock_seconds() % SCHEDULE_WEEK) % SCHEDULE_WEEK;
+}
+/*---------------------------------------------------------------------------*/
+/* Seconds from transition i to the next one, a whole week if alone */
+static uint32_t
+gap(uint8_t i)
+{
+  uint8_t next = (i + 1) % count;
+  uint32_t left;
+
+  left = (ENTRY_SECOND(program[next]) + SCHEDULE_WEEK -
+          ENTRY_SECOND(program[i])) % SCHEDULE_WEEK;
+  return left == 0 ? SCHEDULE_WEEK : left;
+}
+/*---------------------------------------------------------------------------*/
+static void expired(void *ptr);
+
+static void
+arm(void)
+{
+  long left = (long)(deadline - clock_seconds());
+
+  if(left < 0) {
+    left = 0;
+  } else if(left > SCHEDULE_MAX_SLEEP) {
+    left = SCHEDULE_MAX_SLEEP;
+  }
+  ctimer_set(&timer, (clock_time_t)left * CLOCK_SECOND, expired, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+expired(void *ptr)
+{
+  (void)ptr;
+  if((long)(clock_seconds() - deadline) >= 0) {
+    /* Constant time: the next transition is the next entry */
+    current = (current + 1) % count;
+    deadline += gap(current);
+    PRINTF("schedule: transition %u, setpoint %u\n", current,
+           ENTRY_SETPOINT(program[current]));
+    callback(ENTRY_SETPOINT(program[current]));
+  }
+  arm();
+}
+/*---------------------------------------------------------------------------*/
+/* Find the transition in effect and arm the timer for the next one */
+static void
+start(void)
+{
+  uint32_t now;
+  uint8_t i;
+
+  ctimer_stop(&timer);
+  if(!time_known || count == 0) {
+    callback(SCHEDULE_OFF);
+    return;
+  }
+  now = week_now();
+  current = count - 1;
+  for(i = 0; i < count && ENTRY_SECOND(program[i]) <= now; i++) {
+    current = i;
+  }
+  deadline = clock_seconds() +
+    (ENTRY_SECOND(program[(current + 1) % count]) + SCHEDULE_WEEK - now) %
+    SCHEDULE_WEEK;
+  if(deadline == clock_seconds()) {
+    deadline += SCHEDULE_WEEK;
+  }
+  callback(ENTRY_SETPOINT(program[current]));
+  arm();
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+record_crc(const struct schedule_record *record)
+{
+  return crc16_data((const unsigned char *)record,
+                    offsetof(struct schedule_record, crc), 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+load(void)
+{
+  struct schedule_record record;
+  int fd;
+  int len;
+
+  fd = cfs_open(SCHEDULE_FILENAME, CFS_READ);
+  if(fd < 0) {
+    PRINTF("schedule: no stored program\n");
+    return;
+  }
+  len = cfs_read(fd, &record, sizeof(record));
+  cfs_close(fd);
+
+  if(len != sizeof(record) || record.magic != SCHEDULE_MAGIC ||
+     record.count > SCHEDULE_TRANSITIONS || record.crc != record_crc(&record)) {
+    PRINTF("schedule: stored program is invalid\n");
+    return;
+  }
+  count = record.count;
+  memcpy(program, record.program, sizeof(program));
+}
+/*---------------------------------------------------------------------------*/
+static int
+save(void)
+{
+  struct schedule_record record;
+  int fd;
+  int len;
+
+  memset(&record, 0, sizeof(record));
+  record.magic = SCHEDULE_MAGIC;
+  record.count = count;
+  memcpy(record.program, program, sizeof(program));
+  record.crc = record_crc(&record);
+
+  /* Fixed size, so that rewrites go through Coffee's micro log */
+  cfs_coffee_reserve(SCHEDULE_FILENAME, sizeof(record));
+  fd = cfs_open(SCHEDULE_FILENAME, CFS_WRITE);
+  if(fd < 0) {
+    PRINTF("schedule: could not open %s\n", SCHEDULE_FILENAME);
+    return 0;
+  }
+  len = cfs_write(fd, &record, sizeof(record));
+  cfs_close(fd);
+  return len == sizeof(record);
+}
+/*---------------------------------------------------------------------------*/
+void
+schedule_init(schedule_callback_t cb)
+{
+  callback = cb;
+  load();
+  PRINTF("schedule: %u transitions, waiting for the time\n", count);
+}
+/*---------------------------------------------------------------------------*/
+void
+schedule_set_time(uint32_t second)
+{
+  week_base = (second % SCHEDULE_WEEK + SCHEDULE_WEEK -
+               clock_seconds() % SCHEDULE_WEEK) % SCHEDULE_WEEK;
+  time_known = 1;
+  start();
+}
+/*---------------------------------------------------------------------------*/
+int
+schedule_parse_time(const char *text, int len, uint32_t *second)
+{
+  uint32_t v[4] = { 0, 0, 0, 0 };
+  uint8_t n = 0;
+  uint8_t d = 0;
+
+  for(; len > 0; text++, len--) {
+    if(*text >= '0' && *text <= '9' && d < 2) {
+      v[n] = v[n] * 10 + *text - '0';
+      d++;
+    } else if(*text == ':' && d > 0 && n < 3) {
+      n++;
+      d = 0;
+    } else {
+      return -1;
+    }
+  }
+  if(n < 2 || d == 0 || v[0] > 6 || v[1] > 23 || v[2] > 59 || v[3] > 59) {
+    return -1;
+  }
+  *second = ((v[0] * 24 + v[1]) * 60 + v[2]) * 60 + v[3];
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+schedule_upload_begin(void)
+{
+  upload_count = 0;
+  upload_error = 0;
+  field = 0;
+  digits = 0;
+  memset(values, 0, sizeof(values));
+}
+/*---------------------------------------------------------------------------*/
+/* End of a "D:HH:MM=T" */
+static void
+add_transition(void)
+{
+  if(field != 3 || digits == 0 || values[0] > 6 || values[1] > 23 ||
+     values[2] > 59 || values[2] % 15 != 0 ||
+     values[3] > SCHEDULE_MAX_SETPOINT ||
+     upload_count == SCHEDULE_TRANSITIONS) {
+    upload_error = 1;
+    return;
+  }
+  upload[upload_count++] = ENTRY(values[0] * SLOTS_PER_DAY +
+                                 values[1] * SLOTS_PER_HOUR + values[2] / 15,
+                                 values[3]);
+  field = 0;
+  digits = 0;
+  memset(values, 0, sizeof(values));
+}
+/*---------------------------------------------------------------------------*/
+int
+schedule_upload_feed(const char *text, int len)
+{
+  char c;
+
+  for(; len > 0 && !upload_error; text++, len--) {
+    c = *text;
+    if(c >= '0' && c <= '9' && digits < 2) {
+      values[field] = values[field] * 10 + c - '0';
+      digits++;
+    } else if(c == ':' && field < 2 && digits > 0) {
+      field++;
+      digits = 0;
+    } else if(c == '=' && field == 2 && digits > 0) {
+      field++;
+      digits = 0;
+    } else if(c == ';' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+      if(field > 0 || digits > 0) {
+        add_transition();
+      }
+    } else {
+      upload_error = 1;
+    }
+  }
+  return upload_error ? -1 : 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+schedule_upload_end(void)
+{
+  uint16_t e;
+  uint8_t i, j, n;
+
+  if(field > 0 || digits > 0) {
+    add_transition();
+  }
+  if(upload_error) {
+    return -1;
+  }
+  /* Sort by time; of two transitions at the same time, the later wins */
+  for(i = 1; i < upload_count; i++) {
+    e = upload[i];
+    for(j = i; j > 0 && ENTRY_SLOT(upload[j - 1]) > ENTRY_SLOT(e); j--) {
+      upload[j] = upload[j - 1];
+    }
+    upload[j] = e;
+  }
+  for(i = 0, n = 0; i < upload_count; i++) {
+    if(n > 0 && ENTRY_SLOT(program[n - 1]) == ENTRY_SLOT(upload[i])) {
+      n--;
+    }
+    program[n++] = upload[i];
+  }
+  count = n;
+  memset(program + n, 0, sizeof(program) - n * sizeof(program[0]));
+  PRINTF("schedule: new program, %u transitions\n", count);
+  if(!save()) {
+    PRINTF("schedule: not stored\n");
+  }
+  start();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+schedule_setpoint(void)
+{
+  return time_known && count > 0 ? ENTRY_SETPOINT(program[current])
+                                 : SCHEDULE_OFF;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+schedule_transitions(void)
+{
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/* Transition i in text form, with the separator before it */
+static int
+entry_text(char *buf, uint8_t i)
+{
+  uint16_t slot = ENTRY_SLOT(program[i]);
+
+  return sprintf(buf, "%s%u:%02u:%02u=%u", i > 0 ? ";" : "",
+                 slot / SLOTS_PER_DAY, slot % SLOTS_PER_DAY / SLOTS_PER_HOUR,
+                 slot % SLOTS_PER_HOUR * 15, ENTRY_SETPOINT(program[i]));
+}
+/*---------------------------------------------------------------------------*/
+int
+schedule_text_length(void)
+{
+  char entry[16];
+  int total = 0;
+  uint8_t i;
+
+  for(i = 0; i < count; i++) {
+    total += entry_text(entry, i);
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+int
+schedule_text(char *buf, int len, int offset)
+{
+  char entry[16];
+  int pos = 0;
+  int copied = 0;
+  int n, k;
+  uint8_t i;
+
+  for(i = 0; i < count && copied < len; i++) {
+    n = entry_text(entry, i);
+    for(k = 0; k < n && copied < len; k++, pos++) {
+      if(pos >= offset) {
+        buf[copied++] = entry[k];
+      }
+    }
+  }
+  return copied;
+}
+/*---------------------------------------------------------------------------*/
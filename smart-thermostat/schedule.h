@@ -0,0 +1,98 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Weekly setpoint program of the thermostat, kept in flash
+ *
+ *         A program is a list of transitions, each a quarter hour of the
+ *         week and the setpoint that applies from then on, packed in 16
+ *         bits and sorted. Since the week repeats, the transition after
+ *         the current one is always the next entry (or the first), so it
+ *         is found in constant time and a single timer is armed for it;
+ *         the mote does nothing in between (the 16-bit clock cannot wait
+ *         long, so a long wait is cut into SCHEDULE_MAX_SLEEP pieces).
+ *         The program is stored in a Coffee file and comes back at boot,
+ *         but runs only once the time of the week is known again (set
+ *         with schedule_set_time()).
+ *
+ *         The text form, for upload and download, is a list of
+ *         "D:HH:MM=T" separated by ';', spaces or newlines: D is the day
+ *         (0 Monday to 6 Sunday), MM a multiple of 15 and T the setpoint,
+ *         0 to give the control back to /leds.
+ */
+
+#ifndef __SCHEDULE_H__
+#define __SCHEDULE_H__
+
+#include "contiki.h"
+
+#ifdef SCHEDULE_CONF_TRANSITIONS
+#define SCHEDULE_TRANSITIONS SCHEDULE_CONF_TRANSITIONS
+#else
+#define SCHEDULE_TRANSITIONS 32
+#endif
+
+#ifdef SCHEDULE_CONF_MAX_SLEEP
+#define SCHEDULE_MAX_SLEEP SCHEDULE_CONF_MAX_SLEEP
+#else
+#define SCHEDULE_MAX_SLEEP 240    /* seconds */
+#endif
+
+#define SCHEDULE_OFF     0        /* setpoint that leaves the actuators alone */
+#define SCHEDULE_MAX_SETPOINT 60
+#define SCHEDULE_SLOT    (15 * 60UL)
+#define SCHEDULE_WEEK    (7 * 24 * 60 * 60UL)
+
+/* Called on every transition, and when a new program or time takes effect */
+typedef void (*schedule_callback_t)(uint8_t setpoint);
+
+/* Load the stored program */
+void schedule_init(schedule_callback_t callback);
+
+/* Second of the week now, 0 being Monday 00:00 */
+void schedule_set_time(uint32_t second);
+
+/* Parse "D:HH:MM[:SS]" into a second of the week. Returns 0 on success. */
+int schedule_parse_time(const char *text, int len, uint32_t *second);
+
+/* An upload replaces the program once schedule_upload_end() has checked
+   and stored it; the text may be fed in pieces of any size. */
+void schedule_upload_begin(void);
+int schedule_upload_feed(const char *text, int len);
+int schedule_upload_end(void);
+
+/* Setpoint in effect, SCHEDULE_OFF without a program or the time */
+uint8_t schedule_setpoint(void);
+uint8_t schedule_transitions(void);
+
+/* The text form: its length, and len bytes of it from offset */
+int schedule_text_length(void);
+int schedule_text(char *buf, int len, int offset);
+
+#endif /* __SCHEDULE_H__ */
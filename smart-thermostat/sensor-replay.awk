@@ -0,0 +1,73 @@
+# Turns a temperature trace into the table of sensor-replay.c, run by the
+# Makefile for REPLAY_TRACE=file.csv.
+#
+# Input: lines "time,mote,temperature", time in seconds from any origin and
+# never going back, mote the last byte of the link-layer address (the Cooja
+# mote ID) or 0 for every mote without samples of its own, temperature in
+# degrees Celsius, rounded. Lines that do not start with a number, such as
+# a header, are skipped. Times are kept in units of unit seconds (default
+# 1), at most 65535 of them.
+
+BEGIN {
+  FS = ","
+  if(unit == "") {
+    unit = 1
+  }
+  n = 0
+  failed = 0
+}
+
+$1 !~ /^[ \t]*[0-9]+(\.[0-9]*)?[ \t]*$/ {
+  next
+}
+
+{
+  t = $1 + 0
+  if(n == 0) {
+    start = t
+  } else if(t < last) {
+    printf("%s:%d: time goes back\n", FILENAME, FNR) > "/dev/stderr"
+    failed = 1
+    exit 1
+  }
+  if(t > last) {
+    gap = t - last
+  }
+  last = t
+  time = int((t - start) / unit)
+  temp = int($3 + 0.5)
+  if(time > 65535) {
+    printf("%s:%d: trace too long, set REPLAY_UNIT\n", FILENAME, FNR) > "/dev/stderr"
+    failed = 1
+    exit 1
+  }
+  if(temp < 1 || temp > 255 || $2 + 0 > 255) {
+    printf("%s:%d: bad mote or temperature\n", FILENAME, FNR) > "/dev/stderr"
+    failed = 1
+    exit 1
+  }
+  rows[n++] = sprintf("  { %u, %u, %u },", time, $2 + 0, temp)
+}
+
+END {
+  if(failed) {
+    exit 1
+  }
+  if(n == 0) {
+    printf("%s: no samples\n", FILENAME) > "/dev/stderr"
+    exit 1
+  }
+  # The last sample lasts as long as the one before it
+  span = int((last - start + gap) / unit)
+  if(span < 1) {
+    span = 1
+  }
+  printf("/* Generated from %s by sensor-replay.awk, do not edit */\n", FILENAME)
+  printf("#define SENSOR_REPLAY_UNIT %uUL\n", unit)
+  printf("#define SENSOR_REPLAY_SPAN %uUL\n", span)
+  printf("static const struct sensor_replay_sample sensor_replay_trace[] = {\n")
+  for(i = 0; i < n; i++) {
+    print rows[i]
+  }
+  printf("};\n")
+}
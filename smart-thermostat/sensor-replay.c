@@ -0,0 +1,150 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Replay of recorded temperature traces
+ */
+
+#include "contiki.h"
+#include "net/rime/rimeaddr.h"
+#include "dev/serial-line.h"
+#include "sensor-replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#ifndef SENSOR_REPLAY_CONF_TRACE
+#define SENSOR_REPLAY_CONF_TRACE 0
+#endif
+
+#if SENSOR_REPLAY_CONF_TRACE
+/* Generated by the Makefile from REPLAY_TRACE */
+#include "sensor-replay-trace.h"
+
+#define SAMPLES (sizeof(sensor_replay_trace) / sizeof(sensor_replay_trace[0]))
+
+/* Mote of the samples followed: this one, or 0 */
+static uint8_t mote;
+#endif /* SENSOR_REPLAY_CONF_TRACE */
+
+/* Set over the serial line */
+static int serial_temp = SENSOR_REPLAY_NONE;
+
+PROCESS(sensor_replay_process, "Sensor replay");
+
+/*---------------------------------------------------------------------------*/
+#if SENSOR_REPLAY_CONF_TRACE
+static int
+trace_temp(void)
+{
+  const struct sensor_replay_sample *s;
+  unsigned long now;
+  int temp = SENSOR_REPLAY_NONE;
+  uint16_t i;
+
+  now = clock_seconds() / SENSOR_REPLAY_UNIT % SENSOR_REPLAY_SPAN;
+  for(i = 0; i < SAMPLES; i++) {
+    s = &sensor_replay_trace[i];
+    if(s->mote != mote) {
+      continue;
+    }
+    /* Before its first sample, the mote starts from it */
+    if(s->time > now && temp != SENSOR_REPLAY_NONE) {
+      break;
+    }
+    temp = s->temp;
+  }
+  return temp;
+}
+#endif /* SENSOR_REPLAY_CONF_TRACE */
+/*---------------------------------------------------------------------------*/
+int
+sensor_replay_temp(void)
+{
+  if(serial_temp != SENSOR_REPLAY_NONE) {
+    return serial_temp;
+  }
+#if SENSOR_REPLAY_CONF_TRACE
+  return trace_temp();
+#else
+  return SENSOR_REPLAY_NONE;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
+sensor_replay_init(void)
+{
+#if SENSOR_REPLAY_CONF_TRACE
+  uint16_t i;
+
+  mote = 0;
+  for(i = 0; i < SAMPLES; i++) {
+    if(sensor_replay_trace[i].mote ==
+       rimeaddr_node_addr.u8[RIMEADDR_SIZE - 1]) {
+      mote = sensor_replay_trace[i].mote;
+      break;
+    }
+  }
+  PRINTF("sensor-replay: %u samples, following mote %u\n",
+         (unsigned)SAMPLES, mote);
+#endif
+  process_start(&sensor_replay_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sensor_replay_process, ev, data)
+{
+  const char *line;
+  int temp;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == serial_line_event_message);
+    line = data;
+    if(strncmp(line, "replay ", 7) != 0) {
+      continue;
+    }
+    line += 7;
+    if(strcmp(line, "off") == 0) {
+      serial_temp = SENSOR_REPLAY_NONE;
+    } else {
+      temp = atoi(line);
+      if(temp > 0 && temp <= 255) {
+        serial_temp = temp;
+      }
+    }
+    PRINTF("sensor-replay: serial %d\n", serial_temp);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
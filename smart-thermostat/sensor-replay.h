@@ -0,0 +1,69 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Replay of recorded temperature traces
+ *
+ *         Instead of the random start and the drift driven by the
+ *         actuators alone, the temperature of the room follows a recorded
+ *         trace, the same at every run. A trace built into the firmware
+ *         (make WITH_REPLAY=1 REPLAY_TRACE=file.csv) holds samples for
+ *         several motes, picked by the last byte of the link-layer address
+ *         (the Cooja mote ID); mote 0 stands for all those without samples
+ *         of their own. Each sample holds from its time after boot until
+ *         the next one, and the trace starts over when it ends.
+ *
+ *         A line "replay <temperature>" on the serial line sets the
+ *         temperature until the next one, ahead of the built-in trace, so
+ *         that a Cooja script or a host can feed a trace of any length;
+ *         "replay off" goes back to the built-in trace.
+ */
+
+#ifndef __SENSOR_REPLAY_H__
+#define __SENSOR_REPLAY_H__
+
+#include "contiki.h"
+
+#define SENSOR_REPLAY_NONE (-1)
+
+/* A row of the table generated from the trace by sensor-replay.awk */
+struct sensor_replay_sample {
+  uint16_t time;          /* units of SENSOR_REPLAY_UNIT s from the start */
+  uint8_t mote;
+  uint8_t temp;
+};
+
+/* Starts listening on the serial line */
+void sensor_replay_init(void);
+
+/* Temperature of the room now, SENSOR_REPLAY_NONE if there is no trace
+   for this mote */
+int sensor_replay_temp(void);
+
+#endif /* __SENSOR_REPLAY_H__ */
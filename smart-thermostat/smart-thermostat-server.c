@@ -42,6 +42,45 @@
 #define PLATFORM_HAS_SHT11 1
 #define PLATFORM_HAS_LEDS 1
 
+/* Weekly setpoint program in flash (make WITH_SCHEDULE=1) */
+#ifndef REST_RES_SCHEDULE
+#define REST_RES_SCHEDULE 0
+#endif
+
+/* State restored from flash at boot (make WITH_PERSIST=1) */
+#ifndef THERMOSTAT_CONF_PERSIST
+#define THERMOSTAT_CONF_PERSIST 0
+#endif
+
+/* Notifications in a slot of the period, spread over the motes by the
+   border router (make WITH_SLOTS=1) */
+#ifndef THERMOSTAT_CONF_SLOTTED
+#define THERMOSTAT_CONF_SLOTTED 0
+#endif
+
+/* Readings also sent up merged with those of the neighbours, for the
+   border router (make WITH_MESH_AGG=1) */
+#ifndef THERMOSTAT_CONF_MESH_AGG
+#define THERMOSTAT_CONF_MESH_AGG 0
+#endif
+
+/* Aggressive DIS at boot and announcement to the border router once
+   routable (make WITH_FAST_JOIN=1) */
+#ifndef THERMOSTAT_CONF_FAST_JOIN
+#define THERMOSTAT_CONF_FAST_JOIN 0
+#endif
+
+/* Resources registered with the directory of the border router
+   (make WITH_RD=1) */
+#ifndef THERMOSTAT_CONF_RD
+#define THERMOSTAT_CONF_RD 0
+#endif
+
+/* Temperature replayed from a recorded trace (make WITH_REPLAY=1) */
+#ifndef THERMOSTAT_CONF_REPLAY
+#define THERMOSTAT_CONF_REPLAY 0
+#endif
+
 #include "erbium.h"
 
 #if defined (PLATFORM_HAS_LEDS)
@@ -64,6 +103,29 @@
 #warning "Erbium without CoAP-specifc functionality"
 #endif
 
+#if REST_RES_SCHEDULE
+#include "schedule.h"
+#endif
+#if THERMOSTAT_CONF_PERSIST
+#include "thermostat-state.h"
+#endif
+#if THERMOSTAT_CONF_SLOTTED
+#include "notify-slot.h"
+#endif
+#if THERMOSTAT_CONF_MESH_AGG
+#include "mesh-agg.h"
+#endif
+#if THERMOSTAT_CONF_REPLAY
+#include "sensor-replay.h"
+#endif
+#if THERMOSTAT_CONF_FAST_JOIN
+#include "fast-join.h"
+#endif
+#if THERMOSTAT_CONF_RD
+#include "rd-client.h"
+#endif
+#include "coap-fit.h"
+
 
 #define DEBUG 1
 #if DEBUG
@@ -76,6 +138,10 @@
 #define PRINTLLADDR(addr)
 #endif
 
+#ifndef UIP_IP_BUF
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#endif
+
 // Limit for the random number generator (used for temperature)
 const int rand_max = 20;
 
@@ -93,6 +159,157 @@ typedef struct thermostat {
 
 static t_thermostat thermostat_status;
 
+#if REST_RES_SCHEDULE
+/* Set by a POST on /leds: the user overrides the program until its next
+   transition */
+static uint8_t setpoint_held;
+#endif
+
+// Period of the thermostat internal logic, the temperature only changes at its expiration
+#define CONTROL_INTERVAL (CLOCK_SECOND * 20)
+static struct etimer control_timer;
+
+// Max-Age of the status: it only changes on a POST, proxies may cache it briefly
+#define STATUS_MAX_AGE 10
+
+/* Seconds until the next temperature update, used as Max-Age so that
+   caches (e.g. the border router proxy) never serve a stale value. */
+static uint32_t
+temp_max_age(void)
+{
+  clock_time_t left;
+
+  if(etimer_expired(&control_timer)) {
+    return 1;
+  }
+  left = etimer_expiration_time(&control_timer) - clock_time();
+  return (left + CLOCK_SECOND - 1) / CLOCK_SECOND;
+}
+
+#if defined (PLATFORM_HAS_LEDS)
+/* Show the actuators on the LEDs, as leds_handler does */
+static void
+show_actuators(void)
+{
+  if(thermostat_status.heating) {
+    leds_on(LEDS_RED);
+  } else {
+    leds_off(LEDS_RED);
+  }
+  if(thermostat_status.ventilation) {
+    leds_on(LEDS_GREEN);
+  } else {
+    leds_off(LEDS_GREEN);
+  }
+  if(thermostat_status.air_conditioning) {
+    leds_on(LEDS_BLUE);
+  } else {
+    leds_off(LEDS_BLUE);
+  }
+}
+#endif /* PLATFORM_HAS_LEDS */
+
+#if THERMOSTAT_CONF_PERSIST
+/* Have the state written to flash; writes are batched in
+   thermostat-state.c, so this can be called on every change */
+static void
+persist(void)
+{
+  struct thermostat_state state;
+
+  state.heating = thermostat_status.heating;
+  state.air_conditioning = thermostat_status.air_conditioning;
+  state.ventilation = thermostat_status.ventilation;
+  state.flags = 0;
+#if REST_RES_SCHEDULE
+  if(setpoint_held) {
+    state.flags |= THERMOSTAT_STATE_HELD;
+  }
+#endif
+  state.temp = thermostat_status.temp;
+  thermostat_state_save(&state);
+}
+
+/* Take up where the thermostat was before the reboot */
+static void
+restore(void)
+{
+  struct thermostat_state state;
+  clock_time_t start = clock_time();
+
+  if(!thermostat_state_restore(&state)) {
+    PRINTF("No stored state\n");
+    return;
+  }
+  thermostat_status.heating = state.heating;
+  thermostat_status.air_conditioning = state.air_conditioning;
+  thermostat_status.ventilation = state.ventilation;
+  thermostat_status.temp = state.temp;
+#if REST_RES_SCHEDULE
+  setpoint_held = (state.flags & THERMOSTAT_STATE_HELD) != 0;
+#endif
+#if defined (PLATFORM_HAS_LEDS)
+  show_actuators();
+#endif
+  PRINTF("State restored in %lu ms: temperature %u\n",
+         (unsigned long)(clock_time_t)(clock_time() - start) * 1000 / CLOCK_SECOND,
+         thermostat_status.temp);
+}
+#endif /* THERMOSTAT_CONF_PERSIST */
+
+#if THERMOSTAT_CONF_REPLAY
+/* What the actuators added to the replayed temperature */
+static int replay_offset;
+
+/* The room follows the trace, moved by the actuators as before */
+static void
+replay(void)
+{
+  int temp = sensor_replay_temp();
+
+  if(temp == SENSOR_REPLAY_NONE) {
+    return;
+  }
+  temp += replay_offset;
+  if(temp > max_sensing_temp) {
+    temp = max_sensing_temp;
+  } else if(temp < min_sensing_temp) {
+    temp = min_sensing_temp;
+  }
+  thermostat_status.temp = temp;
+}
+#endif /* THERMOSTAT_CONF_REPLAY */
+
+#if REST_RES_SCHEDULE
+/* Drive heating and conditioning towards the setpoint of the program */
+static void
+regulate(void)
+{
+  uint8_t setpoint = schedule_setpoint();
+
+  if(setpoint == SCHEDULE_OFF || setpoint_held) {
+    return;
+  }
+  thermostat_status.heating = thermostat_status.temp < setpoint;
+  thermostat_status.air_conditioning = thermostat_status.temp > setpoint;
+#if defined (PLATFORM_HAS_LEDS)
+  show_actuators();
+#endif
+}
+
+/* A transition of the program, or a new program or time */
+static void
+schedule_changed(uint8_t setpoint)
+{
+  PRINTF("Setpoint: %u\n", setpoint);
+  setpoint_held = 0;
+  regulate();
+#if THERMOSTAT_CONF_PERSIST
+  persist();
+#endif
+}
+#endif /* REST_RES_SCHEDULE */
+
 /******************************************************************************/
 /* GET method for requesting the current temperature of the sensor.
    The flag REST_RES_TEMP is set to 0, since the currently used method is the periodic one (COAP observe)
@@ -108,13 +325,16 @@ temperature_handler(void* request, void* response, uint8_t *buffer, uint16_t pre
      Currently the value is random and controlled in the code, since 
      we are doing a simulation of the sensor. */
   //uint16_t tempval = ((sht11_sensor.value(SHT11_SENSOR_TEMP) / 10) - 396) / 10;
+  struct coap_fit fit;
 
   PRINTF("temperature_handler: %u \n", thermostat_status.temp);
   
   // Response header and payload
   REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
-  snprintf((char *)buffer, REST_MAX_CHUNK_SIZE, "%u", thermostat_status.temp);
-  REST.set_response_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
+  REST.set_header_max_age(response, temp_max_age());
+  coap_fit_begin(&fit, buffer, preferred_size, *offset);
+  coap_fit_printf(&fit, "%u", thermostat_status.temp);
+  coap_fit_end(&fit, request, response, offset);
 }
 #endif /*REST_RES_TEMP*/
 
@@ -122,21 +342,43 @@ temperature_handler(void* request, void* response, uint8_t *buffer, uint16_t pre
 /* This GET method deals with a COAP observe request for observing the value of the temperature in intervals of 5s.
    The COAP request is sent in NodeRed when deployed and the method sends a payload containing the temperature every 5 seconds. */
 #if REST_RES_PUSHING
-PERIODIC_RESOURCE(tempobs, METHOD_GET, "temperature", "title=\"Temperature observe\";obs", 5*CLOCK_SECOND); //every 5 seconds
+#if THERMOSTAT_CONF_SLOTTED
+/* Same period, but notified in the slot of the mote (notify-slot.c) */
+EVENT_RESOURCE(tempobs, METHOD_GET, "temperature", "title=\"Temperature observe\";obs;rt=\"Data\"");
+#else
+PERIODIC_RESOURCE(tempobs, METHOD_GET, "temperature", "title=\"Temperature observe\";obs;rt=\"Data\"", 5*CLOCK_SECOND); //every 5 seconds
+#endif
 
 void
 tempobs_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
+  struct coap_fit fit;
+#if THERMOSTAT_CONF_FAST_JOIN
+  uint32_t observe;
+
+  if(coap_get_header_observe(request, &observe) && observe == 0) {
+    /* The answer to a registration is the first notification */
+    fast_join_notified();
+  }
+#endif
+
   PRINTF("tempobs_handler: %u \n", thermostat_status.temp);
   
   // Set response header and payload after the first request (i.e. after the subscribe)
   REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
-  snprintf((char *)buffer, REST_MAX_CHUNK_SIZE, "%u", thermostat_status.temp);
-  REST.set_response_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
+  REST.set_header_max_age(response, temp_max_age());
+  coap_fit_begin(&fit, buffer, preferred_size, *offset);
+  coap_fit_printf(&fit, "%u", thermostat_status.temp);
+  coap_fit_end(&fit, request, response, offset);
 }
 
+#if THERMOSTAT_CONF_SLOTTED
+void
+tempobs_event_handler(resource_t *r)
+#else
 void
 tempobs_periodic_handler(resource_t *r)
+#endif
 {
   static uint16_t obs_counter = 0;
   static char content[11];
@@ -148,12 +390,74 @@ tempobs_periodic_handler(resource_t *r)
   /* Build notification for the subscribers */
   coap_packet_t notification[1]; /* This way the packet can be treated as pointer as usual. */
   coap_init_message(notification, COAP_TYPE_NON, REST.status.OK, 0 );
+  coap_set_header_max_age(notification, temp_max_age());
   coap_set_payload(notification, content, snprintf(content, sizeof(content), "%u", thermostat_status.temp));
 
   /* Notify the registered observers with the given message type, observe option, and payload. */
   REST.notify_subscribers(r, obs_counter, notification);
+
+#if THERMOSTAT_CONF_MESH_AGG
+  /* The border router gets it through the parents instead */
+  mesh_agg_report(thermostat_status.temp, temp_max_age());
+#endif
 }
 
+#if THERMOSTAT_CONF_SLOTTED
+static void
+slot_expired(void)
+{
+  tempobs_event_handler(&resource_tempobs);
+}
+
+/* The slot is assigned by the border router with a POST of s (slot), n
+   (slots in the period) and t (ms since the period started). */
+RESOURCE(slot, METHOD_GET | METHOD_POST, "slot", "title=\"Notification slot: POST s=..&n=..&t=ms\"");
+
+static int
+post_number(void *request, const char *name, uint16_t *value)
+{
+  const char *text = NULL;
+  int len;
+  int i;
+
+  len = REST.get_post_variable(request, name, &text);
+  if(len == 0 || len > 5) {
+    return -1;
+  }
+  *value = 0;
+  for(i = 0; i < len; i++) {
+    if(text[i] < '0' || text[i] > '9') {
+      return -1;
+    }
+    *value = *value * 10 + (text[i] - '0');
+  }
+  return 0;
+}
+
+void
+slot_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  struct coap_fit fit;
+  uint16_t s, n, t;
+
+  if(REST.get_method_type(request) == METHOD_POST) {
+    if(post_number(request, "s", &s) < 0 || post_number(request, "n", &n) < 0 ||
+       post_number(request, "t", &t) < 0 || s > 255 || n > 255 ||
+       notify_slot_assign(s, n, t) < 0) {
+      PRINTF("slot_handler: bad assignment\n");
+      REST.set_response_status(response, REST.status.BAD_REQUEST);
+      REST.set_response_payload(response, "KO", 2);
+      return;
+    }
+    REST.set_response_status(response, REST.status.CHANGED);
+  }
+  REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+  coap_fit_begin(&fit, buffer, preferred_size, *offset);
+  coap_fit_printf(&fit, "%u/%u%s", notify_slot_slot(), notify_slot_slots(),
+                  notify_slot_assigned() ? "" : " address");
+  coap_fit_end(&fit, request, response, offset);
+}
+#endif /* THERMOSTAT_CONF_SLOTTED */
 #endif /* REST_RES_PUSHING */
 
 /********************** STATUS **************************/
@@ -166,12 +470,18 @@ RESOURCE(status, METHOD_GET, "status", "title=\"Thermostat status\";rt=\"Data\""
 void
 status_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
+  struct coap_fit fit;
+
   PRINTF("status_handler: heating %u, conditioning %u, ventilation %u\n", thermostat_status.heating, thermostat_status.air_conditioning, thermostat_status.ventilation);
   
-  // Response header and payload
+  // Response header and payload, block-wise if it does not fit in a frame
   REST.set_header_content_type(response, REST.type.APPLICATION_JSON);
-  snprintf((char *)buffer, REST_MAX_CHUNK_SIZE, "[{\"heating\": %u}, {\"conditioning\": %u}, {\"ventilation\": %u}]", 	thermostat_status.heating, thermostat_status.air_conditioning, thermostat_status.ventilation);
-  REST.set_response_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
+  REST.set_header_max_age(response, STATUS_MAX_AGE);
+  coap_fit_begin(&fit, buffer, preferred_size, *offset);
+  coap_fit_printf(&fit, "[{\"heating\": %u}, ", thermostat_status.heating);
+  coap_fit_printf(&fit, "{\"conditioning\": %u}, ", thermostat_status.air_conditioning);
+  coap_fit_printf(&fit, "{\"ventilation\": %u}]", thermostat_status.ventilation);
+  coap_fit_end(&fit, request, response, offset);
 }
 
 #endif /* REST_RES_STATUS */
@@ -188,6 +498,77 @@ status_handler(void* request, void* response, uint8_t *buffer, uint16_t preferre
    The method returns an error when the user tries to activate both air conditioning and heating. */
 RESOURCE(leds, METHOD_POST , "leds", "title=\"LEDs: ?color=r|g|b, POST mode=on|off\";rt=\"Control\"");
 
+/* Answers to the last commands, by client, message ID and token. A command
+   sent again because its ACK was lost gets the same answer without being
+   run a second time, which could toggle the LEDs again or, interleaved
+   with other commands, give another outcome of the mutual exclusion. */
+#ifdef LEDS_CONF_ANSWERS
+#define LEDS_ANSWERS LEDS_CONF_ANSWERS
+#else
+#define LEDS_ANSWERS 4
+#endif
+/* Seconds a message ID may be reused after, EXCHANGE_LIFETIME of CoAP */
+#define LEDS_ANSWER_LIFETIME 247
+
+#if LEDS_ANSWERS
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+struct leds_answer {
+  uip_ipaddr_t addr;
+  uint16_t port;               /* 0 if unused */
+  uint16_t mid;
+  uint8_t token_len;
+  uint8_t token[COAP_TOKEN_LEN];
+  uint8_t refused;
+  const char *msg;
+  unsigned long time;
+};
+
+static struct leds_answer leds_answers[LEDS_ANSWERS];
+
+static struct leds_answer *
+leds_answer_lookup(coap_packet_t *request)
+{
+  struct leds_answer *a;
+  int i;
+
+  for(i = 0; i < LEDS_ANSWERS; i++) {
+    a = &leds_answers[i];
+    if(a->port == UIP_UDP_BUF->srcport && a->mid == request->mid &&
+       a->token_len == request->token_len &&
+       memcmp(a->token, request->token, a->token_len) == 0 &&
+       uip_ipaddr_cmp(&a->addr, &UIP_IP_BUF->srcipaddr) &&
+       clock_seconds() - a->time < LEDS_ANSWER_LIFETIME) {
+      return a;
+    }
+  }
+  return NULL;
+}
+
+static void
+leds_answer_store(coap_packet_t *request, uint8_t refused, const char *msg)
+{
+  struct leds_answer *a;
+  int i;
+
+  /* A free entry, or the oldest */
+  a = &leds_answers[0];
+  for(i = 0; i < LEDS_ANSWERS && a->port != 0; i++) {
+    if(leds_answers[i].port == 0 || leds_answers[i].time < a->time) {
+      a = &leds_answers[i];
+    }
+  }
+  uip_ipaddr_copy(&a->addr, &UIP_IP_BUF->srcipaddr);
+  a->port = UIP_UDP_BUF->srcport;
+  a->mid = request->mid;
+  a->token_len = request->token_len;
+  memcpy(a->token, request->token, request->token_len);
+  a->refused = refused;
+  a->msg = msg;
+  a->time = clock_seconds();
+}
+#endif /* LEDS_ANSWERS */
+
 void
 leds_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
@@ -197,6 +578,22 @@ leds_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_
   uint8_t led = 0;
   int success = 1;
   uint8_t* unit_type_p = NULL; // pointer to the type of engine (heating, air conditioning, ventilation) that is the object of the request
+#if LEDS_ANSWERS
+  struct leds_answer *answer;
+
+  // A retransmission of a command already run is only answered again
+  answer = leds_answer_lookup((coap_packet_t *)request);
+  if(answer != NULL) {
+    PRINTF("leds_handler: duplicate %u\n", answer->mid);
+    if(answer->refused) {
+      REST.set_response_status(response, REST.status.NOT_ACCEPTABLE);
+    } else {
+      REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+    }
+    REST.set_response_payload(response, answer->msg, strlen(answer->msg));
+    return;
+  }
+#endif
   
   /* Retrieve the query variable for color */
   size_t query_variable = REST.get_query_variable(request, "color", &color);
@@ -263,14 +660,126 @@ leds_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_
     REST.set_response_payload(response, msg, strlen(msg));
   } else if (success) {
     PRINTF("leds_handler: request ok\n", query_variable, color, mode);
+#if REST_RES_SCHEDULE
+    setpoint_held = 1;
+#endif
+#if THERMOSTAT_CONF_PERSIST
+    persist();
+#endif
     REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
     REST.set_response_payload(response, msg, strlen(msg));
   }
+#if LEDS_ANSWERS
+  leds_answer_store((coap_packet_t *)request, !success, msg);
+#endif
 }
 
 #endif
 #endif /* PLATFORM_HAS_LEDS */
 
+/********************** SCHEDULE **************************/
+/* Weekly setpoint program (schedule.h), run by the mote itself so that it
+   goes on when the dashboard or the border router is away.
+   GET returns the program, "D:HH:MM=T;...", block-wise when long.
+   POST or PUT replaces it; a long program is uploaded block-wise (Block1)
+   and checked as the blocks arrive, so it is never held whole in RAM.
+   The query variable now=D:HH:MM sets the time of the week, which the
+   program needs and which is lost when the mote reboots. */
+#if REST_RES_SCHEDULE
+RESOURCE(schedule, METHOD_GET | METHOD_POST | METHOD_PUT, "schedule", "title=\"Weekly program: ?now=D:HH:MM, POST D:HH:MM=T;...\";rt=\"Control\"");
+
+/* Number of the Block1 expected next */
+static uint32_t schedule_block;
+/* Message ID and sender of the first block of the upload, which tell a
+   late copy of it from the start of a new upload */
+static uint16_t schedule_mid;
+static uip_ipaddr_t schedule_peer;
+
+void
+schedule_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const char *now = NULL;
+  const uint8_t *payload = NULL;
+  uint32_t second;
+  uint32_t num = 0;
+  uint32_t block_offset = 0;
+  uint16_t size = 0;
+  uint8_t more = 0;
+  struct coap_fit fit;
+  uint8_t again = 0;
+  int blockwise;
+  int len;
+
+  len = REST.get_query_variable(request, "now", &now);
+  if(len > 0) {
+    if(schedule_parse_time(now, len, &second) < 0) {
+      REST.set_response_status(response, REST.status.BAD_REQUEST);
+      REST.set_response_payload(response, "KO", 2);
+      return;
+    }
+    schedule_set_time(second);
+  }
+
+  if(REST.get_method_type(request) == METHOD_GET) {
+    /* Produced by offset, in blocks that fit in a frame */
+    REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+    coap_fit_begin(&fit, buffer, preferred_size, *offset);
+    fit.len = schedule_text((char *)buffer, fit.size, fit.start);
+    fit.total = schedule_text_length();
+    coap_fit_end(&fit, request, response, offset);
+    return;
+  }
+
+  len = REST.get_request_payload(request, &payload);
+  blockwise = coap_get_header_block1(request, &num, &more, &size, &block_offset);
+  if(!blockwise) {
+    num = 0;
+    more = 0;
+  }
+  if(num == 0) {
+    if(schedule_block > 0 &&
+       ((coap_packet_t *)request)->mid == schedule_mid &&
+       uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &schedule_peer)) {
+      again = 1;
+    } else {
+      schedule_upload_begin();
+      schedule_block = 0;
+      schedule_mid = ((coap_packet_t *)request)->mid;
+      uip_ipaddr_copy(&schedule_peer, &UIP_IP_BUF->srcipaddr);
+    }
+  }
+
+  if(again || num + 1 == schedule_block) {
+    /* Retransmission of a block already taken */
+    PRINTF("schedule_handler: block %lu again\n", num);
+  } else if(num != schedule_block) {
+    PRINTF("schedule_handler: block %lu, expected %lu\n", num, schedule_block);
+    REST.set_response_status(response, REST.status.BAD_REQUEST);
+    REST.set_response_payload(response, "KO", 2);
+    return;
+  } else {
+    schedule_block++;
+    if(schedule_upload_feed((const char *)payload, len) < 0 ||
+       (!more && schedule_upload_end() < 0)) {
+      PRINTF("schedule_handler: bad program\n");
+      schedule_block = 0;
+      REST.set_response_status(response, REST.status.BAD_REQUEST);
+      REST.set_response_payload(response, "KO", 2);
+      return;
+    }
+  }
+
+  REST.set_response_status(response, REST.status.CHANGED);
+  if(blockwise) {
+    coap_set_header_block1(response, num, more, size);
+  }
+  if(!more) {
+    snprintf((char *)buffer, REST_MAX_CHUNK_SIZE, "%u", schedule_transitions());
+    REST.set_response_payload(response, buffer, strlen((char *)buffer));
+  }
+}
+#endif /* REST_RES_SCHEDULE */
+
 /******************************************************************************/
 PROCESS(thermostat_server_process, "Smart Thermostat Server");
 AUTOSTART_PROCESSES(&thermostat_server_process);
@@ -292,8 +801,36 @@ PROCESS_THREAD(thermostat_server_process, ev, data)
   PRINTF("IP+UDP header: %u\n", UIP_IPUDPH_LEN);
   PRINTF("REST max chunk: %u\n", REST_MAX_CHUNK_SIZE);
 
+  /* Thermostat initialization 
+     Set all the engine to off and generates a random value 
+     for the temperature (between 10 and 30) */
+  thermostat_status.heating = 0;
+  thermostat_status.air_conditioning = 0;
+  thermostat_status.ventilation = 0;
+  thermostat_status.temp = (random_rand() % rand_max) + 10;
+  
+  PRINTF("Random temperature: %u\n", thermostat_status.temp);
+
+#if THERMOSTAT_CONF_REPLAY
+  /* Or the one of the trace, the same at every run */
+  sensor_replay_init();
+  replay();
+  PRINTF("Replayed temperature: %u\n", thermostat_status.temp);
+#endif
+
+#if THERMOSTAT_CONF_PERSIST
+  /* Or the state before the reboot, ready before the first request */
+  restore();
+#endif
+
   /* Initialize the REST engine. */
   rest_init_engine();
+#if THERMOSTAT_CONF_MESH_AGG
+  mesh_agg_init();
+#endif
+#if THERMOSTAT_CONF_FAST_JOIN
+  fast_join_init();
+#endif
 
   /* Activate the application-specific resources. */
 
@@ -310,36 +847,47 @@ PROCESS_THREAD(thermostat_server_process, ev, data)
 
 /* Resource for observe temperature */
 #if REST_RES_PUSHING
+#if THERMOSTAT_CONF_SLOTTED
+  rest_activate_event_resource(&resource_tempobs);
+  rest_activate_resource(&resource_slot);
+  notify_slot_init(slot_expired);
+#else
   rest_activate_periodic_resource(&periodic_resource_tempobs);
 #endif
+#endif
 #if defined (PLATFORM_HAS_LEDS)
 #if REST_RES_LEDS
   rest_activate_resource(&resource_leds);
 #endif
 #endif /* PLATFORM_HAS_LEDS */
-  
-  /* Thermostat initialization 
-     Set all the engine to off and generates a random value 
-     for the temperature (between 10 and 30) */
-  thermostat_status.heating = 0;
-  thermostat_status.air_conditioning = 0;
-  thermostat_status.ventilation = 0;
-  thermostat_status.temp = (random_rand() % rand_max) + 10;
-  
-  PRINTF("Random temperature: %u\n", thermostat_status.temp);
-  
-  // Declaration of the timer
-  static struct etimer timer;
+
+/* Resource for the weekly program */
+#if REST_RES_SCHEDULE
+  rest_activate_resource(&resource_schedule);
+#endif
+
+#if REST_RES_SCHEDULE
+  /* The stored program runs once the time is set through /schedule */
+  schedule_init(schedule_changed);
+#endif
+
+#if THERMOSTAT_CONF_RD
+  /* Registers the resources activated above */
+  rd_client_init();
+#endif
   
   /* Thermostat internal logic */
   // Set and start the timer for increasing or decrasing the temperature, if necessary
-  etimer_set(&timer, CLOCK_SECOND * 20);
+  etimer_set(&control_timer, CONTROL_INTERVAL);
   
   while(1) {
     PROCESS_WAIT_EVENT();
     
     if(ev == PROCESS_EVENT_TIMER){
       unsigned short vent_multiplier = 1;
+#if THERMOSTAT_CONF_REPLAY
+      unsigned short before = thermostat_status.temp;
+#endif
       // If the ventilation is on, the multiplier is set to 2
       if(thermostat_status.ventilation == 1) {
         vent_multiplier = 2;
@@ -354,9 +902,19 @@ PROCESS_THREAD(thermostat_server_process, ev, data)
         PRINTF("Temperature decreased: -%u\n", vent_multiplier);
         thermostat_status.temp -= 1 * vent_multiplier;
       }
+#if THERMOSTAT_CONF_REPLAY
+      replay_offset += (int)thermostat_status.temp - before;
+      replay();
+#endif
+#if REST_RES_SCHEDULE
+      regulate();
+#endif
+#if THERMOSTAT_CONF_PERSIST
+      persist();
+#endif
       
       // Reset timer
-      etimer_reset(&timer);
+      etimer_reset(&control_timer);
     }
     
   } /* while (1) */
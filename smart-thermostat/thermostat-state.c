@@ -0,0 +1,243 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Thermostat state kept in a wear-levelled log in flash
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/crc16.h"
+#include "thermostat-state.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Bumped whenever struct state_record changes layout. */
+#define STATE_MAGIC 0x7E
+
+/* Coffee finds the end of a file at its last non-zero byte, so every
+   record ends with one to be appended after, whatever its CRC. */
+#define STATE_END   0x5A
+
+struct state_record {
+  uint8_t magic;
+  uint8_t generation;      /* of the file, to tell the newer one */
+  struct thermostat_state state;
+  uint16_t crc;
+  uint8_t reserved;
+  uint8_t end;
+};
+
+static const char *const filenames[2] = { "state0", "state1" };
+
+static uint8_t current;    /* file appended to */
+static uint8_t generation;
+static uint8_t used;       /* records in it */
+
+static struct thermostat_state saved;
+static struct thermostat_state pending;
+static uint8_t have_saved;
+static uint8_t waiting;
+static clock_time_t due;
+static struct ctimer timer;
+
+struct thermostat_state_stats thermostat_state_stats;
+/*---------------------------------------------------------------------------*/
+static uint16_t
+record_crc(const struct state_record *record)
+{
+  return crc16_data((const unsigned char *)record,
+                    offsetof(struct state_record, crc), 0);
+}
+/*---------------------------------------------------------------------------*/
+/* Number of valid records at the start of file i, the last one in last.
+   *clean is 0 if something else follows them (a write cut short). */
+static uint8_t
+scan(uint8_t i, struct state_record *last, uint8_t *clean)
+{
+  struct state_record record;
+  uint8_t n = 0;
+  int fd;
+  int len;
+
+  *clean = 1;
+  fd = cfs_open(filenames[i], CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  while(n < THERMOSTAT_STATE_RECORDS) {
+    len = cfs_read(fd, &record, sizeof(record));
+    if(len == 0) {
+      break;
+    }
+    if(len != sizeof(record) || record.magic != STATE_MAGIC ||
+       record.end != STATE_END || record.crc != record_crc(&record) ||
+       (n > 0 && record.generation != last->generation)) {
+      *clean = 0;
+      break;
+    }
+    memcpy(last, &record, sizeof(record));
+    n++;
+  }
+  cfs_close(fd);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+int
+thermostat_state_restore(struct thermostat_state *state)
+{
+  struct state_record last[2];
+  uint8_t n[2];
+  uint8_t clean[2];
+
+  n[0] = scan(0, &last[0], &clean[0]);
+  n[1] = scan(1, &last[1], &clean[1]);
+  if(n[0] == 0 && n[1] == 0) {
+    PRINTF("thermostat-state: nothing stored\n");
+    cfs_remove(filenames[0]);
+    cfs_remove(filenames[1]);
+    current = 0;
+    used = 0;
+    return 0;
+  }
+
+  current = n[1] > 0 &&
+    (n[0] == 0 || (int8_t)(last[1].generation - last[0].generation) > 0);
+  generation = last[current].generation;
+  /* After a write cut short, start the other file at the next write */
+  used = clean[current] ? n[current] : THERMOSTAT_STATE_RECORDS;
+  /* The older file is left over from a rotation cut short */
+  cfs_remove(filenames[!current]);
+
+  memcpy(&saved, &last[current].state, sizeof(saved));
+  memcpy(state, &saved, sizeof(saved));
+  have_saved = 1;
+  PRINTF("thermostat-state: record %u of %s\n", used, filenames[current]);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+append(const struct thermostat_state *state)
+{
+  struct state_record record;
+  uint8_t rotated = 0;
+  int fd;
+  int len;
+
+  if(used == THERMOSTAT_STATE_RECORDS) {
+    /* Start the other file, remove the full one once that worked */
+    current = !current;
+    generation++;
+    used = 0;
+    rotated = 1;
+    thermostat_state_stats.rotations++;
+  }
+  if(used == 0) {
+    cfs_remove(filenames[current]);
+    cfs_coffee_reserve(filenames[current],
+                       THERMOSTAT_STATE_RECORDS * sizeof(record));
+  }
+
+  memset(&record, 0, sizeof(record));
+  record.magic = STATE_MAGIC;
+  record.generation = generation;
+  memcpy(&record.state, state, sizeof(record.state));
+  record.crc = record_crc(&record);
+  record.end = STATE_END;
+
+  fd = cfs_open(filenames[current], CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return 0;
+  }
+  len = cfs_write(fd, &record, sizeof(record));
+  cfs_close(fd);
+  if(len != sizeof(record)) {
+    /* Where the next record would go is not known any more */
+    used = THERMOSTAT_STATE_RECORDS;
+    return 0;
+  }
+  used++;
+  if(rotated) {
+    cfs_remove(filenames[!current]);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+flush(void *ptr)
+{
+  (void)ptr;
+  waiting = 0;
+  if(have_saved && memcmp(&pending, &saved, sizeof(saved)) == 0) {
+    return;
+  }
+  if(append(&pending)) {
+    memcpy(&saved, &pending, sizeof(saved));
+    have_saved = 1;
+    thermostat_state_stats.writes++;
+    PRINTF("thermostat-state: written, %u in %s\n", used, filenames[current]);
+  } else {
+    thermostat_state_stats.failures++;
+    PRINTF("thermostat-state: write failed\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+thermostat_state_save(const struct thermostat_state *state)
+{
+  clock_time_t delay;
+
+  memcpy(&pending, state, sizeof(pending));
+  if(have_saved && memcmp(&pending, &saved, sizeof(saved)) == 0) {
+    /* Back to what is stored: nothing to write */
+    ctimer_stop(&timer);
+    waiting = 0;
+    return;
+  }
+  if(have_saved && pending.heating == saved.heating &&
+     pending.air_conditioning == saved.air_conditioning &&
+     pending.ventilation == saved.ventilation &&
+     pending.flags == saved.flags) {
+    delay = THERMOSTAT_STATE_TEMP_DELAY;
+  } else {
+    delay = THERMOSTAT_STATE_DELAY;
+  }
+  /* A write already due sooner takes this change along */
+  if(!waiting || (clock_time_t)(due - clock_time()) > delay) {
+    ctimer_set(&timer, delay, flush, NULL);
+    due = clock_time() + delay;
+    waiting = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,97 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Thermostat state kept in a wear-levelled log in flash
+ *
+ *         The state is appended as a small record to a Coffee file
+ *         reserved for THERMOSTAT_STATE_RECORDS of them. Every record goes
+ *         to flash that has not been written since the file was created,
+ *         so nothing is ever rewritten in place. When the file is full
+ *         the latest record starts the other of two files and the full one
+ *         is removed; Coffee places each new file after the previous ones,
+ *         which spreads the erases over its whole area. At boot the last
+ *         valid record of the newer file is the state.
+ *
+ *         Saving is batched: a change is written after a short delay, and
+ *         a temperature alone after a longer one, so that a burst of
+ *         changes costs one record.
+ */
+
+#ifndef __THERMOSTAT_STATE_H__
+#define __THERMOSTAT_STATE_H__
+
+#include "contiki.h"
+
+#ifdef THERMOSTAT_STATE_CONF_RECORDS
+#define THERMOSTAT_STATE_RECORDS THERMOSTAT_STATE_CONF_RECORDS
+#else
+#define THERMOSTAT_STATE_RECORDS 64
+#endif
+
+/* Delay before writing a change of the actuators or the flags */
+#ifdef THERMOSTAT_STATE_CONF_DELAY
+#define THERMOSTAT_STATE_DELAY THERMOSTAT_STATE_CONF_DELAY
+#else
+#define THERMOSTAT_STATE_DELAY (5 * CLOCK_SECOND)
+#endif
+
+/* Delay before writing a change of the temperature alone */
+#ifdef THERMOSTAT_STATE_CONF_TEMP_DELAY
+#define THERMOSTAT_STATE_TEMP_DELAY THERMOSTAT_STATE_CONF_TEMP_DELAY
+#else
+#define THERMOSTAT_STATE_TEMP_DELAY (240 * CLOCK_SECOND)
+#endif
+
+#define THERMOSTAT_STATE_HELD 0x01  /* the schedule is overridden */
+
+struct thermostat_state {
+  uint8_t heating;
+  uint8_t air_conditioning;
+  uint8_t ventilation;
+  uint8_t flags;
+  uint16_t temp;
+};
+
+struct thermostat_state_stats {
+  uint16_t writes;
+  uint16_t rotations;   /* files filled up */
+  uint16_t failures;
+};
+
+extern struct thermostat_state_stats thermostat_state_stats;
+
+/* Returns 1 if a state was found, 0 otherwise */
+int thermostat_state_restore(struct thermostat_state *state);
+
+/* Schedule the writing of state, after THERMOSTAT_STATE_TEMP_DELAY if only
+   the temperature changed, THERMOSTAT_STATE_DELAY otherwise. */
+void thermostat_state_save(const struct thermostat_state *state);
+
+#endif /* __THERMOSTAT_STATE_H__ */
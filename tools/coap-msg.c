@@ -0,0 +1,284 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Minimal CoAP message encoding for the host tools
+ */
+
+#include "coap-msg.h"
+#include <string.h>
+
+#define COAP_VERSION        1
+#define COAP_PAYLOAD_MARKER 0xff
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+put_option(uint8_t *p, const uint8_t *end, unsigned delta,
+           const uint8_t *value, size_t len)
+{
+  uint8_t *head;
+
+  if(end - p < (ptrdiff_t)(5 + len)) {
+    return NULL;
+  }
+  head = p++;
+  if(delta >= 269) {
+    *head = 14 << 4;
+    *p++ = (delta - 269) >> 8;
+    *p++ = (delta - 269) & 0xff;
+  } else if(delta >= 13) {
+    *head = 13 << 4;
+    *p++ = delta - 13;
+  } else {
+    *head = delta << 4;
+  }
+  if(len >= 269) {
+    *head |= 14;
+    *p++ = (len - 269) >> 8;
+    *p++ = (len - 269) & 0xff;
+  } else if(len >= 13) {
+    *head |= 13;
+    *p++ = len - 13;
+  } else {
+    *head |= len;
+  }
+  memcpy(p, value, len);
+  return p + len;
+}
+/*---------------------------------------------------------------------------*/
+/* Each '/' or '&' separated segment of s becomes one option */
+static uint8_t *
+put_segments(uint8_t *p, const uint8_t *end, unsigned *last,
+             unsigned number, const char *s, size_t len, char sep)
+{
+  const char *seg;
+  size_t n;
+
+  while(len > 0 && p != NULL) {
+    seg = s;
+    while(len > 0 && *s != sep) {
+      s++;
+      len--;
+    }
+    n = s - seg;
+    if(len > 0) {
+      s++;
+      len--;
+    }
+    if(n > 0) {
+      p = put_option(p, end, number - *last, (const uint8_t *)seg, n);
+      *last = number;
+    }
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+coap_build_request(uint8_t *buf, size_t size, uint8_t type, uint8_t code,
+                   uint16_t mid, const uint8_t *token, uint8_t token_len,
+                   int32_t observe, const char *uri,
+                   const uint8_t *payload, size_t payload_len)
+{
+  const uint8_t *end = buf + size;
+  const char *query;
+  uint8_t *p = buf;
+  uint8_t value[3];
+  unsigned last = 0;
+  size_t n;
+
+  if(token_len > COAP_MAX_TOKEN || size < 4u + token_len) {
+    return 0;
+  }
+  *p++ = (COAP_VERSION << 6) | (type << 4) | token_len;
+  *p++ = code;
+  *p++ = mid >> 8;
+  *p++ = mid & 0xff;
+  memcpy(p, token, token_len);
+  p += token_len;
+
+  if(observe >= 0) {
+    /* Shortest encoding: no bytes for 0 */
+    n = observe > 0xffff ? 3 : observe > 0xff ? 2 : observe > 0 ? 1 : 0;
+    value[0] = observe >> 16;
+    value[1] = observe >> 8;
+    value[2] = observe;
+    p = put_option(p, end, COAP_OPTION_OBSERVE, value + 3 - n, n);
+    last = COAP_OPTION_OBSERVE;
+  }
+
+  while(*uri == '/') {
+    uri++;
+  }
+  query = strchr(uri, '?');
+  n = query != NULL ? (size_t)(query - uri) : strlen(uri);
+  p = put_segments(p, end, &last, COAP_OPTION_URI_PATH, uri, n, '/');
+  if(query != NULL) {
+    query++;
+    p = put_segments(p, end, &last, COAP_OPTION_URI_QUERY, query,
+                     strlen(query), '&');
+  }
+
+  if(p != NULL && payload_len > 0) {
+    if((size_t)(end - p) < payload_len + 1) {
+      return 0;
+    }
+    *p++ = COAP_PAYLOAD_MARKER;
+    memcpy(p, payload, payload_len);
+    p += payload_len;
+  }
+  return p != NULL ? (size_t)(p - buf) : 0;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+coap_build_empty(uint8_t *buf, uint8_t type, uint16_t mid)
+{
+  buf[0] = (COAP_VERSION << 6) | (type << 4);
+  buf[1] = 0;
+  buf[2] = mid >> 8;
+  buf[3] = mid & 0xff;
+  return 4;
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_ext(const uint8_t **p, const uint8_t *end, unsigned nibble,
+        unsigned *value)
+{
+  if(nibble == 13) {
+    if(*p + 1 > end) {
+      return -1;
+    }
+    *value = 13 + **p;
+    *p += 1;
+  } else if(nibble == 14) {
+    if(*p + 2 > end) {
+      return -1;
+    }
+    *value = 269 + (((*p)[0] << 8) | (*p)[1]);
+    *p += 2;
+  } else if(nibble == 15) {
+    return -1;
+  } else {
+    *value = nibble;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get_uint(const uint8_t *p, unsigned len)
+{
+  uint32_t v = 0;
+
+  while(len-- > 0) {
+    v = (v << 8) | *p++;
+  }
+  return v;
+}
+/*---------------------------------------------------------------------------*/
+/* Append an option of a request to uri, with sep if not the first */
+static int
+add_uri(char *uri, size_t *n, char sep, const uint8_t *value, unsigned len)
+{
+  if(*n + len + 2 > COAP_MAX_URI) {
+    return -1;
+  }
+  if(*n > 0 || sep == '?') {
+    uri[(*n)++] = sep;
+  }
+  memcpy(uri + *n, value, len);
+  *n += len;
+  uri[*n] = '\0';
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_parse(struct coap_msg *msg, const uint8_t *buf, size_t len)
+{
+  const uint8_t *p = buf + 4;
+  const uint8_t *end = buf + len;
+  unsigned number = 0;
+  unsigned delta;
+  unsigned olen;
+  size_t uri_len = 0;
+  int query = 0;
+
+  if(len < 4 || (buf[0] >> 6) != COAP_VERSION ||
+     (buf[0] & 0x0f) > COAP_MAX_TOKEN) {
+    return -1;
+  }
+  msg->type = (buf[0] >> 4) & 3;
+  msg->token_len = buf[0] & 0x0f;
+  msg->code = buf[1];
+  msg->mid = (buf[2] << 8) | buf[3];
+  msg->observe = -1;
+  msg->max_age = 60;
+  msg->payload = NULL;
+  msg->payload_len = 0;
+  msg->uri[0] = '\0';
+  if(p + msg->token_len > end) {
+    return -1;
+  }
+  memcpy(msg->token, p, msg->token_len);
+  p += msg->token_len;
+
+  while(p < end) {
+    if(*p == COAP_PAYLOAD_MARKER) {
+      p++;
+      if(p == end) {
+        return -1;
+      }
+      msg->payload = p;
+      msg->payload_len = end - p;
+      break;
+    }
+    delta = *p >> 4;
+    olen = *p & 0x0f;
+    p++;
+    if(get_ext(&p, end, delta, &delta) < 0 ||
+       get_ext(&p, end, olen, &olen) < 0 || p + olen > end) {
+      return -1;
+    }
+    number += delta;
+    if(number == COAP_OPTION_OBSERVE && olen <= 3) {
+      msg->observe = get_uint(p, olen);
+    } else if(number == COAP_OPTION_MAX_AGE && olen <= 4) {
+      msg->max_age = get_uint(p, olen);
+    } else if(number == COAP_OPTION_URI_PATH) {
+      if(add_uri(msg->uri, &uri_len, '/', p, olen) < 0) {
+        return -1;
+      }
+    } else if(number == COAP_OPTION_URI_QUERY) {
+      if(add_uri(msg->uri, &uri_len, query ? '&' : '?', p, olen) < 0) {
+        return -1;
+      }
+      query = 1;
+    }
+    p += olen;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,96 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Minimal CoAP message encoding for the host tools
+ *
+ *         Only what the tools need to talk to the Erbium (draft-13) servers
+ *         of the motes, or to stand in for them: messages with Uri-Path,
+ *         Uri-Query and Observe, empty ACK/RST, and parsing.
+ */
+
+#ifndef __COAP_MSG_H__
+#define __COAP_MSG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COAP_PORT 5683
+
+#define COAP_TYPE_CON 0
+#define COAP_TYPE_NON 1
+#define COAP_TYPE_ACK 2
+#define COAP_TYPE_RST 3
+
+#define COAP_GET    1
+#define COAP_POST   2
+#define COAP_PUT    3
+#define COAP_DELETE 4
+#define COAP_CONTENT 69  /* 2.05 */
+#define COAP_NOT_FOUND      132  /* 4.04 */
+#define COAP_NOT_ACCEPTABLE 134  /* 4.06 */
+
+#define COAP_OPTION_OBSERVE   6
+#define COAP_OPTION_URI_PATH  11
+#define COAP_OPTION_MAX_AGE   14
+#define COAP_OPTION_URI_QUERY 15
+
+#define COAP_MAX_TOKEN 8
+#define COAP_MAX_URI   64
+
+struct coap_msg {
+  uint8_t type;
+  uint8_t code;
+  uint16_t mid;
+  uint8_t token_len;
+  uint8_t token[COAP_MAX_TOKEN];
+  int32_t observe;           /* -1 if absent */
+  uint32_t max_age;          /* 60 if absent */
+  char uri[COAP_MAX_URI];    /* "path?query", as given to coap_build_request */
+  const uint8_t *payload;
+  size_t payload_len;
+};
+
+/* Build a request for uri, a path with an optional query
+   ("leds?color=r"). observe is -1 to leave the option out. Returns the
+   message length, or 0 if it does not fit in size. Responses are built
+   the same way, with a response code and an empty uri. */
+size_t coap_build_request(uint8_t *buf, size_t size, uint8_t type,
+                          uint8_t code, uint16_t mid,
+                          const uint8_t *token, uint8_t token_len,
+                          int32_t observe, const char *uri,
+                          const uint8_t *payload, size_t payload_len);
+
+/* Empty ACK or RST for a message id; always 4 bytes */
+size_t coap_build_empty(uint8_t *buf, uint8_t type, uint16_t mid);
+
+/* Returns 0, or -1 if the message is malformed or its uri too long */
+int coap_parse(struct coap_msg *msg, const uint8_t *buf, size_t len);
+
+#endif /* __COAP_MSG_H__ */
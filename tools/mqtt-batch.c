@@ -0,0 +1,661 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Batched MQTT publication of the collected readings
+ *
+ *         The compact format is one JSON object per window:
+ *         {"t":<start>,"d":<seconds>,"h":<house mean>,
+ *          "r":{"<last group of the mote address>":
+ *               [mean,min,max,count,actuators],...}}
+ *         with the actuators as a bit mask: 1 heating, 2 conditioning,
+ *         4 ventilation.
+ */
+
+#include "mqtt-batch.h"
+#include "tsdb.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Windows kept for the broker; at one a minute, half an hour */
+#define QUEUE_WINDOWS 32
+#define INFLIGHT      4
+#define KEEPALIVE     60
+#define MAX_BACKOFF   60
+#define OUT_SIZE      16384
+#define IN_SIZE       1024
+#define PAYLOAD_SIZE  8192
+
+#define MQTT_CONNECT    0x10
+#define MQTT_CONNACK    0x20
+#define MQTT_PUBLISH    0x30
+#define MQTT_PUBACK     0x40
+#define MQTT_PINGREQ    0xc0
+#define MQTT_PINGRESP   0xd0
+#define MQTT_QOS1       0x02
+#define MQTT_DUP        0x08
+
+#define STATE_IDLE       0  /* not connected, waiting to retry */
+#define STATE_CONNECTING 1  /* TCP connection in progress */
+#define STATE_CONNACK    2  /* CONNECT sent */
+#define STATE_CONNECTED  3
+
+struct room {
+  int64_t sum;
+  int32_t min;
+  int32_t max;
+  uint32_t count;
+  uint8_t actuators;
+};
+
+struct window {
+  time_t start;
+  time_t end;
+  uint16_t packet_id;       /* 0 until first sent */
+  uint8_t in_flight;
+  uint8_t acked;
+  uint32_t motes;           /* highest mote index + 1 */
+  struct room rooms[TSDB_MOTES];
+};
+
+struct mqtt_batch_stats mqtt_batch_stats;
+
+static struct mqtt_batch_config conf;
+static struct window current;
+static struct window queue[QUEUE_WINDOWS];
+static int queue_head;      /* oldest unacknowledged */
+static int queue_len;
+static uint8_t actuators[TSDB_MOTES];
+static uint16_t keys[TSDB_MOTES];
+
+static int sock = -1;
+static int state;
+static time_t retry_at;
+static int backoff = 1;
+static time_t last_sent;
+static time_t last_received;
+static uint16_t next_packet_id;
+static uint8_t out[OUT_SIZE];
+static size_t out_len;
+static uint8_t in[IN_SIZE];
+static size_t in_len;
+/*---------------------------------------------------------------------------*/
+static void
+window_open(struct window *w, time_t start)
+{
+  w->start = start;
+  w->end = start;
+  w->packet_id = 0;
+  w->in_flight = 0;
+  w->acked = 0;
+  memset(w->rooms, 0, sizeof(struct room) * w->motes);
+  w->motes = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+window_merge(struct window *into, const struct window *w)
+{
+  const struct room *from;
+  struct room *to;
+  int i;
+
+  for(i = 0; i < w->motes; i++) {
+    from = &w->rooms[i];
+    to = &into->rooms[i];
+    if(from->count == 0) {
+      continue;
+    }
+    if(to->count == 0 || from->min < to->min) {
+      to->min = from->min;
+    }
+    if(to->count == 0 || from->max > to->max) {
+      to->max = from->max;
+    }
+    to->sum += from->sum;
+    to->count += from->count;
+    to->actuators = from->actuators;
+  }
+  if(w->motes > into->motes) {
+    into->motes = w->motes;
+  }
+  into->end = w->end;
+}
+/*---------------------------------------------------------------------------*/
+void
+mqtt_batch_add(uint16_t mote, const uint8_t *addr, uint8_t kind,
+               int32_t value)
+{
+  struct room *r;
+
+  if(mote >= TSDB_MOTES) {
+    return;
+  }
+  keys[mote] = (addr[14] << 8) | addr[15];
+  if(kind != TSDB_TEMPERATURE) {
+    if(value) {
+      actuators[mote] |= 1 << (kind - TSDB_HEATING);
+    } else {
+      actuators[mote] &= ~(1 << (kind - TSDB_HEATING));
+    }
+    return;
+  }
+  r = &current.rooms[mote];
+  if(r->count == 0 || value < r->min) {
+    r->min = value;
+  }
+  if(r->count == 0 || value > r->max) {
+    r->max = value;
+  }
+  r->sum += value;
+  r->count++;
+  if(mote >= current.motes) {
+    current.motes = mote + 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+window_close(time_t now)
+{
+  struct window *w;
+  int i;
+
+  current.end = now;
+  for(i = 0; i < current.motes; i++) {
+    current.rooms[i].actuators = actuators[i];
+  }
+  if(current.motes > 0) {
+    if(queue_len < QUEUE_WINDOWS) {
+      w = &queue[(queue_head + queue_len) % QUEUE_WINDOWS];
+      memcpy(w, &current, sizeof(*w));
+      queue_len++;
+    } else {
+      /* The queue only fills up beyond the windows in flight */
+      window_merge(&queue[(queue_head + queue_len - 1) % QUEUE_WINDOWS],
+                   &current);
+      mqtt_batch_stats.merged++;
+    }
+  }
+  window_open(&current, now);
+}
+/*---------------------------------------------------------------------------*/
+static int
+put_tenths(char *buf, size_t size, int64_t sum, uint32_t count)
+{
+  int64_t tenths;
+
+  tenths = (sum * 20 / count + (sum < 0 ? -1 : 1)) / 2;
+  return snprintf(buf, size, "%s%lld.%d", tenths < 0 ? "-" : "",
+                  llabs(tenths) / 10, (int)(llabs(tenths) % 10));
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+format(const struct window *w, char *buf, size_t size)
+{
+  const struct room *r;
+  int64_t sum = 0;
+  uint32_t count = 0;
+  size_t len = 0;
+  int field = 0;
+  int i;
+
+#define PUT(...) do { \
+    len += snprintf(buf + len, len < size ? size - len : 0, __VA_ARGS__); \
+  } while(0)
+#define PUT_TENTHS(s, c) do { \
+    len += put_tenths(buf + len, len < size ? size - len : 0, s, c); \
+  } while(0)
+
+  for(i = 0; i < w->motes; i++) {
+    sum += w->rooms[i].sum;
+    count += w->rooms[i].count;
+  }
+
+  switch(conf.format) {
+  case MQTT_BATCH_THINGSPEAK_HOUSE:
+    PUT("field1=");
+    PUT_TENTHS(sum, count);
+    break;
+  case MQTT_BATCH_THINGSPEAK:
+    /* Rooms in the order the collector found them; a channel has 8 */
+    for(i = 0; i < w->motes && field < 8; i++) {
+      r = &w->rooms[i];
+      if(r->count > 0) {
+        PUT("%sfield%d=", field > 0 ? "&" : "", field + 1);
+        PUT_TENTHS(r->sum, r->count);
+      }
+      field++;
+    }
+    break;
+  default:
+    PUT("{\"t\":%lld,\"d\":%lld,\"h\":", (long long)w->start,
+        (long long)(w->end - w->start));
+    PUT_TENTHS(sum, count);
+    PUT(",\"r\":{");
+    for(i = 0; i < w->motes; i++) {
+      r = &w->rooms[i];
+      if(r->count == 0) {
+        continue;
+      }
+      PUT("%s\"%x\":[", field++ > 0 ? "," : "", keys[i]);
+      PUT_TENTHS(r->sum, r->count);
+      PUT(",%d,%d,%u,%u]", r->min, r->max, r->count, r->actuators);
+    }
+    PUT("}}");
+  }
+  return len < size ? len : size;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+put_length(uint8_t *p, size_t len)
+{
+  do {
+    *p = len & 0x7f;
+    len >>= 7;
+    if(len > 0) {
+      *p |= 0x80;
+    }
+    p++;
+  } while(len > 0);
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+put_string(uint8_t *p, const char *s)
+{
+  size_t len = strlen(s);
+
+  *p++ = len >> 8;
+  *p++ = len & 0xff;
+  memcpy(p, s, len);
+  return p + len;
+}
+/*---------------------------------------------------------------------------*/
+/* Queues a packet for sending; 0 if there is no room for it yet */
+static int
+put_packet(uint8_t type, const uint8_t *var, size_t var_len,
+           const uint8_t *payload, size_t payload_len)
+{
+  uint8_t *p;
+
+  if(out_len + 5 + var_len + payload_len > sizeof(out)) {
+    return 0;
+  }
+  p = out + out_len;
+  *p++ = type;
+  p = put_length(p, var_len + payload_len);
+  if(var_len > 0) {
+    memcpy(p, var, var_len);
+    p += var_len;
+  }
+  if(payload_len > 0) {
+    memcpy(p, payload, payload_len);
+    p += payload_len;
+  }
+  out_len = p - out;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+disconnect(time_t now, const char *why)
+{
+  int i;
+
+  if(conf.verbose) {
+    fprintf(stderr, "mqtt-batch: %s, retrying in %d s\n", why, backoff);
+  }
+  if(sock >= 0) {
+    close(sock);
+    sock = -1;
+  }
+  state = STATE_IDLE;
+  retry_at = now + backoff;
+  backoff = backoff * 2 > MAX_BACKOFF ? MAX_BACKOFF : backoff * 2;
+  out_len = 0;
+  in_len = 0;
+  /* What was not acknowledged is sent again, flagged as duplicate */
+  for(i = 0; i < queue_len; i++) {
+    queue[(queue_head + i) % QUEUE_WINDOWS].in_flight = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_connect(time_t now)
+{
+  struct addrinfo hints, *res, *r;
+  int err;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  err = getaddrinfo(conf.host, conf.port, &hints, &res);
+  if(err != 0) {
+    disconnect(now, gai_strerror(err));
+    return;
+  }
+  for(r = res; r != NULL; r = r->ai_next) {
+    sock = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+    if(sock < 0) {
+      continue;
+    }
+    fcntl(sock, F_SETFL, O_NONBLOCK);
+    if(connect(sock, r->ai_addr, r->ai_addrlen) == 0 ||
+       errno == EINPROGRESS) {
+      break;
+    }
+    close(sock);
+    sock = -1;
+  }
+  freeaddrinfo(res);
+  if(sock < 0) {
+    disconnect(now, "cannot connect to the broker");
+    return;
+  }
+  state = STATE_CONNECTING;
+  retry_at = now + KEEPALIVE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_connect(time_t now)
+{
+  uint8_t var[10];
+  uint8_t payload[512];
+  uint8_t *p = payload;
+
+  memcpy(var, "\0\4MQTT\4", 7);
+  var[7] = 0x02;                      /* clean session */
+  if(conf.username != NULL) {
+    var[7] |= 0x80;
+  }
+  if(conf.password != NULL) {
+    var[7] |= 0x40;
+  }
+  var[8] = KEEPALIVE >> 8;
+  var[9] = KEEPALIVE & 0xff;
+  p = put_string(p, conf.client_id);
+  if(conf.username != NULL) {
+    p = put_string(p, conf.username);
+  }
+  if(conf.password != NULL) {
+    p = put_string(p, conf.password);
+  }
+  put_packet(MQTT_CONNECT, var, sizeof(var), payload, p - payload);
+  state = STATE_CONNACK;
+  last_sent = now;
+  last_received = now;
+}
+/*---------------------------------------------------------------------------*/
+static void
+publish_windows(time_t now)
+{
+  static char payload[PAYLOAD_SIZE];
+  uint8_t var[256 + 4];
+  uint8_t *p;
+  struct window *w;
+  size_t len;
+  int in_flight = 0;
+  int dup;
+  int i;
+
+  for(i = 0; i < queue_len; i++) {
+    w = &queue[(queue_head + i) % QUEUE_WINDOWS];
+    if(w->in_flight && !w->acked) {
+      in_flight++;
+    }
+  }
+  for(i = 0; i < queue_len && in_flight < INFLIGHT; i++) {
+    w = &queue[(queue_head + i) % QUEUE_WINDOWS];
+    if(w->in_flight || w->acked) {
+      continue;
+    }
+    len = format(w, payload, sizeof(payload));
+    p = put_string(var, conf.topic);
+    /* Sent before the connection was lost: same id, flagged duplicate */
+    dup = w->packet_id != 0;
+    if(!dup) {
+      if(++next_packet_id == 0) {
+        next_packet_id = 1;
+      }
+      w->packet_id = next_packet_id;
+    }
+    *p++ = w->packet_id >> 8;
+    *p++ = w->packet_id & 0xff;
+    if(!put_packet(MQTT_PUBLISH | MQTT_QOS1 | (dup ? MQTT_DUP : 0),
+                   var, p - var, (uint8_t *)payload, len)) {
+      /* The socket does not keep up: wait for the output to drain */
+      w->packet_id = dup ? w->packet_id : 0;
+      break;
+    }
+    w->in_flight = 1;
+    in_flight++;
+    last_sent = now;
+    mqtt_batch_stats.published++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+acknowledged(uint16_t packet_id)
+{
+  struct window *w;
+  int i;
+
+  for(i = 0; i < queue_len; i++) {
+    w = &queue[(queue_head + i) % QUEUE_WINDOWS];
+    if(w->in_flight && w->packet_id == packet_id) {
+      w->acked = 1;
+      mqtt_batch_stats.acked++;
+      break;
+    }
+  }
+  while(queue_len > 0 && queue[queue_head].acked) {
+    queue_head = (queue_head + 1) % QUEUE_WINDOWS;
+    queue_len--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_input(time_t now)
+{
+  size_t pos = 0;
+  size_t len;
+  size_t hlen;
+  int shift;
+  ssize_t n;
+
+  n = read(sock, in + in_len, sizeof(in) - in_len);
+  if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+    disconnect(now, "connection closed by the broker");
+    return;
+  }
+  if(n < 0) {
+    return;
+  }
+  in_len += n;
+  last_received = now;
+
+  while(in_len - pos >= 2) {
+    len = 0;
+    shift = 0;
+    for(hlen = 1; hlen < 5 && pos + hlen < in_len; hlen++) {
+      len |= (size_t)(in[pos + hlen] & 0x7f) << shift;
+      shift += 7;
+      if(!(in[pos + hlen] & 0x80)) {
+        break;
+      }
+    }
+    if(hlen == 5 || pos + hlen >= in_len) {
+      if(hlen == 5) {
+        disconnect(now, "malformed packet from the broker");
+        return;
+      }
+      break;
+    }
+    hlen++;
+    if(len > sizeof(in) - hlen) {
+      disconnect(now, "packet from the broker too long");
+      return;
+    }
+    if(pos + hlen + len > in_len) {
+      break;
+    }
+    switch(in[pos] & 0xf0) {
+    case MQTT_CONNACK:
+      if(len < 2 || in[pos + hlen + 1] != 0) {
+        disconnect(now, "connection refused by the broker");
+        return;
+      }
+      state = STATE_CONNECTED;
+      backoff = 1;
+      mqtt_batch_stats.connects++;
+      if(conf.verbose) {
+        fprintf(stderr, "mqtt-batch: connected to %s\n", conf.host);
+      }
+      break;
+    case MQTT_PUBACK:
+      if(len >= 2) {
+        acknowledged((in[pos + hlen] << 8) | in[pos + hlen + 1]);
+      }
+      break;
+    }
+    pos += hlen + len;
+  }
+  memmove(in, in + pos, in_len - pos);
+  in_len -= pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_output(time_t now)
+{
+  int err;
+  socklen_t errlen = sizeof(err);
+  ssize_t n;
+
+  if(state == STATE_CONNECTING) {
+    if(getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 || err != 0) {
+      disconnect(now, "cannot connect to the broker");
+      return;
+    }
+    send_connect(now);
+  }
+  if(out_len == 0) {
+    return;
+  }
+  n = write(sock, out, out_len);
+  if(n < 0) {
+    if(errno != EAGAIN && errno != EINTR) {
+      disconnect(now, "connection to the broker lost");
+    }
+    return;
+  }
+  mqtt_batch_stats.bytes += n;
+  memmove(out, out + n, out_len - n);
+  out_len -= n;
+}
+/*---------------------------------------------------------------------------*/
+void
+mqtt_batch_init(const struct mqtt_batch_config *config)
+{
+  conf = *config;
+  if(strlen(conf.topic) > 255 || strlen(conf.client_id) > 23 ||
+     (conf.username != NULL && strlen(conf.username) > 200) ||
+     (conf.password != NULL && strlen(conf.password) > 200)) {
+    fprintf(stderr, "mqtt-batch: topic, client id or credentials too long\n");
+    exit(1);
+  }
+  window_open(&current, time(NULL));
+}
+/*---------------------------------------------------------------------------*/
+int
+mqtt_batch_fd(int *want_write)
+{
+  *want_write = sock >= 0 && (state == STATE_CONNECTING || out_len > 0);
+  return sock;
+}
+/*---------------------------------------------------------------------------*/
+int
+mqtt_batch_queued(void)
+{
+  return queue_len;
+}
+/*---------------------------------------------------------------------------*/
+void
+mqtt_batch_poll(time_t now)
+{
+  fd_set rset, wset;
+  struct timeval tv = { 0, 0 };
+
+  if(now - current.start >= conf.window) {
+    window_close(now);
+  }
+
+  if(state == STATE_IDLE) {
+    if(now >= retry_at) {
+      start_connect(now);
+    }
+    return;
+  }
+  if(state != STATE_CONNECTED && now >= retry_at) {
+    disconnect(now, "no answer from the broker");
+    return;
+  }
+
+  FD_ZERO(&rset);
+  FD_ZERO(&wset);
+  FD_SET(sock, &rset);
+  FD_SET(sock, &wset);
+  if(select(sock + 1, &rset, &wset, NULL, &tv) <= 0) {
+    return;
+  }
+  if(FD_ISSET(sock, &wset)) {
+    write_output(now);
+  }
+  if(sock >= 0 && state >= STATE_CONNACK && FD_ISSET(sock, &rset)) {
+    read_input(now);
+  }
+  if(sock >= 0 && state == STATE_CONNECTED) {
+    if(now - last_received > KEEPALIVE * 3 / 2) {
+      disconnect(now, "no answer from the broker");
+      return;
+    }
+    publish_windows(now);
+    if(out_len == 0 && now - last_sent >= KEEPALIVE / 2) {
+      put_packet(MQTT_PINGREQ, NULL, 0, NULL, 0);
+      last_sent = now;
+    }
+    write_output(now);
+  }
+}
+/*---------------------------------------------------------------------------*/
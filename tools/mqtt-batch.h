@@ -0,0 +1,89 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Batched MQTT publication of the collected readings
+ *
+ *         The readings of a time window are reduced to one message: the
+ *         mean, minimum, maximum and count of the temperatures of each
+ *         mote, its actuator states and the house mean. Messages are
+ *         published with QoS 1 to an MQTT 3.1.1 broker, a few in flight at
+ *         a time. Windows wait in a bounded queue while the broker is slow
+ *         or unreachable; when it is full, new windows are merged into the
+ *         last queued one, which only makes the time resolution coarser.
+ */
+
+#ifndef __MQTT_BATCH_H__
+#define __MQTT_BATCH_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#define MQTT_BATCH_COMPACT         0  /* JSON, see mqtt-batch.c */
+#define MQTT_BATCH_THINGSPEAK      1  /* field<n>=<room mean> */
+#define MQTT_BATCH_THINGSPEAK_HOUSE 2 /* field1=<house mean> */
+
+struct mqtt_batch_config {
+  const char *host;
+  const char *port;
+  const char *topic;
+  const char *client_id;
+  const char *username;         /* NULL if none */
+  const char *password;         /* NULL if none */
+  int window;                   /* seconds */
+  int format;
+  int verbose;
+};
+
+struct mqtt_batch_stats {
+  unsigned long published;      /* messages sent, retransmissions included */
+  unsigned long acked;
+  unsigned long merged;         /* windows merged for lack of queue room */
+  unsigned long connects;
+  unsigned long bytes;
+};
+
+extern struct mqtt_batch_stats mqtt_batch_stats;
+
+void mqtt_batch_init(const struct mqtt_batch_config *config);
+
+/* A reading of mote (store index) with address addr */
+void mqtt_batch_add(uint16_t mote, const uint8_t *addr, uint8_t kind,
+                    int32_t value);
+
+/* Socket to wait on, -1 if none; *want_write when output is pending */
+int mqtt_batch_fd(int *want_write);
+
+/* Closes windows, connects, sends and reads as needed */
+void mqtt_batch_poll(time_t now);
+
+/* Windows waiting for the broker, in flight included */
+int mqtt_batch_queued(void);
+
+#endif /* __MQTT_BATCH_H__ */
@@ -0,0 +1,286 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Stand-in MQTT broker for testing thermo-collector
+ *
+ *         Accepts one client at a time, prints what it publishes and
+ *         acknowledges it. -d delays the acknowledgements to play a slow
+ *         broker, -x drops the connection after a number of messages to
+ *         play an unreliable one.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define BUF_SIZE 65536
+#define MAX_ACKS 256
+
+struct ack {
+  uint16_t packet_id;
+  long long due;            /* ms */
+};
+
+static struct ack acks[MAX_ACKS];
+static int num_acks;
+static int delay_ms;
+static int drop_after;
+static int quiet;
+static unsigned long messages;
+static unsigned long duplicates;
+static unsigned long bytes;
+static volatile sig_atomic_t stop;
+/*---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: mqtt-sink [-q] [-p port] [-d ms] [-x messages]\n"
+          "  -q  count the messages instead of printing them\n"
+          "  -d  delay each acknowledgement\n"
+          "  -x  close the connection after this many messages\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+/*---------------------------------------------------------------------------*/
+static long long
+now_ms(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_acks(int fd, int all)
+{
+  uint8_t puback[4] = { 0x40, 2 };
+  int i;
+
+  for(i = 0; i < num_acks && (all || acks[i].due <= now_ms()); i++) {
+    puback[2] = acks[i].packet_id >> 8;
+    puback[3] = acks[i].packet_id & 0xff;
+    if(write(fd, puback, sizeof(puback)) < 0) {
+      break;
+    }
+  }
+  memmove(acks, acks + i, (num_acks - i) * sizeof(struct ack));
+  num_acks -= i;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns 0 when the connection is to be closed */
+static int
+handle_packet(int fd, const uint8_t *p, size_t len, uint8_t type)
+{
+  static const uint8_t connack[4] = { 0x20, 2, 0, 0 };
+  static const uint8_t pingresp[2] = { 0xd0, 0 };
+  size_t topic_len;
+  size_t hlen;
+
+  switch(type & 0xf0) {
+  case 0x10:
+    if(write(fd, connack, sizeof(connack)) < 0) {
+      return 0;
+    }
+    break;
+  case 0x30:
+    if(len < 2) {
+      return 0;
+    }
+    topic_len = (p[0] << 8) | p[1];
+    hlen = 2 + topic_len + ((type & 0x06) ? 2 : 0);
+    if(hlen > len) {
+      return 0;
+    }
+    messages++;
+    if(type & 0x08) {
+      duplicates++;
+    }
+    if(!quiet) {
+      printf("%.*s%s %.*s\n", (int)topic_len, p + 2,
+             (type & 0x08) ? " (dup)" : "", (int)(len - hlen), p + hlen);
+      fflush(stdout);
+    }
+    if((type & 0x06) && num_acks < MAX_ACKS) {
+      acks[num_acks].packet_id = (p[hlen - 2] << 8) | p[hlen - 1];
+      acks[num_acks].due = now_ms() + delay_ms;
+      num_acks++;
+    }
+    if(drop_after > 0 && messages % drop_after == 0) {
+      fprintf(stderr, "mqtt-sink: dropping the connection\n");
+      num_acks = 0;
+      return 0;
+    }
+    break;
+  case 0xc0:
+    if(write(fd, pingresp, sizeof(pingresp)) < 0) {
+      return 0;
+    }
+    break;
+  case 0xe0:
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+serve(int fd)
+{
+  static uint8_t buf[BUF_SIZE];
+  size_t len = 0;
+  size_t pos;
+  size_t plen;
+  size_t hlen;
+  int shift;
+  ssize_t n;
+
+  while(!stop) {
+    fd_set rset;
+    struct timeval tv = { 0, 10000 };
+
+    FD_ZERO(&rset);
+    FD_SET(fd, &rset);
+    if(select(fd + 1, &rset, NULL, NULL, &tv) < 0 && errno != EINTR) {
+      break;
+    }
+    send_acks(fd, 0);
+    if(!FD_ISSET(fd, &rset)) {
+      continue;
+    }
+    n = read(fd, buf + len, sizeof(buf) - len);
+    if(n <= 0) {
+      break;
+    }
+    bytes += n;
+    len += n;
+
+    pos = 0;
+    while(len - pos >= 2) {
+      plen = 0;
+      shift = 0;
+      for(hlen = 1; hlen < 5 && pos + hlen < len; hlen++) {
+        plen |= (size_t)(buf[pos + hlen] & 0x7f) << shift;
+        shift += 7;
+        if(!(buf[pos + hlen] & 0x80)) {
+          break;
+        }
+      }
+      if(hlen == 5 || pos + hlen >= len) {
+        break;
+      }
+      hlen++;
+      if(pos + hlen + plen > len) {
+        break;
+      }
+      if(!handle_packet(fd, buf + pos + hlen, plen, buf[pos])) {
+        return;
+      }
+      pos += hlen + plen;
+    }
+    memmove(buf, buf + pos, len - pos);
+    len -= pos;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  struct sockaddr_in6 sin;
+  struct sigaction sa;
+  int port = 1883;
+  int one = 1;
+  int lfd;
+  int fd;
+  int c;
+
+  while((c = getopt(argc, argv, "qp:d:x:")) != -1) {
+    switch(c) {
+    case 'q': quiet = 1; break;
+    case 'p': port = atoi(optarg); break;
+    case 'd': delay_ms = atoi(optarg); break;
+    case 'x': drop_after = atoi(optarg); break;
+    default: usage();
+    }
+  }
+
+  lfd = socket(AF_INET6, SOCK_STREAM, 0);
+  if(lfd < 0) {
+    perror("socket");
+    exit(1);
+  }
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&sin, 0, sizeof(sin));
+  sin.sin6_family = AF_INET6;
+  sin.sin6_addr = in6addr_any;
+  sin.sin6_port = htons(port);
+  if(bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+     listen(lfd, 1) < 0) {
+    perror("mqtt-sink");
+    exit(1);
+  }
+  /* Without SA_RESTART, so that a signal interrupts accept() */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  while(!stop) {
+    fd = accept(lfd, NULL, NULL);
+    if(fd < 0) {
+      continue;
+    }
+    fprintf(stderr, "mqtt-sink: client connected\n");
+    num_acks = 0;
+    serve(fd);
+    close(fd);
+    fprintf(stderr, "mqtt-sink: client gone\n");
+  }
+  fprintf(stderr, "mqtt-sink: %lu messages (%lu duplicates), %lu bytes\n",
+          messages, duplicates, bytes);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,280 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Thermal model of many thermostats at once
+ */
+
+#include "thermal-model.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Chance of the occupant switching the ventilation in a step: 1/32, about
+   every 10 minutes */
+#define VENTILATION_MASK 31
+
+struct worker_arg {
+  struct thermal_model *m;
+  int slice;
+};
+/*---------------------------------------------------------------------------*/
+/* The occupant: heating on below the set point minus one until it is
+   reached, the same for the conditioning above it. The arguments are
+   restrict so that the loop can be vectorized without alias checks. */
+static void
+occupy(uint32_t n, const int16_t *restrict temp,
+       const int16_t *restrict setpoint, uint8_t *restrict heating,
+       uint8_t *restrict conditioning, uint8_t *restrict ventilation,
+       uint8_t *restrict changed, uint32_t *restrict rng)
+{
+  uint32_t i;
+
+  for(i = 0; i < n; i++) {
+    uint32_t r = rng[i];
+    int t = temp[i];
+    int sp = setpoint[i];
+    uint8_t h, c, v;
+
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    rng[i] = r;
+    h = (t < sp - 1) | (heating[i] & (t < sp));
+    c = (t > sp + 1) | (conditioning[i] & (t > sp));
+    v = ventilation[i] ^ ((r & VENTILATION_MASK) == 0);
+    changed[i] |= (h ^ heating[i]) | (c ^ conditioning[i]) |
+                  (v ^ ventilation[i]);
+    heating[i] = h;
+    conditioning[i] = c;
+    ventilation[i] = v;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The control loop of the mote; heating and conditioning are never on
+   together, so applying both at once is the same as one after the other */
+static void
+control(uint32_t n, int16_t *restrict temp, const uint8_t *restrict heating,
+        const uint8_t *restrict conditioning,
+        const uint8_t *restrict ventilation, uint8_t *restrict changed)
+{
+  uint32_t i;
+
+  for(i = 0; i < n; i++) {
+    int t = temp[i];
+    int up = heating[i] & (t < THERMAL_MODEL_MAX_TEMP);
+    int down = conditioning[i] & (t > THERMAL_MODEL_MIN_TEMP);
+    int delta = (up - down) * (1 + ventilation[i]);
+
+    temp[i] = t + delta;
+    changed[i] |= delta != 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+slice(const struct thermal_model *m, int k, uint32_t *first, uint32_t *last)
+{
+  uint32_t per = (m->count + m->threads - 1) / m->threads;
+
+  per = (per + THERMAL_MODEL_SLICE - 1) / THERMAL_MODEL_SLICE *
+        THERMAL_MODEL_SLICE;
+  *first = (uint64_t)k * per < m->count ? k * per : m->count;
+  *last = m->count - *first > per ? *first + per : m->count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+step_slice(struct thermal_model *m, int k)
+{
+  uint32_t first, last;
+
+  slice(m, k, &first, &last);
+  if(m->occupants) {
+    occupy(last - first, m->temp + first, m->setpoint + first,
+           m->heating + first, m->conditioning + first,
+           m->ventilation + first, m->changed + first, m->rng + first);
+  }
+  control(last - first, m->temp + first, m->heating + first,
+          m->conditioning + first, m->ventilation + first,
+          m->changed + first);
+}
+/*---------------------------------------------------------------------------*/
+static void *
+worker(void *arg)
+{
+  struct worker_arg *w = arg;
+  struct thermal_model *m = w->m;
+  int k = w->slice;
+  unsigned seen = 0;
+
+  free(w);
+  pthread_mutex_lock(&m->lock);
+  for(;;) {
+    while(m->generation == seen && !m->quit) {
+      pthread_cond_wait(&m->go, &m->lock);
+    }
+    if(m->quit) {
+      break;
+    }
+    seen = m->generation;
+    pthread_mutex_unlock(&m->lock);
+    step_slice(m, k);
+    pthread_mutex_lock(&m->lock);
+    if(--m->pending == 0) {
+      pthread_cond_signal(&m->done);
+    }
+  }
+  pthread_mutex_unlock(&m->lock);
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void *
+column(uint32_t count, size_t size)
+{
+  void *p;
+
+  if(posix_memalign(&p, 64, (size_t)count * size + 64) != 0) {
+    return NULL;
+  }
+  memset(p, 0, (size_t)count * size);
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_columns(struct thermal_model *m)
+{
+  free(m->temp);
+  free(m->heating);
+  free(m->conditioning);
+  free(m->ventilation);
+  free(m->changed);
+  free(m->setpoint);
+  free(m->rng);
+  free(m);
+}
+/*---------------------------------------------------------------------------*/
+struct thermal_model *
+thermal_model_create(uint32_t count, int threads, uint32_t seed)
+{
+  struct thermal_model *m;
+  struct worker_arg *w;
+  uint32_t i, r;
+  int k;
+
+  m = calloc(1, sizeof(*m));
+  if(m == NULL) {
+    return NULL;
+  }
+  m->count = count;
+  m->temp = column(count, sizeof(*m->temp));
+  m->heating = column(count, sizeof(*m->heating));
+  m->conditioning = column(count, sizeof(*m->conditioning));
+  m->ventilation = column(count, sizeof(*m->ventilation));
+  m->changed = column(count, sizeof(*m->changed));
+  m->setpoint = column(count, sizeof(*m->setpoint));
+  m->rng = column(count, sizeof(*m->rng));
+  if(m->temp == NULL || m->heating == NULL || m->conditioning == NULL ||
+     m->ventilation == NULL || m->changed == NULL || m->setpoint == NULL ||
+     m->rng == NULL) {
+    free_columns(m);
+    return NULL;
+  }
+
+  for(i = 0; i < count; i++) {
+    /* A different, never zero, xorshift state per thermostat */
+    r = (seed + i) * 2654435761u;
+    r ^= r >> 15;
+    m->rng[i] = r != 0 ? r : 1;
+    m->temp[i] = r % 20 + 10;
+    m->setpoint[i] = (r >> 8) % 6 + 18;
+  }
+
+  pthread_mutex_init(&m->lock, NULL);
+  pthread_cond_init(&m->go, NULL);
+  pthread_cond_init(&m->done, NULL);
+  m->threads = 1;
+  if(threads > 1) {
+    m->workers = calloc(threads - 1, sizeof(*m->workers));
+  }
+  /* With fewer threads than asked for, the slices are just larger */
+  for(k = 1; k < threads && m->workers != NULL; k++) {
+    w = malloc(sizeof(*w));
+    if(w == NULL) {
+      break;
+    }
+    w->m = m;
+    w->slice = k;
+    if(pthread_create(&m->workers[k - 1], NULL, worker, w) != 0) {
+      free(w);
+      break;
+    }
+    m->threads++;
+  }
+  return m;
+}
+/*---------------------------------------------------------------------------*/
+void
+thermal_model_destroy(struct thermal_model *m)
+{
+  int k;
+
+  pthread_mutex_lock(&m->lock);
+  m->quit = 1;
+  pthread_cond_broadcast(&m->go);
+  pthread_mutex_unlock(&m->lock);
+  for(k = 1; k < m->threads; k++) {
+    pthread_join(m->workers[k - 1], NULL);
+  }
+  pthread_mutex_destroy(&m->lock);
+  pthread_cond_destroy(&m->go);
+  pthread_cond_destroy(&m->done);
+  free(m->workers);
+  free_columns(m);
+}
+/*---------------------------------------------------------------------------*/
+void
+thermal_model_step(struct thermal_model *m)
+{
+  if(m->threads == 1) {
+    step_slice(m, 0);
+    return;
+  }
+  pthread_mutex_lock(&m->lock);
+  m->generation++;
+  m->pending = m->threads - 1;
+  pthread_cond_broadcast(&m->go);
+  pthread_mutex_unlock(&m->lock);
+
+  step_slice(m, 0);
+
+  pthread_mutex_lock(&m->lock);
+  while(m->pending > 0) {
+    pthread_cond_wait(&m->done, &m->lock);
+  }
+  pthread_mutex_unlock(&m->lock);
+}
+/*---------------------------------------------------------------------------*/
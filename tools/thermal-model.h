@@ -0,0 +1,94 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Thermal model of many thermostats at once
+ *
+ *         The control loop of smart-thermostat-server.c, kept for every
+ *         thermostat in one array per variable (temperature, heating,
+ *         conditioning, ventilation) rather than one struct per thermostat.
+ *         A step applies the loop to all of them: heating adds 1 and
+ *         conditioning takes 1 while below max_sensing_temp or above
+ *         min_sensing_temp, twice that with the ventilation on. The loops
+ *         have no branches, so the compiler turns them into vector code,
+ *         and the arrays are cut into slices stepped by a pool of threads.
+ *
+ *         Optionally a synthetic occupant per thermostat switches the
+ *         actuators as the NodeRed flow would: heating below the set
+ *         point, conditioning above it, and the ventilation now and then.
+ */
+
+#ifndef __THERMAL_MODEL_H__
+#define __THERMAL_MODEL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* Constants of smart-thermostat-server.c */
+#define THERMAL_MODEL_MIN_TEMP   1
+#define THERMAL_MODEL_MAX_TEMP   60
+#define THERMAL_MODEL_INTERVAL   20   /* seconds, CONTROL_INTERVAL */
+
+/* Slices are a multiple of this many thermostats, so that no two threads
+   write to the same cache line */
+#define THERMAL_MODEL_SLICE      64
+
+struct thermal_model {
+  uint32_t count;
+  int16_t *temp;
+  uint8_t *heating;
+  uint8_t *conditioning;
+  uint8_t *ventilation;
+  uint8_t *changed;       /* set by a step that changes any of the above */
+  int16_t *setpoint;      /* of the occupant */
+  uint32_t *rng;          /* xorshift32 state of the occupant */
+  int occupants;          /* whether the occupants switch the actuators */
+
+  /* Thread pool, the calling thread takes the first slice */
+  int threads;
+  pthread_t *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t go;
+  pthread_cond_t done;
+  unsigned generation;    /* steps started */
+  int pending;            /* workers still stepping their slice */
+  int quit;
+};
+
+/* count thermostats at a random temperature between 10 and 29, as the
+   motes start, with every actuator off, stepped by up to threads threads.
+   Returns NULL if out of memory. */
+struct thermal_model *thermal_model_create(uint32_t count, int threads,
+                                           uint32_t seed);
+void thermal_model_destroy(struct thermal_model *m);
+
+/* One control interval for every thermostat */
+void thermal_model_step(struct thermal_model *m);
+
+#endif /* __THERMAL_MODEL_H__ */
@@ -0,0 +1,532 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Collector of the thermostat readings
+ *
+ *         Observes /temperature and polls /status on every thermostat and
+ *         appends the readings and actuator states to a tsdb.h store, to
+ *         be read by thermo-export or any program that maps the file.
+ *         The thermostats are given on the command line or, by default,
+ *         taken from the route list of the border router web page, which
+ *         is read again every minute to pick up new motes. With -m, the
+ *         readings are also published to an MQTT broker, one message per
+ *         time window (mqtt-batch.h).
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coap-msg.h"
+#include "mqtt-batch.h"
+#include "tsdb.h"
+
+#define MAX_MOTES TSDB_MOTES
+#define MSG_SIZE  256
+
+/* A lost observation is registered again after 3 missed notifications */
+#define OBSERVE_TIMEOUT 15
+#define DISCOVER_INTERVAL 60
+#define SYNC_INTERVAL 5
+
+/* Token: mote number and resource */
+#define RES_TEMPERATURE 'T'
+#define RES_STATUS      'S'
+
+struct mote {
+  struct in6_addr addr;
+  uint16_t id;              /* in the store */
+  time_t last_notification;
+  time_t observe_sent;
+  time_t status_due;
+  int32_t state[TSDB_KINDS];
+};
+
+static struct mote motes[MAX_MOTES];
+static int num_motes;
+/* Collector mote number + 1 of each store index, 0 if not collected */
+static uint32_t by_id[TSDB_MOTES];
+static int full_reported;
+static struct tsdb *db;
+static int sock = -1;
+static uint16_t next_mid;
+static int verbose;
+static int publish;
+static int status_interval = 20;
+static unsigned long readings;
+static unsigned long bad_messages;
+static volatile sig_atomic_t stop;
+/*---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: thermo-collector [-v] [-o store] [-n records] "
+          "[-r router] [-s seconds]\n"
+          "                        [-m broker [-p port] [-t topic] "
+          "[-w seconds] [-F format]\n"
+          "                         [-u user] [-k password]] [mote...]\n"
+          "  -o  store file, created if missing (thermostat.tsdb)\n"
+          "  -n  records kept in a new store (1048576)\n"
+          "  -r  border router to take the motes from "
+          "(aaaa::212:7401:1:101)\n"
+          "  -s  /status polling interval (20)\n"
+          "  -m  publish to this MQTT broker (port 1883), one message per "
+          "window\n"
+          "  -t  topic (thermostat/batch)\n"
+          "  -w  window (60)\n"
+          "  -F  compact, thingspeak (room means) or thingspeak-house\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+/*---------------------------------------------------------------------------*/
+static int64_t
+now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+/*---------------------------------------------------------------------------*/
+static struct mote *
+add_mote(const struct in6_addr *addr)
+{
+  struct mote *m;
+  char str[INET6_ADDRSTRLEN];
+  int id;
+  int i;
+
+  id = tsdb_mote(db, addr->s6_addr);
+  if(id >= 0 && by_id[id] != 0) {
+    return &motes[by_id[id] - 1];
+  }
+  if(num_motes == MAX_MOTES || id < 0) {
+    if(!full_reported) {
+      fprintf(stderr, "thermo-collector: mote table full (%d motes), %s "
+              "and any further mote not collected\n", num_motes,
+              inet_ntop(AF_INET6, addr, str, sizeof(str)));
+      full_reported = 1;
+    }
+    return NULL;
+  }
+  by_id[id] = num_motes + 1;
+  m = &motes[num_motes++];
+  memset(m, 0, sizeof(*m));
+  m->addr = *addr;
+  m->id = id;
+  for(i = 0; i < TSDB_KINDS; i++) {
+    m->state[i] = -1;
+  }
+  if(verbose) {
+    printf("thermo-collector: mote %s\n",
+           inet_ntop(AF_INET6, addr, str, sizeof(str)));
+  }
+  return m;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_to(const struct mote *m, const uint8_t *buf, size_t len)
+{
+  struct sockaddr_in6 sin;
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin6_family = AF_INET6;
+  sin.sin6_addr = m->addr;
+  sin.sin6_port = htons(COAP_PORT);
+  if(sendto(sock, buf, len, 0, (struct sockaddr *)&sin, sizeof(sin)) < 0 &&
+     verbose) {
+    perror("thermo-collector: sendto");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+request(struct mote *m, uint8_t res, int32_t observe, const char *uri)
+{
+  uint8_t buf[MSG_SIZE];
+  uint8_t token[3];
+  size_t len;
+
+  token[0] = (m - motes) >> 8;
+  token[1] = (m - motes) & 0xff;
+  token[2] = res;
+  len = coap_build_request(buf, sizeof(buf), COAP_TYPE_CON, COAP_GET,
+                           next_mid++, token, sizeof(token), observe, uri,
+                           NULL, 0);
+  send_to(m, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+record(struct mote *m, uint8_t kind, int32_t value, int64_t time)
+{
+  /* Actuators are stored when they change, temperatures every time */
+  if(kind != TSDB_TEMPERATURE && m->state[kind] == value) {
+    return;
+  }
+  m->state[kind] = value;
+  tsdb_append(db, time, m->id, kind, value);
+  if(publish) {
+    mqtt_batch_add(m->id, m->addr.s6_addr, kind, value);
+  }
+  readings++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+json_value(const char *json, const char *key, int32_t *value)
+{
+  const char *p = strstr(json, key);
+
+  if(p == NULL || (p = strchr(p + strlen(key), ':')) == NULL) {
+    return 0;
+  }
+  *value = strtol(p + 1, NULL, 10);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_message(const uint8_t *buf, size_t len, const struct sockaddr_in6 *from)
+{
+  struct coap_msg msg;
+  struct mote *m;
+  uint8_t reply[4];
+  char text[MSG_SIZE];
+  unsigned index;
+  int64_t time;
+  int32_t value;
+
+  if(coap_parse(&msg, buf, len) < 0) {
+    bad_messages++;
+    return;
+  }
+  index = msg.token_len == 3 ? (msg.token[0] << 8) | msg.token[1] : MAX_MOTES;
+  if(index >= (unsigned)num_motes ||
+     memcmp(&motes[index].addr, &from->sin6_addr, sizeof(struct in6_addr))) {
+    /* Not ours, e.g. a notification for an earlier collector: have the
+       mote drop the observation. */
+    if(msg.type == COAP_TYPE_CON || msg.type == COAP_TYPE_NON) {
+      sendto(sock, reply, coap_build_empty(reply, COAP_TYPE_RST, msg.mid), 0,
+             (const struct sockaddr *)from, sizeof(*from));
+    }
+    return;
+  }
+  m = &motes[index];
+  if(msg.type == COAP_TYPE_CON) {
+    sendto(sock, reply, coap_build_empty(reply, COAP_TYPE_ACK, msg.mid), 0,
+           (const struct sockaddr *)from, sizeof(*from));
+  }
+  if(msg.code != COAP_CONTENT || msg.payload_len == 0) {
+    return;
+  }
+
+  len = msg.payload_len < sizeof(text) ? msg.payload_len : sizeof(text) - 1;
+  memcpy(text, msg.payload, len);
+  text[len] = '\0';
+  time = now_ms();
+
+  if(msg.token[2] == RES_TEMPERATURE) {
+    m->last_notification = time / 1000;
+    record(m, TSDB_TEMPERATURE, strtol(text, NULL, 10), time);
+  } else if(msg.token[2] == RES_STATUS) {
+    if(json_value(text, "\"heating\"", &value)) {
+      record(m, TSDB_HEATING, value, time);
+    }
+    if(json_value(text, "\"conditioning\"", &value)) {
+      record(m, TSDB_CONDITIONING, value, time);
+    }
+    if(json_value(text, "\"ventilation\"", &value)) {
+      record(m, TSDB_VENTILATION, value, time);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The motes are the /128 routes listed on the router web page */
+static void
+discover(const char *router)
+{
+  struct sockaddr_in6 sin;
+  struct timeval tv = { 2, 0 };
+  struct in6_addr addr;
+  static char page[16384];
+  char str[INET6_ADDRSTRLEN];
+  const char *p;
+  const char *start;
+  size_t len = 0;
+  ssize_t n;
+  int fd;
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin6_family = AF_INET6;
+  sin.sin6_port = htons(80);
+  if(inet_pton(AF_INET6, router, &sin.sin6_addr) != 1) {
+    fprintf(stderr, "thermo-collector: bad router address %s\n", router);
+    exit(1);
+  }
+  fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if(fd < 0) {
+    return;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  if(connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+     write(fd, "GET / HTTP/1.0\r\n\r\n", 18) != 18) {
+    if(verbose) {
+      fprintf(stderr, "thermo-collector: cannot read the routes from %s\n",
+              router);
+    }
+    close(fd);
+    return;
+  }
+  while(len < sizeof(page) - 1 &&
+        (n = read(fd, page + len, sizeof(page) - 1 - len)) > 0) {
+    len += n;
+  }
+  close(fd);
+  page[len] = '\0';
+
+  p = strstr(page, "Routes");
+  while(p != NULL && (p = strstr(p, "/128")) != NULL) {
+    start = p;
+    while(start > page && (isxdigit((unsigned char)start[-1]) ||
+                           start[-1] == ':')) {
+      start--;
+    }
+    if(p - start < (ptrdiff_t)sizeof(str)) {
+      memcpy(str, start, p - start);
+      str[p - start] = '\0';
+      if(inet_pton(AF_INET6, str, &addr) == 1) {
+        add_mote(&addr);
+      }
+    }
+    p += 4;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+tick(time_t now)
+{
+  struct mote *m;
+  int i;
+
+  for(i = 0; i < num_motes; i++) {
+    m = &motes[i];
+    if(now - m->last_notification >= OBSERVE_TIMEOUT &&
+       now - m->observe_sent >= OBSERVE_TIMEOUT) {
+      request(m, RES_TEMPERATURE, 0, "temperature");
+      m->observe_sent = now;
+    }
+    if(now >= m->status_due) {
+      request(m, RES_STATUS, -1, "status");
+      /* Spread the polls of the motes over the interval */
+      m->status_due = now + status_interval + (i % 3) - 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  const char *path = "thermostat.tsdb";
+  const char *router = "aaaa::212:7401:1:101";
+  struct mqtt_batch_config mqtt = { NULL, "1883", "thermostat/batch",
+                                    NULL, NULL, NULL, 60,
+                                    MQTT_BATCH_COMPACT, 0 };
+  char client_id[24];
+  int want_write;
+  int mqtt_fd;
+  uint64_t capacity = 1 << 20;
+  uint8_t buf[MSG_SIZE];
+  struct sockaddr_in6 from;
+  socklen_t fromlen;
+  struct in6_addr addr;
+  time_t now, last_tick = 0, last_discovery = 0, last_sync = 0;
+  time_t started;
+  unsigned long last_readings = 0;
+  int rcvbuf = 1 << 20;
+  ssize_t n;
+  int c;
+
+  while((c = getopt(argc, argv, "vo:n:r:s:m:p:t:w:F:u:k:")) != -1) {
+    switch(c) {
+    case 'v': verbose = 1; break;
+    case 'o': path = optarg; break;
+    case 'n': capacity = strtoull(optarg, NULL, 0); break;
+    case 'r': router = optarg; break;
+    case 's': status_interval = atoi(optarg); break;
+    case 'm': mqtt.host = optarg; break;
+    case 'p': mqtt.port = optarg; break;
+    case 't': mqtt.topic = optarg; break;
+    case 'w': mqtt.window = atoi(optarg); break;
+    case 'u': mqtt.username = optarg; break;
+    case 'k': mqtt.password = optarg; break;
+    case 'F':
+      if(strcmp(optarg, "thingspeak") == 0) {
+        mqtt.format = MQTT_BATCH_THINGSPEAK;
+      } else if(strcmp(optarg, "thingspeak-house") == 0) {
+        mqtt.format = MQTT_BATCH_THINGSPEAK_HOUSE;
+      } else if(strcmp(optarg, "compact") != 0) {
+        usage();
+      }
+      break;
+    default: usage();
+    }
+  }
+  if(status_interval < 1 || mqtt.window < 1) {
+    usage();
+  }
+
+  db = tsdb_open(path, capacity, 1);
+  if(db == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  for(; optind < argc; optind++) {
+    if(inet_pton(AF_INET6, argv[optind], &addr) != 1) {
+      fprintf(stderr, "thermo-collector: bad address %s\n", argv[optind]);
+      exit(1);
+    }
+    add_mote(&addr);
+  }
+  if(num_motes > 0) {
+    router = NULL;
+  }
+
+  sock = socket(AF_INET6, SOCK_DGRAM, 0);
+  if(sock < 0) {
+    perror("socket");
+    exit(1);
+  }
+  /* Room for the notifications that arrive while the route list is read */
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  next_mid = getpid();
+
+  if(mqtt.host != NULL) {
+    snprintf(client_id, sizeof(client_id), "thermo-collector-%d",
+             (int)getpid() % 100000);
+    mqtt.client_id = client_id;
+    mqtt.verbose = verbose;
+    mqtt_batch_init(&mqtt);
+    publish = 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  started = time(NULL);
+
+  while(!stop) {
+    fd_set rset, wset;
+    struct timeval tv = { 1, 0 };
+    int maxfd = sock;
+
+    now = time(NULL);
+    if(router != NULL && now - last_discovery >= DISCOVER_INTERVAL) {
+      discover(router);
+      last_discovery = now;
+    }
+    if(now != last_tick) {
+      tick(now);
+      last_tick = now;
+    }
+    if(now - last_sync >= SYNC_INTERVAL) {
+      tsdb_sync(db);
+      if(verbose && readings != last_readings) {
+        printf("thermo-collector: %lu readings from %d motes, %llu stored\n",
+               readings, num_motes, (unsigned long long)tsdb_count(db));
+        last_readings = readings;
+      }
+      last_sync = now;
+    }
+    if(publish) {
+      mqtt_batch_poll(now);
+    }
+
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    FD_SET(sock, &rset);
+    mqtt_fd = publish ? mqtt_batch_fd(&want_write) : -1;
+    if(mqtt_fd >= 0) {
+      FD_SET(mqtt_fd, &rset);
+      if(want_write) {
+        FD_SET(mqtt_fd, &wset);
+      }
+      if(mqtt_fd > maxfd) {
+        maxfd = mqtt_fd;
+      }
+    }
+    if(select(maxfd + 1, &rset, &wset, NULL, &tv) < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      perror("select");
+      exit(1);
+    }
+    if(!FD_ISSET(sock, &rset)) {
+      continue;
+    }
+    /* Drain the socket before looking at the clock again */
+    while((fromlen = sizeof(from),
+           n = recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT,
+                        (struct sockaddr *)&from, &fromlen)) > 0) {
+      handle_message(buf, n, &from);
+    }
+  }
+
+  now = time(NULL);
+  printf("thermo-collector: %lu readings in %ld s, %lu bad messages\n",
+         readings, (long)(now - started), bad_messages);
+  if(publish) {
+    printf("thermo-collector: %lu messages published, %lu acknowledged, "
+           "%d queued, %lu windows merged, %lu bytes to the broker\n",
+           mqtt_batch_stats.published, mqtt_batch_stats.acked,
+           mqtt_batch_queued(), mqtt_batch_stats.merged,
+           mqtt_batch_stats.bytes);
+  }
+  tsdb_close(db);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,204 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Export of the readings stored by thermo-collector
+ *
+ *         Maps the store read-only and prints the records of a time range
+ *         as CSV, or with -s the count, minimum, maximum and mean of each
+ *         mote and kind. The columns are read in place, so the collector
+ *         can keep writing meanwhile.
+ */
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tsdb.h"
+
+struct summary {
+  uint64_t count;
+  int64_t sum;
+  int32_t min;
+  int32_t max;
+};
+/*---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: thermo-export [-s] [-f from] [-t to] [-m mote] [-k kind] "
+          "[store]\n"
+          "  -f, -t  range in seconds since the epoch, or before now if "
+          "negative\n"
+          "  -m      only this mote address\n"
+          "  -k      only temperature, heating, conditioning or ventilation\n"
+          "  -s      summary per mote and kind instead of the records\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static int64_t
+parse_time(const char *s)
+{
+  long long t = strtoll(s, NULL, 10);
+
+  if(t < 0) {
+    t += time(NULL);
+  }
+  return t * 1000;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  static struct summary summary[TSDB_MOTES][TSDB_KINDS];
+  const char *path = "thermostat.tsdb";
+  int64_t from = INT64_MIN;
+  int64_t to = INT64_MAX;
+  int mote = -1;
+  int kind = -1;
+  int summarize = 0;
+  struct in6_addr addr;
+  char str[INET6_ADDRSTRLEN];
+  struct tsdb *db;
+  struct summary *s;
+  uint64_t first, count, n, slot;
+  uint32_t motes, i;
+  int k, c;
+
+  while((c = getopt(argc, argv, "sf:t:m:k:")) != -1) {
+    switch(c) {
+    case 's': summarize = 1; break;
+    case 'f': from = parse_time(optarg); break;
+    case 't': to = parse_time(optarg); break;
+    case 'm':
+      if(inet_pton(AF_INET6, optarg, &addr) != 1) {
+        usage();
+      }
+      mote = -2;
+      break;
+    case 'k':
+      for(kind = 0; kind < TSDB_KINDS; kind++) {
+        if(strcmp(optarg, tsdb_kind_name(kind)) == 0) {
+          break;
+        }
+      }
+      if(kind == TSDB_KINDS) {
+        usage();
+      }
+      break;
+    default: usage();
+    }
+  }
+  if(optind < argc) {
+    path = argv[optind++];
+  }
+  if(optind != argc) {
+    usage();
+  }
+
+  db = tsdb_open(path, 0, 0);
+  if(db == NULL) {
+    perror(path);
+    exit(1);
+  }
+  motes = __atomic_load_n(&db->hdr->motes, __ATOMIC_ACQUIRE);
+  if(mote == -2) {
+    for(i = 0; i < motes; i++) {
+      if(memcmp(db->mote_addr[i], addr.s6_addr, 16) == 0) {
+        mote = i;
+      }
+    }
+    if(mote < 0) {
+      fprintf(stderr, "thermo-export: no records of that mote\n");
+      exit(1);
+    }
+  }
+
+  count = tsdb_count(db);
+  first = tsdb_find(db, from);
+  if(!summarize) {
+    printf("time,mote,kind,value\n");
+  }
+  for(n = first; n < count; n++) {
+    slot = TSDB_SLOT(db, n);
+    if(db->time[slot] >= to) {
+      break;
+    }
+    if((mote >= 0 && db->mote[slot] != mote) ||
+       (kind >= 0 && db->kind[slot] != kind) ||
+       db->mote[slot] >= motes || db->kind[slot] >= TSDB_KINDS) {
+      continue;
+    }
+    if(summarize) {
+      s = &summary[db->mote[slot]][db->kind[slot]];
+      if(s->count == 0 || db->value[slot] < s->min) {
+        s->min = db->value[slot];
+      }
+      if(s->count == 0 || db->value[slot] > s->max) {
+        s->max = db->value[slot];
+      }
+      s->sum += db->value[slot];
+      s->count++;
+      continue;
+    }
+    inet_ntop(AF_INET6, db->mote_addr[db->mote[slot]], str, sizeof(str));
+    printf("%lld.%03d,%s,%s,%d\n", (long long)(db->time[slot] / 1000),
+           (int)(db->time[slot] % 1000), str,
+           tsdb_kind_name(db->kind[slot]), db->value[slot]);
+  }
+  /* The collector may have gone round the ring meanwhile */
+  if(tsdb_first(db) > first) {
+    fprintf(stderr, "thermo-export: the oldest records were overwritten "
+            "while being read\n");
+  }
+
+  if(summarize) {
+    printf("mote,kind,count,min,max,mean\n");
+    for(i = 0; i < motes; i++) {
+      for(k = 0; k < TSDB_KINDS; k++) {
+        s = &summary[i][k];
+        if(s->count == 0) {
+          continue;
+        }
+        inet_ntop(AF_INET6, db->mote_addr[i], str, sizeof(str));
+        printf("%s,%s,%llu,%d,%d,%.2f\n", str, tsdb_kind_name(k),
+               (unsigned long long)s->count, s->min, s->max,
+               (double)s->sum / s->count);
+      }
+    }
+  }
+  tsdb_close(db);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,603 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Simulation of a large number of thermostats
+ *
+ *         Steps the thermal model of thermal-model.h for every thermostat
+ *         every 20 simulated seconds. Without -c, it runs as fast as it
+ *         can and reports the step rate and the notification traffic that
+ *         the thermostats would send, for capacity planning. With -c, it
+ *         answers CoAP for all of them in real time (or -x times faster),
+ *         as the motes do: /temperature, observable and notified every
+ *         5 s, /status and POST /leds. Thermostat i is prefix::i+1; route
+ *         the prefix to the loopback interface so that this process
+ *         receives for all of them:
+ *
+ *           ip -6 route add local aaaa::/64 dev lo
+ *
+ *         and point thermo-collector, or anything else that talks to the
+ *         motes, at those addresses.
+ */
+
+#define _GNU_SOURCE     /* struct in6_pktinfo */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coap-msg.h"
+#include "thermal-model.h"
+
+#define MSG_SIZE 256
+
+/* Period of the /temperature notifications of the motes */
+#define OBSERVE_PERIOD 5
+
+struct observer {
+  struct sockaddr_in6 addr;
+  uint32_t seq;
+  uint16_t mid;           /* of the last notification */
+  uint8_t active;
+  uint8_t token_len;
+  uint8_t token[COAP_MAX_TOKEN];
+};
+
+static struct thermal_model *model;
+static struct observer *observers;
+static struct in6_addr prefix;
+static int sock = -1;
+static uint16_t next_mid;
+static int verbose;
+
+static unsigned long requests;
+static unsigned long notifications;
+static unsigned long long notification_bytes;
+static unsigned long changes;
+static unsigned long steps;
+static volatile sig_atomic_t stop;
+/*---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: thermo-sim [-v] [-n thermostats] [-j threads] [-S seed] "
+          "[-x speed] [-d seconds] [-q]\n"
+          "                  [-c prefix [-p port] [-l]]\n"
+          "  -n  thermostats (50000)\n"
+          "  -j  threads stepping the model (processors online)\n"
+          "  -x  simulated seconds per second (1), as fast as possible "
+          "without -c\n"
+          "  -d  simulated seconds to run, 0 for ever (3600, 0 with -c)\n"
+          "  -q  no occupants: the actuators only change on POST /leds\n"
+          "  -c  serve the thermostats over CoAP as prefix::1, prefix::2...\n"
+          "  -p  CoAP port (5683)\n"
+          "  -l  print the thermostat addresses and exit\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+/*---------------------------------------------------------------------------*/
+static double
+now_s(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mote_addr(uint32_t i, struct in6_addr *addr)
+{
+  *addr = prefix;
+  memset(addr->s6_addr + 8, 0, 4);
+  addr->s6_addr[12] = (i + 1) >> 24;
+  addr->s6_addr[13] = (i + 1) >> 16;
+  addr->s6_addr[14] = (i + 1) >> 8;
+  addr->s6_addr[15] = i + 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Thermostat at addr, model->count if none */
+static uint32_t
+mote_index(const struct in6_addr *addr)
+{
+  const uint8_t *a = addr->s6_addr;
+  uint32_t n;
+
+  if(memcmp(a, prefix.s6_addr, 8) != 0 ||
+     (a[8] | a[9] | a[10] | a[11]) != 0) {
+    return model->count;
+  }
+  n = ((uint32_t)a[12] << 24) | (a[13] << 16) | (a[14] << 8) | a[15];
+  return n >= 1 && n <= model->count ? n - 1 : model->count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_changes(void)
+{
+  uint32_t i;
+
+  for(i = 0; i < model->count; i++) {
+    changes += model->changed[i];
+  }
+  memset(model->changed, 0, model->count);
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+notification(uint8_t *buf, size_t size, uint32_t i, const uint8_t *token,
+             uint8_t token_len, uint16_t mid, uint32_t seq)
+{
+  char text[8];
+  int len;
+
+  len = snprintf(text, sizeof(text), "%u", (unsigned)model->temp[i]);
+  return coap_build_request(buf, size, COAP_TYPE_NON, COAP_CONTENT, mid,
+                            token, token_len, seq & 0xffffff, "",
+                            (const uint8_t *)text, len);
+}
+/*---------------------------------------------------------------------------*/
+/* Send from the address of thermostat i */
+static void
+send_from(uint32_t i, const struct sockaddr_in6 *to, const uint8_t *buf,
+          size_t len)
+{
+  union {
+    struct cmsghdr hdr;
+    uint8_t space[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+  } control;
+  struct in6_pktinfo *info;
+  struct cmsghdr *cmsg;
+  struct msghdr mh;
+  struct iovec iov;
+
+  iov.iov_base = (void *)buf;
+  iov.iov_len = len;
+  memset(&mh, 0, sizeof(mh));
+  memset(&control, 0, sizeof(control));
+  mh.msg_name = (void *)to;
+  mh.msg_namelen = sizeof(*to);
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = &control;
+  mh.msg_controllen = sizeof(control);
+  cmsg = CMSG_FIRSTHDR(&mh);
+  cmsg->cmsg_level = IPPROTO_IPV6;
+  cmsg->cmsg_type = IPV6_PKTINFO;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(*info));
+  info = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+  mote_addr(i, &info->ipi6_addr);
+  if(sendmsg(sock, &mh, 0) < 0 && verbose) {
+    perror("thermo-sim: sendmsg");
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Value of name in a "a=1&b=2" list, into out */
+static int
+variable(const char *s, size_t len, const char *name, char *out,
+         size_t size)
+{
+  size_t n = strlen(name);
+  const char *end = s + len;
+  const char *v;
+
+  while(s < end) {
+    v = memchr(s, '&', end - s);
+    v = v != NULL ? v : end;
+    if((size_t)(v - s) > n && memcmp(s, name, n) == 0 && s[n] == '=' &&
+       (size_t)(v - s - n - 1) < size) {
+      memcpy(out, s + n + 1, v - s - n - 1);
+      out[v - s - n - 1] = '\0';
+      return 1;
+    }
+    s = v + 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* POST /leds of the mote: color r, g or b is heating, ventilation or
+   conditioning; heating and conditioning are never on together */
+static const char *
+leds(uint32_t i, const struct coap_msg *msg)
+{
+  const char *query = strchr(msg->uri, '?');
+  char color[2], mode[4];
+  uint8_t *unit;
+
+  if(query == NULL ||
+     !variable(query + 1, strlen(query + 1), "color", color, sizeof(color)) ||
+     !variable((const char *)msg->payload, msg->payload_len, "mode", mode,
+               sizeof(mode))) {
+    return NULL;
+  }
+  switch(color[0]) {
+  case 'r': unit = &model->heating[i]; break;
+  case 'g': unit = &model->ventilation[i]; break;
+  case 'b': unit = &model->conditioning[i]; break;
+  default: return NULL;
+  }
+  if(strcmp(mode, "on") == 0) {
+    if((color[0] == 'r' && model->conditioning[i]) ||
+       (color[0] == 'b' && model->heating[i])) {
+      return NULL;
+    }
+    model->changed[i] |= !*unit;
+    *unit = 1;
+    return "mode=on";
+  } else if(strcmp(mode, "off") == 0) {
+    model->changed[i] |= *unit;
+    *unit = 0;
+    return "mode=off";
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+serve(uint32_t i, const struct sockaddr_in6 *from, const uint8_t *buf,
+      size_t len)
+{
+  struct observer *o = &observers[i];
+  struct coap_msg msg;
+  uint8_t reply[MSG_SIZE];
+  char text[80];
+  const char *payload = text;
+  uint8_t code = COAP_CONTENT;
+  int32_t observe = -1;
+
+  if(coap_parse(&msg, buf, len) < 0) {
+    return;
+  }
+  if(msg.type == COAP_TYPE_RST) {
+    /* The observer does not want the notifications any more */
+    if(o->active && msg.mid == o->mid) {
+      o->active = 0;
+    }
+    return;
+  } else if(msg.type == COAP_TYPE_ACK) {
+    return;
+  }
+  requests++;
+
+  if(msg.code == COAP_GET && strcmp(msg.uri, "temperature") == 0) {
+    if(msg.observe == 0) {
+      o->addr = *from;
+      o->token_len = msg.token_len;
+      memcpy(o->token, msg.token, msg.token_len);
+      o->active = 1;
+      observe = o->seq;
+    } else if(msg.observe == 1 && o->active && o->token_len == msg.token_len &&
+              memcmp(o->token, msg.token, msg.token_len) == 0) {
+      o->active = 0;
+    }
+    snprintf(text, sizeof(text), "%u", (unsigned)model->temp[i]);
+  } else if(msg.code == COAP_GET && strcmp(msg.uri, "status") == 0) {
+    snprintf(text, sizeof(text),
+             "[{\"heating\": %u}, {\"conditioning\": %u}, "
+             "{\"ventilation\": %u}]", model->heating[i],
+             model->conditioning[i], model->ventilation[i]);
+  } else if(msg.code == COAP_POST && strncmp(msg.uri, "leds?", 5) == 0) {
+    payload = leds(i, &msg);
+    if(payload == NULL) {
+      code = COAP_NOT_ACCEPTABLE;
+      payload = "KO";
+    }
+  } else {
+    code = COAP_NOT_FOUND;
+    payload = "";
+  }
+
+  len = coap_build_request(reply, sizeof(reply),
+                           msg.type == COAP_TYPE_CON ? COAP_TYPE_ACK
+                                                     : COAP_TYPE_NON,
+                           code, msg.type == COAP_TYPE_CON ? msg.mid
+                                                           : next_mid++,
+                           msg.token, msg.token_len, observe, "",
+                           (const uint8_t *)payload, strlen(payload));
+  if(len > 0) {
+    send_from(i, from, reply, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+receive(void)
+{
+  union {
+    struct cmsghdr hdr;
+    uint8_t space[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+  } control;
+  struct in6_pktinfo *info = NULL;
+  struct sockaddr_in6 from;
+  struct cmsghdr *cmsg;
+  struct msghdr mh;
+  struct iovec iov;
+  uint8_t buf[MSG_SIZE];
+  uint32_t i;
+  ssize_t n;
+
+  for(;;) {
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = &from;
+    mh.msg_namelen = sizeof(from);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = &control;
+    mh.msg_controllen = sizeof(control);
+    n = recvmsg(sock, &mh, MSG_DONTWAIT);
+    if(n < 0) {
+      return;
+    }
+    info = NULL;
+    for(cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL;
+        cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+      if(cmsg->cmsg_level == IPPROTO_IPV6 &&
+         cmsg->cmsg_type == IPV6_PKTINFO) {
+        info = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+      }
+    }
+    if(info == NULL) {
+      continue;
+    }
+    i = mote_index(&info->ipi6_addr);
+    if(i < model->count) {
+      serve(i, &from, buf, n);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Send the notifications due by simulated time sim_ms; thermostat i
+   notifies at i / count of each period, so that they are spread evenly */
+static void
+notify(uint64_t *sent, uint64_t sim_ms)
+{
+  uint8_t buf[MSG_SIZE];
+  struct observer *o;
+  uint64_t due;
+  uint32_t i;
+  size_t len;
+
+  due = sim_ms * model->count / (OBSERVE_PERIOD * 1000);
+  if(due - *sent > model->count) {
+    /* Fell behind by more than a period: skip rather than burst */
+    *sent = due - model->count;
+  }
+  for(; *sent < due; (*sent)++) {
+    i = *sent % model->count;
+    o = &observers[i];
+    if(!o->active) {
+      continue;
+    }
+    o->seq++;
+    o->mid = next_mid++;
+    len = notification(buf, sizeof(buf), i, o->token, o->token_len, o->mid,
+                       o->seq);
+    send_from(i, &o->addr, buf, len);
+    notifications++;
+    notification_bytes += len;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Step as fast as possible and build, without sending, the notifications
+   of every thermostat */
+static void
+benchmark(uint64_t duration)
+{
+  const uint8_t token[3] = { 0, 0, 'T' };
+  uint8_t buf[MSG_SIZE];
+  double start, stepping = 0, t;
+  uint64_t sim;
+  uint32_t i, seq = 0;
+  int k;
+
+  start = now_s();
+  for(sim = THERMAL_MODEL_INTERVAL; sim <= duration && !stop;
+      sim += THERMAL_MODEL_INTERVAL) {
+    t = now_s();
+    thermal_model_step(model);
+    stepping += now_s() - t;
+    steps++;
+    count_changes();
+    for(k = 0; k < THERMAL_MODEL_INTERVAL / OBSERVE_PERIOD; k++) {
+      seq++;
+      for(i = 0; i < model->count; i++) {
+        notification_bytes += notification(buf, sizeof(buf), i, token,
+                                           sizeof(token), i, seq);
+      }
+      notifications += model->count;
+    }
+  }
+  t = now_s() - start;
+  sim -= THERMAL_MODEL_INTERVAL;
+
+  printf("thermo-sim: %u thermostats, %lu steps in %.3f s on %d threads, "
+         "%.0f thermostat steps/s\n", model->count, steps, stepping,
+         model->threads, stepping > 0 ? model->count * steps / stepping : 0);
+  printf("thermo-sim: %lu notifications, %.0f/s built\n", notifications,
+         t > 0 ? notifications / t : 0);
+  if(sim > 0) {
+    printf("thermo-sim: network load %.0f notifications/s, %.0f bytes/s of "
+           "CoAP, %.2f changes per thermostat per hour\n",
+           (double)notifications / sim, (double)notification_bytes / sim,
+           (double)changes / model->count * 3600 / sim);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(uint64_t duration, double speed, int port)
+{
+  struct sockaddr_in6 sin;
+  struct sigaction sa;
+  double start, last_report;
+  uint64_t sim_ms, next_step, sent = 0;
+  int one = 1;
+
+  observers = calloc(model->count, sizeof(*observers));
+  if(observers == NULL) {
+    perror("thermo-sim");
+    exit(1);
+  }
+  sock = socket(AF_INET6, SOCK_DGRAM, 0);
+  if(sock < 0) {
+    perror("socket");
+    exit(1);
+  }
+  setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &one, sizeof(one));
+  setsockopt(sock, IPPROTO_IPV6, IPV6_FREEBIND, &one, sizeof(one));
+  memset(&sin, 0, sizeof(sin));
+  sin.sin6_family = AF_INET6;
+  sin.sin6_addr = in6addr_any;
+  sin.sin6_port = htons(port);
+  if(bind(sock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+    perror("bind");
+    exit(1);
+  }
+  next_mid = getpid();
+
+  /* Without SA_RESTART, so that a signal ends select() */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  start = last_report = now_s();
+  next_step = THERMAL_MODEL_INTERVAL * 1000;
+  while(!stop) {
+    fd_set rset;
+    struct timeval tv = { 0, 10000 };
+    double now = now_s();
+
+    sim_ms = (now - start) * speed * 1000;
+    if(duration > 0 && sim_ms >= duration * 1000) {
+      break;
+    }
+    while(sim_ms >= next_step) {
+      thermal_model_step(model);
+      steps++;
+      count_changes();
+      next_step += THERMAL_MODEL_INTERVAL * 1000;
+    }
+    notify(&sent, sim_ms);
+    if(verbose && now - last_report >= 10) {
+      printf("thermo-sim: %lu steps, %lu requests, %lu notifications\n",
+             steps, requests, notifications);
+      fflush(stdout);
+      last_report = now;
+    }
+
+    FD_ZERO(&rset);
+    FD_SET(sock, &rset);
+    if(select(sock + 1, &rset, NULL, NULL, &tv) > 0) {
+      receive();
+    }
+  }
+
+  printf("thermo-sim: %u thermostats, %lu steps, %lu requests, "
+         "%lu notifications (%llu bytes), %lu changes\n", model->count,
+         steps, requests, notifications, notification_bytes, changes);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  uint32_t count = 50000, seed = 1, i;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int occupants = 1, serve_coap = 0, list = 0, port = COAP_PORT;
+  long duration = -1;
+  double speed = -1;
+  char text[INET6_ADDRSTRLEN];
+  struct in6_addr addr;
+  int c;
+
+  while((c = getopt(argc, argv, "vn:j:S:x:d:qc:p:l")) != -1) {
+    switch(c) {
+    case 'v': verbose = 1; break;
+    case 'n': count = strtoul(optarg, NULL, 0); break;
+    case 'j': threads = atoi(optarg); break;
+    case 'S': seed = strtoul(optarg, NULL, 0); break;
+    case 'x': speed = atof(optarg); break;
+    case 'd': duration = atol(optarg); break;
+    case 'q': occupants = 0; break;
+    case 'c':
+      if(inet_pton(AF_INET6, optarg, &prefix) != 1) {
+        fprintf(stderr, "thermo-sim: bad prefix %s\n", optarg);
+        exit(1);
+      }
+      serve_coap = 1;
+      break;
+    case 'p': port = atoi(optarg); break;
+    case 'l': list = 1; break;
+    default: usage();
+    }
+  }
+  if(count == 0 || count > 0xfffffffe || optind != argc ||
+     (list && !serve_coap) || (serve_coap && speed == 0)) {
+    usage();
+  }
+  if(duration < 0) {
+    duration = serve_coap ? 0 : 3600;
+  }
+
+  if(list) {
+    for(i = 0; i < count; i++) {
+      mote_addr(i, &addr);
+      printf("%s\n", inet_ntop(AF_INET6, &addr, text, sizeof(text)));
+    }
+    return 0;
+  }
+
+  model = thermal_model_create(count, threads, seed);
+  if(model == NULL) {
+    perror("thermo-sim");
+    exit(1);
+  }
+  model->occupants = occupants;
+
+  if(serve_coap) {
+    run(duration, speed > 0 ? speed : 1, port);
+  } else {
+    signal(SIGINT, on_signal);
+    benchmark(duration);
+  }
+  thermal_model_destroy(model);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,349 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Converts the packet trace of the border router to pcap
+ *
+ *         Reads the text served at http://[router]/dump (WITH_TRACE=1)
+ *         and writes a pcap file in the Linux cooked capture format: one
+ *         packet per record, incoming or outgoing, over SLIP or the radio,
+ *         with the IPv6 header rebuilt from the recorded addresses under
+ *         the prefix given with -p, and the UDP and CoAP headers of CoAP
+ *         packets. The original length is the recorded one, so the
+ *         packets show as truncated captures. Timestamps are the clock
+ *         ticks of the router completed with its rtimer, to 1/32768 s,
+ *         from its boot or from -s seconds.
+ *
+ *         -l lists, for every CoAP message ID, the time from each record
+ *         of it to the next one instead: from the host to the radio is
+ *         the time spent in the router, from the radio back to the radio
+ *         or the host the time spent in the mesh.
+ */
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_RECORDS 4096
+
+/* As in br-trace.h */
+#define TRACE_SLIP_IN   0
+#define TRACE_SLIP_OUT  1
+#define TRACE_RADIO_IN  2
+#define TRACE_RADIO_OUT 3
+#define TRACE_DIR       0x03
+#define TRACE_COAP      0x04
+#define TRACE_NO_IP     0x08
+
+#define LINKTYPE_LINUX_SLL 113
+#define ARPHRD_SLIP        256
+#define ARPHRD_IEEE802154  804
+#define SLL_HOST           0
+#define SLL_OUTGOING       4
+
+#define PROTO_UDP   17
+#define PROTO_ICMP6 58
+#define COAP_PORT   5683
+
+struct record {
+  unsigned long ticks;
+  unsigned rtimer;
+  unsigned flags;
+  unsigned proto;
+  unsigned len;
+  uint8_t src[4];
+  uint8_t dst[4];
+  unsigned mid;
+  unsigned code;
+  unsigned type;
+  double time;          /* s */
+  int line;
+};
+
+static struct record records[MAX_RECORDS];
+static int num_records;
+static unsigned clock_second = 128;
+static unsigned rtimer_second = 32768;
+static uint8_t prefix[16] = { 0xaa, 0xaa };
+static double start;
+
+static const char *dir_names[] = {
+  "slip-in", "slip-out", "radio-in", "radio-out"
+};
+/*---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: trace2pcap [-l] [-p prefix] [-s seconds] [dump] > trace.pcap\n"
+          "  -l  list the times between the records of each CoAP message\n"
+          "  -p  prefix of the recorded addresses (aaaa::)\n"
+          "  -s  time of the boot of the router\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+parse_addr(const char *hex, uint8_t *addr)
+{
+  unsigned long a;
+  char *end;
+
+  a = strtoul(hex, &end, 16);
+  if(*end != '\0' || strlen(hex) != 8) {
+    return 0;
+  }
+  addr[0] = a >> 24;
+  addr[1] = a >> 16;
+  addr[2] = a >> 8;
+  addr[3] = a;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_dump(FILE *in)
+{
+  char line[256], src[16], dst[16];
+  struct record *r;
+  unsigned c, rt;
+  int n = 0;
+
+  while(fgets(line, sizeof(line), in) != NULL) {
+    n++;
+    if(line[0] == '#') {
+      if(sscanf(line, "# clock %u %u", &c, &rt) == 2 && c > 0 && rt > 0) {
+        clock_second = c;
+        rtimer_second = rt;
+      }
+      continue;
+    }
+    if(num_records == MAX_RECORDS) {
+      fprintf(stderr, "trace2pcap: more than %d records\n", MAX_RECORDS);
+      break;
+    }
+    r = &records[num_records];
+    if(sscanf(line, "%lx %x %x %x %x %15s %15s %x %x %x",
+              &r->ticks, &r->rtimer, &r->flags, &r->proto, &r->len,
+              src, dst, &r->mid, &r->code, &r->type) != 10 ||
+       !parse_addr(src, r->src) || !parse_addr(dst, r->dst)) {
+      if(line[strspn(line, " \t\r\n")] != '\0') {
+        fprintf(stderr, "trace2pcap: line %d ignored\n", n);
+      }
+      continue;
+    }
+    r->line = n;
+    num_records++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The rtimer runs from the same timer as the clock: its 16 bits complete
+   the ticks, read just before it. */
+static double
+record_time(const struct record *r)
+{
+  unsigned long long at_tick;
+  long long t;
+
+  at_tick = (unsigned long long)r->ticks * rtimer_second / clock_second;
+  t = at_tick + (int16_t)(r->rtimer - (uint16_t)at_tick);
+  return start + (double)t / rtimer_second;
+}
+/*---------------------------------------------------------------------------*/
+static int
+by_time(const void *a, const void *b)
+{
+  const struct record *ra = a, *rb = b;
+
+  if(ra->time != rb->time) {
+    return ra->time < rb->time ? -1 : 1;
+  }
+  return ra->line - rb->line;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put16(uint8_t *p, unsigned v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(FILE *out, uint32_t v)
+{
+  fwrite(&v, sizeof(v), 1, out);
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_packet(FILE *out, const struct record *r)
+{
+  uint8_t p[16 + 40 + 8 + 4];
+  uint8_t *ip = &p[16];
+  unsigned dir = r->flags & TRACE_DIR;
+  unsigned caplen, len;
+  double secs;
+
+  memset(p, 0, sizeof(p));
+  put16(&p[0], dir == TRACE_SLIP_OUT || dir == TRACE_RADIO_OUT ?
+        SLL_OUTGOING : SLL_HOST);
+  put16(&p[2], dir == TRACE_SLIP_IN || dir == TRACE_SLIP_OUT ?
+        ARPHRD_SLIP : ARPHRD_IEEE802154);
+  if(r->flags & TRACE_NO_IP) {
+    /* A frame for the router itself: only its sender is known */
+    put16(&p[4], 8);
+    memcpy(&p[6 + 4], r->src, 4);
+    caplen = 16;
+  } else {
+    put16(&p[14], 0x86dd);
+    ip[0] = 0x60;
+    put16(&ip[4], r->len > 40 ? r->len - 40 : 0);
+    ip[6] = r->proto;
+    ip[7] = 64;
+    memcpy(&ip[8], prefix, 12);
+    memcpy(&ip[8 + 12], r->src, 4);
+    memcpy(&ip[24], prefix, 12);
+    memcpy(&ip[24 + 12], r->dst, 4);
+    caplen = 16 + 40;
+    if(r->proto == PROTO_UDP && (r->flags & TRACE_COAP)) {
+      put16(&ip[40], COAP_PORT);
+      put16(&ip[42], COAP_PORT);
+      put16(&ip[44], r->len > 40 ? r->len - 40 : 0);
+      ip[48] = 0x40 | (r->type << 4);
+      ip[49] = r->code;
+      put16(&ip[50], r->mid);
+      caplen += 8 + 4;
+    } else if(r->proto == PROTO_ICMP6) {
+      ip[40] = r->type;
+      caplen += 1;
+    }
+  }
+  len = 16 + r->len;
+  if(len < caplen) {
+    len = caplen;
+  }
+
+  secs = r->time;
+  put32(out, (uint32_t)secs);
+  put32(out, (uint32_t)((secs - (uint32_t)secs) * 1000000));
+  put32(out, caplen);
+  put32(out, len);
+  fwrite(p, caplen, 1, out);
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_pcap(FILE *out)
+{
+  static const uint16_t version[2] = { 2, 4 };
+  int i;
+
+  put32(out, 0xa1b2c3d4);
+  fwrite(&version, sizeof(version), 1, out);
+  put32(out, 0);                  /* GMT offset */
+  put32(out, 0);                  /* accuracy */
+  put32(out, 65535);              /* snapshot length */
+  put32(out, LINKTYPE_LINUX_SLL);
+  for(i = 0; i < num_records; i++) {
+    write_packet(out, &records[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+list_coap(void)
+{
+  const struct record *r, *next;
+  int i, j;
+
+  for(i = 0; i < num_records; i++) {
+    r = &records[i];
+    if(!(r->flags & TRACE_COAP)) {
+      continue;
+    }
+    for(j = i + 1; j < num_records; j++) {
+      next = &records[j];
+      if((next->flags & TRACE_COAP) && next->mid == r->mid) {
+        printf("%04x %d.%02d %-9s -> %d.%02d %-9s %9.3f ms\n", r->mid,
+               r->code >> 5, r->code & 0x1f, dir_names[r->flags & TRACE_DIR],
+               next->code >> 5, next->code & 0x1f,
+               dir_names[next->flags & TRACE_DIR],
+               (next->time - r->time) * 1000);
+        break;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  FILE *in = stdin;
+  int list = 0;
+  int c, i;
+
+  while((c = getopt(argc, argv, "lp:s:")) != -1) {
+    switch(c) {
+    case 'l': list = 1; break;
+    case 'p':
+      if(inet_pton(AF_INET6, optarg, prefix) != 1) {
+        fprintf(stderr, "trace2pcap: bad prefix %s\n", optarg);
+        exit(1);
+      }
+      break;
+    case 's': start = atof(optarg); break;
+    default: usage();
+    }
+  }
+  if(optind < argc - 1) {
+    usage();
+  }
+  if(optind == argc - 1 && (in = fopen(argv[optind], "r")) == NULL) {
+    perror(argv[optind]);
+    exit(1);
+  }
+  if(!list && isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "trace2pcap: not writing pcap to a terminal\n");
+    exit(1);
+  }
+
+  read_dump(in);
+  for(i = 0; i < num_records; i++) {
+    records[i].time = record_time(&records[i]);
+  }
+  /* Records added while the dump was sent may come out of order */
+  qsort(records, num_records, sizeof(records[0]), by_time);
+
+  if(list) {
+    list_coap();
+  } else {
+    write_pcap(stdout);
+  }
+  fprintf(stderr, "trace2pcap: %d records\n", num_records);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,319 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Memory-mapped time-series store of the thermostat readings
+ */
+
+#include "tsdb.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC "THERMOTS"
+#define ALIGN 4096
+#define ALIGN_UP(x) (((x) + ALIGN - 1) & ~(uint64_t)(ALIGN - 1))
+/* Open addressing on the mote addresses, at most half full */
+#define HASH_SIZE (2 * TSDB_MOTES)
+/*---------------------------------------------------------------------------*/
+static void
+layout(struct tsdb_header *hdr, uint64_t capacity)
+{
+  uint64_t off;
+
+  capacity = (capacity + TSDB_BLOCK - 1) / TSDB_BLOCK * TSDB_BLOCK;
+  if(capacity == 0) {
+    capacity = TSDB_BLOCK;
+  }
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->version = TSDB_VERSION;
+  hdr->capacity = capacity;
+  /* Each column starts on its own page */
+  off = ALIGN_UP(sizeof(*hdr));
+  hdr->time_offset = off;
+  off = ALIGN_UP(off + capacity * sizeof(int64_t));
+  hdr->value_offset = off;
+  off = ALIGN_UP(off + capacity * sizeof(int32_t));
+  hdr->mote_offset = off;
+  off = ALIGN_UP(off + capacity * sizeof(uint16_t));
+  hdr->kind_offset = off;
+  off = ALIGN_UP(off + capacity * sizeof(uint8_t));
+  hdr->index_offset = off;
+  off = ALIGN_UP(off + capacity / TSDB_BLOCK * sizeof(int64_t));
+  hdr->addr_offset = off;
+  off = ALIGN_UP(off + TSDB_MOTES * 16);
+  hdr->size = off;
+}
+/*---------------------------------------------------------------------------*/
+static int
+valid(const struct tsdb_header *hdr, uint64_t file_size)
+{
+  struct tsdb_header expected;
+
+  if(memcmp(hdr->magic, MAGIC, sizeof(hdr->magic)) != 0 ||
+     hdr->version != TSDB_VERSION || hdr->motes > TSDB_MOTES ||
+     hdr->capacity == 0 || hdr->capacity % TSDB_BLOCK != 0) {
+    return 0;
+  }
+  layout(&expected, hdr->capacity);
+  return hdr->time_offset == expected.time_offset &&
+    hdr->value_offset == expected.value_offset &&
+    hdr->mote_offset == expected.mote_offset &&
+    hdr->kind_offset == expected.kind_offset &&
+    hdr->index_offset == expected.index_offset &&
+    hdr->addr_offset == expected.addr_offset &&
+    hdr->size == expected.size && file_size >= hdr->size;
+}
+/*---------------------------------------------------------------------------*/
+struct tsdb *
+tsdb_open(const char *path, uint64_t capacity, int writable)
+{
+  struct tsdb_header hdr;
+  struct tsdb *db;
+  struct stat st;
+  uint8_t *base;
+  int created = 0;
+  int fd;
+  int err;
+
+  fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if(fd < 0) {
+    return NULL;
+  }
+  if(fstat(fd, &st) < 0) {
+    goto fail;
+  }
+  if(st.st_size == 0 && writable) {
+    layout(&hdr, capacity);
+    if(ftruncate(fd, hdr.size) < 0) {
+      goto fail;
+    }
+    created = 1;
+  } else if(pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+            !valid(&hdr, st.st_size)) {
+    errno = EINVAL;
+    goto fail;
+  }
+
+  base = mmap(NULL, hdr.size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+              MAP_SHARED, fd, 0);
+  if(base == MAP_FAILED) {
+    goto fail;
+  }
+  close(fd);
+
+  db = calloc(1, sizeof(*db));
+  if(db == NULL) {
+    munmap(base, hdr.size);
+    errno = ENOMEM;
+    return NULL;
+  }
+  db->hdr = (struct tsdb_header *)base;
+  if(created) {
+    /* The magic goes last: a store cut short while being created is
+       rejected rather than read as empty. */
+    memcpy(db->hdr, &hdr, sizeof(hdr));
+    memcpy(db->hdr->magic, MAGIC, sizeof(db->hdr->magic));
+  }
+  db->time = (int64_t *)(base + hdr.time_offset);
+  db->value = (int32_t *)(base + hdr.value_offset);
+  db->mote = (uint16_t *)(base + hdr.mote_offset);
+  db->kind = base + hdr.kind_offset;
+  db->index = (int64_t *)(base + hdr.index_offset);
+  db->mote_addr = (uint8_t (*)[16])(base + hdr.addr_offset);
+  db->writable = writable;
+  return db;
+
+fail:
+  err = errno;
+  close(fd);
+  errno = err;
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsdb_close(struct tsdb *db)
+{
+  if(db->writable) {
+    msync(db->hdr, db->hdr->size, MS_SYNC);
+  }
+  munmap(db->hdr, db->hdr->size);
+  free(db->mote_hash);
+  free(db);
+}
+/*---------------------------------------------------------------------------*/
+void
+tsdb_sync(struct tsdb *db)
+{
+  msync(db->hdr, db->hdr->size, MS_ASYNC);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+hash(const uint8_t *addr)
+{
+  uint32_t h = 2166136261u;
+  int i;
+
+  /* FNV-1a */
+  for(i = 0; i < 16; i++) {
+    h = (h ^ addr[i]) * 16777619u;
+  }
+  return h & (HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Slot of addr in the hash table: its own, or the free one for it */
+static uint32_t
+lookup(const struct tsdb *db, const uint8_t *addr)
+{
+  uint32_t h;
+
+  for(h = hash(addr); db->mote_hash[h] != 0; h = (h + 1) & (HASH_SIZE - 1)) {
+    if(memcmp(db->mote_addr[db->mote_hash[h] - 1], addr, 16) == 0) {
+      break;
+    }
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsdb_mote(struct tsdb *db, const uint8_t *addr)
+{
+  uint32_t n = db->hdr->motes;
+  uint32_t i;
+  uint32_t h;
+
+  if(db->mote_hash == NULL) {
+    /* Entries are the mote index + 1, 0 when free */
+    db->mote_hash = calloc(HASH_SIZE, sizeof(uint32_t));
+    if(db->mote_hash == NULL) {
+      return -1;
+    }
+    for(i = 0; i < n; i++) {
+      db->mote_hash[lookup(db, db->mote_addr[i])] = i + 1;
+    }
+  }
+  h = lookup(db, addr);
+  if(db->mote_hash[h] != 0) {
+    return db->mote_hash[h] - 1;
+  }
+  if(n == TSDB_MOTES) {
+    return -1;
+  }
+  memcpy(db->mote_addr[n], addr, 16);
+  __atomic_store_n(&db->hdr->motes, n + 1, __ATOMIC_RELEASE);
+  db->mote_hash[h] = n + 1;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsdb_append(struct tsdb *db, int64_t time, uint16_t mote, uint8_t kind,
+            int32_t value)
+{
+  uint64_t n = db->hdr->count;
+  uint64_t slot = TSDB_SLOT(db, n);
+
+  if(n > 0 && time < db->time[TSDB_SLOT(db, n - 1)]) {
+    time = db->time[TSDB_SLOT(db, n - 1)];
+  }
+  db->time[slot] = time;
+  db->value[slot] = value;
+  db->mote[slot] = mote;
+  db->kind[slot] = kind;
+  if(n % TSDB_BLOCK == 0) {
+    db->index[n / TSDB_BLOCK % (db->hdr->capacity / TSDB_BLOCK)] = time;
+  }
+  __atomic_store_n(&db->hdr->count, n + 1, __ATOMIC_RELEASE);
+}
+/*---------------------------------------------------------------------------*/
+uint64_t
+tsdb_count(const struct tsdb *db)
+{
+  return __atomic_load_n(&db->hdr->count, __ATOMIC_ACQUIRE);
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+first_of(const struct tsdb *db, uint64_t count)
+{
+  return count > db->hdr->capacity ? count - db->hdr->capacity : 0;
+}
+/*---------------------------------------------------------------------------*/
+uint64_t
+tsdb_first(const struct tsdb *db)
+{
+  return first_of(db, tsdb_count(db));
+}
+/*---------------------------------------------------------------------------*/
+uint64_t
+tsdb_find(const struct tsdb *db, int64_t time)
+{
+  uint64_t blocks = db->hdr->capacity / TSDB_BLOCK;
+  uint64_t hi = tsdb_count(db);
+  uint64_t lo = first_of(db, hi);
+  uint64_t b_lo, b_hi, mid;
+
+  /* The index of the blocks that start inside the window narrows the
+     search down to one block, which is then searched record by record.
+     The first block may have been partly reused and is left out. */
+  b_lo = (lo + TSDB_BLOCK - 1) / TSDB_BLOCK;
+  b_hi = hi == 0 ? 0 : (hi - 1) / TSDB_BLOCK + 1;
+  while(b_lo < b_hi) {
+    mid = b_lo + (b_hi - b_lo) / 2;
+    if(db->index[mid % blocks] < time) {
+      lo = mid * TSDB_BLOCK;
+      b_lo = mid + 1;
+    } else {
+      hi = mid * TSDB_BLOCK;
+      b_hi = mid;
+    }
+  }
+  while(lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if(db->time[TSDB_SLOT(db, mid)] < time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+/*---------------------------------------------------------------------------*/
+const char *
+tsdb_kind_name(uint8_t kind)
+{
+  static const char *names[TSDB_KINDS] = {
+    "temperature", "heating", "conditioning", "ventilation"
+  };
+
+  return kind < TSDB_KINDS ? names[kind] : "unknown";
+}
+/*---------------------------------------------------------------------------*/
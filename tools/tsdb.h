@@ -0,0 +1,121 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Memory-mapped time-series store of the thermostat readings
+ *
+ *         One file holds a fixed number of records in columns (time, mote,
+ *         kind, value), used as a ring once full, a time index with the
+ *         time of the first record of every block of TSDB_BLOCK records,
+ *         and the addresses of up to TSDB_MOTES motes.
+ *         Records are appended in time order, so a time range is found by
+ *         a binary search on the index and then inside one block.
+ *
+ *         One process writes; any number of readers map the file read-only
+ *         and use the columns in place. The record count is published
+ *         after the record, so records below it are complete; a reader
+ *         that holds on to old records should check tsdb_first() again,
+ *         as the writer reuses the oldest ones.
+ */
+
+#ifndef __TSDB_H__
+#define __TSDB_H__
+
+#include <stdint.h>
+
+#define TSDB_VERSION 2
+#define TSDB_MOTES   65536  /* as many as the uint16_t mote column numbers */
+#define TSDB_BLOCK   4096   /* records per time index entry */
+
+enum tsdb_kind {
+  TSDB_TEMPERATURE,
+  TSDB_HEATING,
+  TSDB_CONDITIONING,
+  TSDB_VENTILATION,
+  TSDB_KINDS
+};
+
+struct tsdb_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t motes;
+  uint64_t capacity;        /* records, a multiple of TSDB_BLOCK */
+  uint64_t count;           /* records ever appended */
+  /* Byte offsets of the columns in the file */
+  uint64_t time_offset;     /* int64_t, ms since the epoch */
+  uint64_t mote_offset;     /* uint16_t, index in the address table */
+  uint64_t kind_offset;     /* uint8_t, enum tsdb_kind */
+  uint64_t value_offset;    /* int32_t */
+  uint64_t index_offset;    /* int64_t, time of the first record of a block */
+  uint64_t addr_offset;     /* uint8_t[16], address of each mote */
+  uint64_t size;            /* of the file */
+};
+
+struct tsdb {
+  struct tsdb_header *hdr;
+  int64_t *time;
+  uint16_t *mote;
+  uint8_t *kind;
+  int32_t *value;
+  int64_t *index;
+  uint8_t (*mote_addr)[16];
+  uint32_t *mote_hash;      /* of the writer, built on first tsdb_mote() */
+  int writable;
+};
+
+/* Map an existing store, or with writable create it with room for
+   capacity records if it does not exist. Returns NULL with errno set. */
+struct tsdb *tsdb_open(const char *path, uint64_t capacity, int writable);
+void tsdb_close(struct tsdb *db);
+
+/* Schedule the dirty pages for writing to disk */
+void tsdb_sync(struct tsdb *db);
+
+/* Index of a mote address, added if new; -1 if the table of TSDB_MOTES
+   is full */
+int tsdb_mote(struct tsdb *db, const uint8_t *addr);
+
+/* Times earlier than the last record are moved up to it, to keep the
+   time column sorted. */
+void tsdb_append(struct tsdb *db, int64_t time, uint16_t mote,
+                 uint8_t kind, int32_t value);
+
+/* Records are numbered from 0 when the store was created; those from
+   tsdb_first() to tsdb_count() - 1 are in the file, at slot
+   number % capacity. */
+uint64_t tsdb_count(const struct tsdb *db);
+uint64_t tsdb_first(const struct tsdb *db);
+#define TSDB_SLOT(db, n) ((n) % (db)->hdr->capacity)
+
+/* Number of the first record at or after time, tsdb_count() if none */
+uint64_t tsdb_find(const struct tsdb *db, int64_t time);
+
+const char *tsdb_kind_name(uint8_t kind);
+
+#endif /* __TSDB_H__ */
@@ -0,0 +1,592 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ */
+
+/**
+ * \file
+ *         Host end of the SLIP tunnel with header-compressed framing
+ *
+ *         A reduced tunslip6: it bridges a tun interface and the border
+ *         router's serial line (or the Cooja serial socket), answers the
+ *         router's prefix requests and, with -H, negotiates the compressed
+ *         framing of rpl-border-router/slip-hc.c. Against a router built
+ *         without WITH_SLIP_HC=1 it falls back to plain framing.
+ *
+ *         With -R it installs a /128 route on its tun interface for each
+ *         mote the router reports (rpl-border-router/br-multi.c), so that
+ *         several routers, each with a tunnel of its own, can serve one
+ *         mesh and prefix.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "slip-hc.h"
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+#define BUF_SIZE 2048
+
+/* Motes reported by the router, -R */
+#define MAX_ROUTES 1024
+#define IID_LEN    8
+
+static int slipfd = -1;
+static int tunfd = -1;
+static int verbose;
+static int want_hc;
+static int hc_tx;
+static struct in6_addr prefix;
+static char tun[IFNAMSIZ] = "tun0";
+static int want_routes;
+
+static struct {
+  uint8_t iid[IID_LEN];
+  uint8_t seen;                 /* in the listing being received */
+} routes[MAX_ROUTES];
+static int nroutes;
+
+/* Bytes of IPv6 carried and bytes actually put on the serial line */
+static unsigned long ip_bytes_out, slip_bytes_out;
+static unsigned long ip_bytes_in, slip_bytes_in;
+static volatile sig_atomic_t stop;
+/*---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+  fprintf(stderr,
+          "usage: tunslip6-hc [-H] [-R] [-v] [-B baud] [-s device] "
+          "[-a host] [-p port] [-t tun] ipaddress/64\n"
+          "  -H  negotiate header-compressed framing with the router\n"
+          "  -R  route the motes the router reports through this tunnel\n"
+          "  -a  connect to a TCP serial socket (e.g. Cooja) instead\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_all(int fd, const uint8_t *buf, size_t len)
+{
+  ssize_t n;
+
+  while(len > 0) {
+    n = write(fd, buf, len);
+    if(n < 0) {
+      if(errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      perror("write");
+      exit(1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+slip_send_frame(const uint8_t *data, size_t len)
+{
+  uint8_t out[2 * BUF_SIZE + 2];
+  size_t i, n = 0;
+
+  out[n++] = SLIP_END;
+  for(i = 0; i < len; i++) {
+    if(data[i] == SLIP_END) {
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_END;
+    } else if(data[i] == SLIP_ESC) {
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_ESC;
+    } else {
+      out[n++] = data[i];
+    }
+  }
+  out[n++] = SLIP_END;
+  write_all(slipfd, out, n);
+  slip_bytes_out += n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_prefix(void)
+{
+  uint8_t msg[10];
+
+  msg[0] = '!';
+  msg[1] = 'P';
+  memcpy(&msg[2], prefix.s6_addr, 8);
+  slip_send_frame(msg, sizeof(msg));
+  if(want_hc) {
+    /* A router that (re)asks for the prefix has restarted: compress only
+       after it acknowledged again. */
+    hc_tx = 0;
+    slip_send_frame((const uint8_t *)"?H", 2);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *cmd)
+{
+  if(verbose) {
+    printf("tunslip6-hc: %s\n", cmd);
+  }
+  if(system(cmd) != 0) {
+    fprintf(stderr, "tunslip6-hc: '%s' failed\n", cmd);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_route(const uint8_t *iid, const char *verb, int quiet)
+{
+  struct in6_addr a;
+  char str[INET6_ADDRSTRLEN];
+  char cmd[256];
+
+  a = prefix;
+  memcpy(&a.s6_addr[8], iid, IID_LEN);
+  inet_ntop(AF_INET6, &a, str, sizeof(str));
+  snprintf(cmd, sizeof(cmd), "ip -6 route %s %s/128 dev %s", verb, str, tun);
+  if(!quiet) {
+    run(cmd);
+    return;
+  }
+  /* Expected to fail at times, e.g. when the route is held by the tunnel
+     of another router */
+  if(verbose) {
+    printf("tunslip6-hc: %s\n", cmd);
+  }
+  strncat(cmd, " 2>/dev/null", sizeof(cmd) - strlen(cmd) - 1);
+  if(system(cmd) != 0 && verbose) {
+    printf("tunslip6-hc: left as it is\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+find_route(const uint8_t *iid)
+{
+  int i;
+
+  for(i = 0; i < nroutes; i++) {
+    if(memcmp(routes[i].iid, iid, IID_LEN) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+drop_route(int i)
+{
+  set_route(routes[i].iid, "del", 1);
+  routes[i] = routes[--nroutes];
+}
+/*---------------------------------------------------------------------------*/
+/* A route report: records '+' or '-' with the interface identifier of a
+   mote, and listings between '*' and '.' */
+static void
+handle_routes(const uint8_t *rec, size_t len)
+{
+  static int listing;
+  int i;
+
+  while(len > 0) {
+    switch(rec[0]) {
+    case '*':
+      listing = 1;
+      for(i = 0; i < nroutes; i++) {
+        routes[i].seen = 0;
+      }
+      rec++; len--;
+      continue;
+    case '.':
+      if(listing) {
+        for(i = nroutes - 1; i >= 0; i--) {
+          if(!routes[i].seen) {
+            drop_route(i);
+          }
+        }
+      }
+      listing = 0;
+      rec++; len--;
+      continue;
+    case '+':
+    case '-':
+      if(len < 1 + IID_LEN) {
+        return;
+      }
+      break;
+    default:
+      fprintf(stderr, "tunslip6-hc: bad route record 0x%02x\n", rec[0]);
+      return;
+    }
+    i = find_route(rec + 1);
+    if(rec[0] == '-') {
+      if(i >= 0) {
+        drop_route(i);
+      }
+    } else if(i < 0 && nroutes == MAX_ROUTES) {
+      fprintf(stderr, "tunslip6-hc: too many routes\n");
+    } else {
+      if(i < 0) {
+        i = nroutes++;
+        memcpy(routes[i].iid, rec + 1, IID_LEN);
+      }
+      if(!listing) {
+        /* A mote that moved from another router takes its route along */
+        set_route(rec + 1, "replace", 0);
+      } else {
+        /* Listed: only put back a route that was lost, and leave it with
+           another router that reported the mote since */
+        set_route(rec + 1, "add", 1);
+      }
+      routes[i].seen = 1;
+    }
+    rec += 1 + IID_LEN;
+    len -= 1 + IID_LEN;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_frame(uint8_t *frame, size_t len)
+{
+  uint16_t iplen;
+
+  if(len == 0) {
+    return;
+  }
+  switch(frame[0]) {
+  case '\r':
+    /* Debug output of the router */
+    fwrite(frame + 1, 1, len - 1, stdout);
+    fflush(stdout);
+    return;
+  case '?':
+    if(len >= 2 && frame[1] == 'P') {
+      send_prefix();
+    }
+    return;
+  case '!':
+    if(len >= 2 && frame[1] == 'H') {
+      if(verbose) {
+        printf("tunslip6-hc: compressed framing enabled\n");
+      }
+      hc_tx = 1;
+    } else if(len >= 2 && frame[1] == 'R' && want_routes) {
+      handle_routes(frame + 2, len - 2);
+    }
+    return;
+  case SLIP_HC_DISPATCH:
+    iplen = slip_hc_decompress(frame, len, BUF_SIZE);
+    if(iplen == 0) {
+      fprintf(stderr, "tunslip6-hc: malformed compressed frame\n");
+      return;
+    }
+    break;
+  default:
+    if((frame[0] & 0xf0) != 0x60) {
+      if(verbose) {
+        fprintf(stderr, "tunslip6-hc: unknown frame type 0x%02x\n", frame[0]);
+      }
+      return;
+    }
+    iplen = len;
+  }
+  ip_bytes_in += iplen;
+  write_all(tunfd, frame, iplen);
+}
+/*---------------------------------------------------------------------------*/
+static void
+serial_input(void)
+{
+  static uint8_t frame[BUF_SIZE];
+  static size_t flen;
+  static int esc;
+  static int overflow;
+  uint8_t in[BUF_SIZE];
+  ssize_t n;
+  ssize_t i;
+
+  n = read(slipfd, in, sizeof(in));
+  if(n <= 0) {
+    if(n < 0 && (errno == EINTR || errno == EAGAIN)) {
+      return;
+    }
+    fprintf(stderr, "tunslip6-hc: serial line closed\n");
+    exit(1);
+  }
+  slip_bytes_in += n;
+
+  for(i = 0; i < n; i++) {
+    uint8_t c = in[i];
+    if(c == SLIP_END) {
+      if(!overflow) {
+        handle_frame(frame, flen);
+      }
+      flen = 0;
+      esc = 0;
+      overflow = 0;
+      continue;
+    }
+    if(esc) {
+      c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+      esc = 0;
+    } else if(c == SLIP_ESC) {
+      esc = 1;
+      continue;
+    }
+    if(flen < sizeof(frame)) {
+      frame[flen++] = c;
+    } else {
+      overflow = 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+tun_input(void)
+{
+  uint8_t buf[BUF_SIZE];
+  ssize_t n;
+  uint16_t len;
+
+  n = read(tunfd, buf, sizeof(buf));
+  if(n <= 0) {
+    return;
+  }
+  ip_bytes_out += n;
+  len = n;
+  if(hc_tx) {
+    uint16_t clen = slip_hc_compress(buf, len);
+    if(clen > 0) {
+      len = clen;
+    }
+  }
+  slip_send_frame(buf, len);
+}
+/*---------------------------------------------------------------------------*/
+static speed_t
+baud_to_speed(int baud)
+{
+  switch(baud) {
+  case 9600: return B9600;
+  case 19200: return B19200;
+  case 38400: return B38400;
+  case 57600: return B57600;
+  case 115200: return B115200;
+  case 230400: return B230400;
+  default:
+    fprintf(stderr, "tunslip6-hc: unsupported baud rate %d\n", baud);
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_serial(const char *device, int baud)
+{
+  struct termios tty;
+  int fd;
+
+  fd = open(device, O_RDWR | O_NOCTTY);
+  if(fd < 0) {
+    perror(device);
+    exit(1);
+  }
+  if(tcgetattr(fd, &tty) < 0) {
+    perror("tcgetattr");
+    exit(1);
+  }
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~CRTSCTS;
+  cfsetispeed(&tty, baud_to_speed(baud));
+  cfsetospeed(&tty, baud_to_speed(baud));
+  if(tcsetattr(fd, TCSAFLUSH, &tty) < 0) {
+    perror("tcsetattr");
+    exit(1);
+  }
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_socket(const char *host, const char *port)
+{
+  struct addrinfo hints, *res, *r;
+  int fd = -1;
+  int err;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  err = getaddrinfo(host, port, &hints, &res);
+  if(err != 0) {
+    fprintf(stderr, "tunslip6-hc: %s: %s\n", host, gai_strerror(err));
+    exit(1);
+  }
+  for(r = res; r != NULL; r = r->ai_next) {
+    fd = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+    if(fd < 0) {
+      continue;
+    }
+    if(connect(fd, r->ai_addr, r->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if(fd < 0) {
+    fprintf(stderr, "tunslip6-hc: cannot connect to %s:%s\n", host, port);
+    exit(1);
+  }
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_tun(char *name)
+{
+  struct ifreq ifr;
+  int fd;
+
+  fd = open("/dev/net/tun", O_RDWR);
+  if(fd < 0) {
+    perror("/dev/net/tun");
+    exit(1);
+  }
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+  snprintf(ifr.ifr_name, IFNAMSIZ, "%s", name);
+  if(ioctl(fd, TUNSETIFF, &ifr) < 0) {
+    perror("TUNSETIFF");
+    exit(1);
+  }
+  strcpy(name, ifr.ifr_name);
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  char cmd[256];
+  char addr[INET6_ADDRSTRLEN];
+  const char *device = "/dev/ttyUSB0";
+  const char *host = NULL;
+  const char *port = "60001";
+  char *slash;
+  int baud = 115200;
+  int c;
+
+  while((c = getopt(argc, argv, "HRvB:s:a:p:t:")) != -1) {
+    switch(c) {
+    case 'H': want_hc = 1; break;
+    case 'R': want_routes = 1; break;
+    case 'v': verbose = 1; break;
+    case 'B': baud = atoi(optarg); break;
+    case 's': device = optarg; break;
+    case 'a': host = optarg; break;
+    case 'p': port = optarg; break;
+    case 't': strncpy(tun, optarg, sizeof(tun) - 1); break;
+    default: usage();
+    }
+  }
+  if(optind != argc - 1) {
+    usage();
+  }
+
+  snprintf(addr, sizeof(addr), "%s", argv[optind]);
+  slash = strchr(addr, '/');
+  if(slash != NULL) {
+    *slash = '\0';
+  }
+  if(inet_pton(AF_INET6, addr, &prefix) != 1) {
+    fprintf(stderr, "tunslip6-hc: bad address %s\n", argv[optind]);
+    exit(1);
+  }
+  slip_hc_set_context(prefix.s6_addr);
+
+  slipfd = host != NULL ? open_socket(host, port) : open_serial(device, baud);
+  tunfd = open_tun(tun);
+  snprintf(cmd, sizeof(cmd), "ip link set %s up", tun);
+  run(cmd);
+  snprintf(cmd, sizeof(cmd), "ip -6 address add %s dev %s", argv[optind], tun);
+  run(cmd);
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  /* The router may already be running: offer the prefix right away. */
+  send_prefix();
+
+  while(!stop) {
+    fd_set rset;
+    int maxfd = slipfd > tunfd ? slipfd : tunfd;
+
+    FD_ZERO(&rset);
+    FD_SET(slipfd, &rset);
+    FD_SET(tunfd, &rset);
+    if(select(maxfd + 1, &rset, NULL, NULL, NULL) < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      perror("select");
+      exit(1);
+    }
+    if(FD_ISSET(slipfd, &rset)) {
+      serial_input();
+    }
+    if(FD_ISSET(tunfd, &rset)) {
+      tun_input();
+    }
+  }
+
+  printf("tunslip6-hc: to router %lu IPv6 bytes in %lu serial bytes, "
+         "from router %lu IPv6 bytes in %lu serial bytes\n",
+         ip_bytes_out, slip_bytes_out, ip_bytes_in, slip_bytes_in);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/